@@ -0,0 +1,204 @@
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+
+#include "benchmark.h"
+#include "overthrower.h"
+#include "test_helpers.h"
+
+namespace {
+
+// Nine rows out of ten have b = 0, the rest spread over 10000 values; c is uniform over 1000 values. With no statistics
+// both indexes look alike, stat1 only knows the average number of rows per b and stat4 knows about the hot value.
+std::string skewedTableSql(int rows)
+{
+    return "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c);"
+           "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < "
+        + std::to_string(rows)
+        + ") INSERT INTO test_table(b, c) SELECT CASE WHEN i % 10 < 9 THEN 0 ELSE (i * 7919) % 10000 + 1 END, (i * 104729) % 1000 FROM n;"
+          "CREATE INDEX test_b_idx ON test_table(b); CREATE INDEX test_c_idx ON test_table(c)";
+}
+
+const struct {
+    const char* name;
+    const char* sql;
+} skewed_queries[] = {
+    { "hot b, rare c", "SELECT count(*) FROM test_table WHERE b = 0 AND c = 5" },
+    { "rare b, half of c", "SELECT count(*) FROM test_table WHERE b = 1234 AND c < 500" },
+    { "b range, rare c", "SELECT count(*) FROM test_table WHERE b > 9000 AND c = 7" },
+    { "b IN, rare c", "SELECT count(*) FROM test_table WHERE b IN (0, 1, 2) AND c = 9" },
+    { "hot b, ORDER BY c", "SELECT sum(a) FROM (SELECT a FROM test_table WHERE b = 0 ORDER BY c, a LIMIT 10)" },
+};
+
+// Keeps sqlite_stat1 and makes the planner forget the samples of sqlite_stat4
+#define DROP_STAT4 "DELETE FROM sqlite_stat4; ANALYZE sqlite_master"
+
+} // namespace
+
+TEST(SQLite3, Analyze)
+{
+    static constexpr int rows_to_insert = 2000;
+
+    // Statistics change plans, never answers
+    std::vector<int64_t> expected;
+    {
+        sqlite3* handle = nullptr;
+        ASSERT_EQ(sqlite3_open(":memory:", &handle), SQLITE_OK);
+        ASSERT_EQ(sqlite3_exec(handle, skewedTableSql(rows_to_insert).c_str(), nullptr, nullptr, nullptr), SQLITE_OK);
+        for (const auto& query : skewed_queries) {
+            expected.push_back(-1);
+            ASSERT_EQ(queryInteger(handle, query.sql, &expected.back()), SQLITE_OK) << query.sql;
+        }
+        ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    }
+
+    static const char* const maintenance[] = { "PRAGMA optimize", "ANALYZE", "ANALYZE test_table" };
+
+    int status;
+
+    auto tryAnalyze = [&](DefaultOverthrower& overthrower) {
+        overthrower.activate();
+        sqlite3* handle = nullptr;
+        removeDbIfExists(overthrower);
+        {
+            OverthrowerPauser pauser;
+            ASSERT_EQ(sqlite3_open(TEST_DB_FILE_NAME, &handle), SQLITE_OK);
+            ASSERT_EQ(sqlite3_exec(handle, skewedTableSql(rows_to_insert).c_str(), nullptr, nullptr, nullptr), SQLITE_OK);
+        }
+
+        // The queries before and after every statement, PRAGMA optimize looks at what the connection has run so far
+        status = SQLITE_OK;
+        for (size_t step = 0; step <= sizeof(maintenance) / sizeof(maintenance[0]) && status == SQLITE_OK; ++step) {
+            for (size_t i = 0; i < sizeof(skewed_queries) / sizeof(skewed_queries[0]) && status == SQLITE_OK; ++i) {
+                int64_t value = -1;
+                status = queryInteger(handle, skewed_queries[i].sql, &value);
+                if (status == SQLITE_OK) {
+                    OverthrowerPauser pauser;
+                    ASSERT_EQ(value, expected[i]) << skewed_queries[i].sql;
+                }
+            }
+            if (status == SQLITE_OK && step < sizeof(maintenance) / sizeof(maintenance[0]))
+                status = sqlite3_exec(handle, maintenance[step], nullptr, nullptr, nullptr);
+        }
+        if (status == SQLITE_OK) {
+            // Both indexes have been analyzed
+            int64_t analyzed = -1;
+            OverthrowerPauser pauser;
+            ASSERT_EQ(queryInteger(handle, "SELECT count(*) FROM sqlite_stat1 WHERE idx IN ('test_b_idx', 'test_c_idx')", &analyzed), SQLITE_OK);
+            ASSERT_EQ(analyzed, 2);
+        } else {
+            OOM_SAFE_ASSERT_EQ(status, SQLITE_NOMEM);
+        }
+
+        ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    };
+
+    runOomSweeps("SQLite3.Analyze", status, tryAnalyze);
+}
+
+TEST(Benchmark, Analyze)
+{
+    static constexpr int rows_to_insert = 1000000;
+    static constexpr int repeats = 5;
+    static constexpr int analyze_attempts = 10;
+    static constexpr unsigned int duty_cycle = 1000;
+    static constexpr const char* db_file_name = "analyze_db";
+
+    const bool stat4 = sqlite3_compileoption_used("ENABLE_STAT4") != 0;
+
+    unlink(db_file_name);
+    sqlite3* handle = nullptr;
+    ASSERT_EQ(sqlite3_open(db_file_name, &handle), SQLITE_OK);
+    ASSERT_EQ(sqlite3_exec(handle, skewedTableSql(rows_to_insert).c_str(), nullptr, nullptr, nullptr), SQLITE_OK);
+
+    std::vector<std::string> latency_columns = { "query" };
+    std::vector<std::vector<std::string>> latencies(sizeof(skewed_queries) / sizeof(skewed_queries[0]));
+    std::vector<std::vector<std::string>> plans(latencies.size());
+    std::vector<std::string> last_plans(latencies.size());
+    for (size_t i = 0; i < latencies.size(); ++i)
+        latencies[i] = plans[i] = { skewed_queries[i].name };
+
+    auto runQueries = [&](const char* stage) {
+        latency_columns.push_back(stage);
+        for (size_t i = 0; i < latencies.size(); ++i) {
+            LatencyRecorder recorder;
+            for (int repeat = 0; repeat < repeats; ++repeat) {
+                int64_t value = 0;
+                const Stopwatch stopwatch;
+                ASSERT_EQ(queryInteger(handle, skewed_queries[i].sql, &value), SQLITE_OK);
+                recorder.add(stopwatch.elapsed());
+            }
+            latencies[i].push_back(ReportTable::format("%.1f", recorder.percentile(0.5)));
+            const std::string plan = queryPlan(handle, skewed_queries[i].sql);
+            plans[i].push_back(plan == last_plans[i] ? "(same)" : plan);
+            last_plans[i] = plan;
+        }
+    };
+
+    auto timeStatement = [&handle](const char* sql) {
+        const Stopwatch stopwatch;
+        EXPECT_EQ(sqlite3_exec(handle, sql, nullptr, nullptr, nullptr), SQLITE_OK) << sql;
+        return ReportTable::format("%.3f", stopwatch.seconds());
+    };
+
+    std::vector<std::vector<std::string>> costs;
+
+    runQueries("no statistics");
+    costs.push_back({ "PRAGMA optimize", timeStatement("PRAGMA optimize") });
+    runQueries("PRAGMA optimize");
+    costs.push_back({ stat4 ? "ANALYZE (stat1 + stat4)" : "ANALYZE (stat1)", timeStatement("ANALYZE") });
+    if (stat4) {
+        ASSERT_EQ(sqlite3_exec(handle, DROP_STAT4, nullptr, nullptr, nullptr), SQLITE_OK);
+        runQueries("ANALYZE, stat1 only");
+        ASSERT_EQ(sqlite3_exec(handle, "ANALYZE", nullptr, nullptr, nullptr), SQLITE_OK);
+        runQueries("ANALYZE, stat1 + stat4");
+    } else {
+        runQueries("ANALYZE, stat1 only");
+    }
+    ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+
+    // ANALYZE retried until it succeeds with every allocation failing at random with the probability 1 / duty_cycle,
+    // each attempt opens the database so that nothing allocated under fault injection outlives it.
+    {
+        int attempts = 0;
+        int status = SQLITE_NOMEM;
+        const Stopwatch stopwatch;
+        while (status != SQLITE_OK && attempts < analyze_attempts) {
+            ++attempts;
+            OverthrowerStrategyRandom overthrower(duty_cycle);
+            overthrower.activate();
+            sqlite3* analyzed = nullptr;
+            status = sqlite3_open(db_file_name, &analyzed);
+            if (status == SQLITE_OK)
+                status = sqlite3_exec(analyzed, "ANALYZE", nullptr, nullptr, nullptr);
+            if (status != SQLITE_OK)
+                OOM_SAFE_ASSERT_EQ(status, SQLITE_NOMEM);
+            ASSERT_EQ(sqlite3_close(analyzed), SQLITE_OK);
+        }
+        costs.push_back({ "ANALYZE, 1/" + std::to_string(duty_cycle) + " allocations fail", ReportTable::format("%.3f", stopwatch.seconds()),
+            std::to_string(attempts) + (status == SQLITE_OK ? "" : " (gave up)") });
+    }
+    costs[0].push_back("1");
+    costs[1].push_back("1");
+
+    unlink(db_file_name);
+
+    ReportTable latency_report(std::to_string(rows_to_insert) + " skewed rows, median query latency us", latency_columns);
+    ReportTable plan_report("Query plans", latency_columns);
+    for (size_t i = 0; i < latencies.size(); ++i) {
+        latency_report.addRow(latencies[i]);
+        plan_report.addRow(plans[i]);
+    }
+    ReportTable cost_report("Cost of gathering statistics", { "statement", "seconds", "attempts" });
+    for (const auto& cost : costs)
+        cost_report.addRow(cost);
+
+    latency_report.print();
+    plan_report.print();
+    cost_report.print();
+}
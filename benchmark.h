@@ -0,0 +1,255 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+
+class Stopwatch final {
+public:
+    Stopwatch()
+        : started(std::chrono::steady_clock::now())
+    {
+    }
+
+    void restart() { started = std::chrono::steady_clock::now(); }
+
+    std::chrono::nanoseconds elapsed() const { return std::chrono::steady_clock::now() - started; }
+    double seconds() const { return std::chrono::duration<double>(elapsed()).count(); }
+
+private:
+    std::chrono::steady_clock::time_point started;
+};
+
+class LatencyRecorder final {
+public:
+    void reserve(size_t count) { samples.reserve(count); }
+    void add(std::chrono::nanoseconds latency) { samples.push_back(latency.count()); }
+
+    size_t count() const { return samples.size(); }
+
+    // Returns the latency (in microseconds) below which the given fraction of samples falls.
+    double percentile(double fraction)
+    {
+        if (samples.empty())
+            return 0.0;
+        if (!sorted) {
+            std::sort(samples.begin(), samples.end());
+            sorted = true;
+        }
+        const size_t index = std::min(samples.size() - 1, static_cast<size_t>(fraction * samples.size()));
+        return samples[index] / 1000.0;
+    }
+
+    double max() { return percentile(1.0); }
+
+private:
+    std::vector<long long> samples;
+    bool sorted = false;
+};
+
+static inline long long fileSize(const char* path)
+{
+    struct stat info;
+    return stat(path, &info) ? 0 : static_cast<long long>(info.st_size);
+}
+
+// Prints benchmark results as a fixed width table so that runs can be compared side by side.
+class ReportTable final {
+public:
+    ReportTable(std::string title, std::vector<std::string> columns)
+        : title(std::move(title))
+        , header(std::move(columns))
+    {
+    }
+
+    void addRow(std::vector<std::string> row) { rows.push_back(std::move(row)); }
+
+    static std::string format(const char* fmt, double value)
+    {
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), fmt, value);
+        return buffer;
+    }
+
+    void print() const
+    {
+        std::vector<size_t> widths(header.size());
+        for (size_t i = 0; i < header.size(); ++i)
+            widths[i] = header[i].size();
+        for (const auto& row : rows) {
+            for (size_t i = 0; i < row.size() && i < widths.size(); ++i)
+                widths[i] = std::max(widths[i], row[i].size());
+        }
+
+        auto printRow = [&widths](const std::vector<std::string>& row) {
+            for (size_t i = 0; i < widths.size(); ++i)
+                printf("%s%-*s", i ? " | " : "", static_cast<int>(widths[i]), i < row.size() ? row[i].c_str() : "");
+            printf("\n");
+        };
+
+        printf("\n%s\n", title.c_str());
+        printRow(header);
+        for (size_t i = 0; i < widths.size(); ++i)
+            printf("%s%s", i ? "-+-" : "", std::string(widths[i], '-').c_str());
+        printf("\n");
+        for (const auto& row : rows)
+            printRow(row);
+        fflush(stdout);
+    }
+
+private:
+    const std::string title;
+    const std::vector<std::string> header;
+    std::vector<std::vector<std::string>> rows;
+};
+
+// Counts the calls to xMalloc and xRealloc of SQLite while it is alive. replace, if given, changes the methods which
+// are counted, e.g. to call another allocator. Installing memory methods needs sqlite3_shutdown(), so no connection may
+// be open when it is constructed or destroyed.
+class CountingMemoryMethods final {
+public:
+    explicit CountingMemoryMethods(void (*replace)(sqlite3_mem_methods* methods) = nullptr)
+    {
+        EXPECT_EQ(sqlite3_shutdown(), SQLITE_OK);
+        EXPECT_EQ(sqlite3_config(SQLITE_CONFIG_GETMALLOC, &original()), SQLITE_OK);
+        base() = original();
+        if (replace)
+            replace(&base());
+        sqlite3_mem_methods counting = base();
+        counting.xMalloc = [](int size) {
+            ++allocations();
+            return base().xMalloc(size);
+        };
+        counting.xRealloc = [](void* memory, int size) {
+            ++allocations();
+            return base().xRealloc(memory, size);
+        };
+        EXPECT_EQ(sqlite3_config(SQLITE_CONFIG_MALLOC, &counting), SQLITE_OK);
+        EXPECT_EQ(sqlite3_initialize(), SQLITE_OK);
+    }
+
+    ~CountingMemoryMethods()
+    {
+        EXPECT_EQ(sqlite3_shutdown(), SQLITE_OK);
+        EXPECT_EQ(sqlite3_config(SQLITE_CONFIG_MALLOC, &original()), SQLITE_OK);
+        EXPECT_EQ(sqlite3_initialize(), SQLITE_OK);
+    }
+
+    CountingMemoryMethods(const CountingMemoryMethods&) = delete;
+    CountingMemoryMethods& operator=(const CountingMemoryMethods&) = delete;
+
+    static long long count() { return allocations(); }
+
+private:
+    static sqlite3_mem_methods& original()
+    {
+        static sqlite3_mem_methods methods;
+        return methods;
+    }
+
+    static sqlite3_mem_methods& base()
+    {
+        static sqlite3_mem_methods methods;
+        return methods;
+    }
+
+    static long long& allocations()
+    {
+        static long long count = 0;
+        return count;
+    }
+};
+
+// The body of one phase of the Resistance workload. With a recorder the insert and select phases add the latency of
+// every single step to it, without one they do not read the clock at all.
+typedef std::function<void(LatencyRecorder* steps)> ResistancePhase;
+
+struct ResistanceOptions {
+    const char* pragmas = nullptr; // Run by "open" before test_table is created
+    bool sorted_select = false; // "select" orders by c, b DESC: a sort of the whole table
+};
+
+// The Resistance workload without fault injection, phase by phase: "open" creates test_table in a new database at path,
+// "insert" adds rows_to_insert rows in one transaction, then come "select" of all of them, "index build", "VACUUM" and
+// "close". Every phase is run by onPhase(phase, handle, body), which gets the connection as it is before the phase,
+// nullptr for "open", and has to run body once, whatever it measures or samples around it. An ASSERT in body only
+// leaves body, the workload stops after a phase with a fatal failure, callers wrap it in ASSERT_NO_FATAL_FAILURE.
+template <typename OnPhase>
+void runResistancePhases(const char* path, int rows_to_insert, OnPhase onPhase, const ResistanceOptions& options = ResistanceOptions())
+{
+    sqlite3* handle = nullptr;
+    sqlite3_stmt* statement = nullptr;
+    unlink(path);
+
+    const struct {
+        const char* name;
+        ResistancePhase body;
+    } phases[] = {
+        { "open",
+            [&](LatencyRecorder*) {
+                ASSERT_EQ(sqlite3_open(path, &handle), SQLITE_OK);
+                if (options.pragmas)
+                    ASSERT_EQ(sqlite3_exec(handle, options.pragmas, nullptr, nullptr, nullptr), SQLITE_OK);
+                ASSERT_EQ(sqlite3_exec(handle, "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)", nullptr, nullptr, nullptr), SQLITE_OK);
+            } },
+        { "insert",
+            [&](LatencyRecorder* steps) {
+                ASSERT_EQ(sqlite3_exec(handle, "BEGIN TRANSACTION", nullptr, nullptr, nullptr), SQLITE_OK);
+                ASSERT_EQ(sqlite3_prepare_v2(handle, "INSERT INTO test_table(b, c) VALUES (?, ?)", -1, &statement, nullptr), SQLITE_OK);
+                Stopwatch step;
+                for (int i = 0; i < rows_to_insert; ++i) {
+                    ASSERT_EQ(sqlite3_bind_int(statement, 1, i), SQLITE_OK);
+                    ASSERT_EQ(sqlite3_bind_text(statement, 2, "AAAAAAAAAAAAAAAA", -1, SQLITE_STATIC), SQLITE_OK);
+                    ASSERT_EQ(sqlite3_step(statement), SQLITE_DONE);
+                    ASSERT_EQ(sqlite3_reset(statement), SQLITE_OK);
+                    if (steps) {
+                        steps->add(step.elapsed());
+                        step.restart();
+                    }
+                }
+                ASSERT_EQ(sqlite3_finalize(statement), SQLITE_OK);
+                ASSERT_EQ(sqlite3_exec(handle, "END TRANSACTION", nullptr, nullptr, nullptr), SQLITE_OK);
+            } },
+        { "select",
+            [&](LatencyRecorder* steps) {
+                const char* sql = options.sorted_select ? "SELECT a, b, c FROM test_table ORDER BY c, b DESC" : "SELECT a, b, c FROM test_table";
+                ASSERT_EQ(sqlite3_prepare_v2(handle, sql, -1, &statement, nullptr), SQLITE_OK);
+                int rows = 0;
+                Stopwatch step;
+                while (sqlite3_step(statement) == SQLITE_ROW) {
+                    ASSERT_EQ(sqlite3_column_int(statement, 1), options.sorted_select ? rows_to_insert - 1 - rows : rows);
+                    ASSERT_NE(sqlite3_column_text(statement, 2), nullptr);
+                    ++rows;
+                    if (steps) {
+                        steps->add(step.elapsed());
+                        step.restart();
+                    }
+                }
+                ASSERT_EQ(rows, rows_to_insert);
+                ASSERT_EQ(sqlite3_finalize(statement), SQLITE_OK);
+            } },
+        { "index build",
+            [&](LatencyRecorder*) {
+                ASSERT_EQ(sqlite3_exec(handle, "CREATE INDEX test_idx ON test_table(a, b, c)", nullptr, nullptr, nullptr), SQLITE_OK);
+            } },
+        { "VACUUM", [&](LatencyRecorder*) { ASSERT_EQ(sqlite3_exec(handle, "VACUUM", nullptr, nullptr, nullptr), SQLITE_OK); } },
+        { "close", [&](LatencyRecorder*) { ASSERT_EQ(sqlite3_close(handle), SQLITE_OK); } },
+    };
+
+    for (const auto& phase : phases) {
+        onPhase(phase.name, handle, phase.body);
+        if (testing::Test::HasFatalFailure())
+            return;
+    }
+    unlink(path);
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <sqlite3.h>
+
+// Whole column arrays passed to a single statement through the "bulk_rows" table-valued function, e.g.
+//     INSERT INTO test_table(b, c) SELECT c0, c1 FROM bulk_rows(?)
+// where the parameter is bound with bindBulkRows(). Arrays are read in place and must outlive the statement step.
+#define BULK_ROWS_MAX_COLUMNS 8
+#define BULK_ROWS_POINTER_TYPE "BulkColumns"
+
+struct BulkColumn {
+    enum Type { INTEGER, REAL, TEXT };
+
+    Type type;
+    const void* values; // const int64_t*, const double* or const char* const* (NUL-terminated, nullptr means NULL)
+};
+
+struct BulkColumns {
+    int64_t row_count = 0;
+    int column_count = 0;
+    BulkColumn columns[BULK_ROWS_MAX_COLUMNS];
+
+    bool add(const int64_t* values) { return add(BulkColumn::INTEGER, values); }
+    bool add(const double* values) { return add(BulkColumn::REAL, values); }
+    bool add(const char* const* values) { return add(BulkColumn::TEXT, values); }
+
+private:
+    bool add(BulkColumn::Type type, const void* values)
+    {
+        if (column_count == BULK_ROWS_MAX_COLUMNS)
+            return false;
+        columns[column_count++] = { type, values };
+        return true;
+    }
+};
+
+namespace bulk_rows {
+
+enum { COLUMN_SOURCE = BULK_ROWS_MAX_COLUMNS };
+
+struct Cursor {
+    sqlite3_vtab_cursor base;
+    const BulkColumns* source;
+    int64_t row;
+};
+
+inline int connect(sqlite3* handle, void*, int, const char* const*, sqlite3_vtab** vtab, char**)
+{
+    const int status = sqlite3_declare_vtab(handle, "CREATE TABLE x(c0, c1, c2, c3, c4, c5, c6, c7, source HIDDEN)");
+    if (status != SQLITE_OK)
+        return status;
+    *vtab = static_cast<sqlite3_vtab*>(sqlite3_malloc(sizeof(sqlite3_vtab)));
+    if (!*vtab)
+        return SQLITE_NOMEM;
+    memset(*vtab, 0, sizeof(sqlite3_vtab));
+    return SQLITE_OK;
+}
+
+inline int disconnect(sqlite3_vtab* vtab)
+{
+    sqlite3_free(vtab);
+    return SQLITE_OK;
+}
+
+// Without the source argument there is nothing to scan, so such plans are made as unattractive as possible.
+inline int bestIndex(sqlite3_vtab*, sqlite3_index_info* info)
+{
+    for (int i = 0; i < info->nConstraint; ++i) {
+        const auto& constraint = info->aConstraint[i];
+        if (constraint.usable && constraint.iColumn == COLUMN_SOURCE && constraint.op == SQLITE_INDEX_CONSTRAINT_EQ) {
+            info->aConstraintUsage[i].argvIndex = 1;
+            info->aConstraintUsage[i].omit = 1;
+            info->idxNum = 1;
+            info->estimatedCost = 1000000;
+            info->estimatedRows = 1000000;
+            return SQLITE_OK;
+        }
+    }
+    info->idxNum = 0;
+    info->estimatedCost = 2147483647;
+    return SQLITE_OK;
+}
+
+inline int openCursor(sqlite3_vtab*, sqlite3_vtab_cursor** cursor)
+{
+    Cursor* result = static_cast<Cursor*>(sqlite3_malloc(sizeof(Cursor)));
+    if (!result)
+        return SQLITE_NOMEM;
+    memset(result, 0, sizeof(Cursor));
+    *cursor = &result->base;
+    return SQLITE_OK;
+}
+
+inline int closeCursor(sqlite3_vtab_cursor* cursor)
+{
+    sqlite3_free(cursor);
+    return SQLITE_OK;
+}
+
+inline int filter(sqlite3_vtab_cursor* base, int index_number, const char*, int argc, sqlite3_value** argv)
+{
+    Cursor* cursor = reinterpret_cast<Cursor*>(base);
+    cursor->source = index_number == 1 && argc == 1 ? static_cast<const BulkColumns*>(sqlite3_value_pointer(argv[0], BULK_ROWS_POINTER_TYPE)) : nullptr;
+    cursor->row = 0;
+    return SQLITE_OK;
+}
+
+inline int next(sqlite3_vtab_cursor* base)
+{
+    ++reinterpret_cast<Cursor*>(base)->row;
+    return SQLITE_OK;
+}
+
+inline int eof(sqlite3_vtab_cursor* base)
+{
+    const Cursor* cursor = reinterpret_cast<Cursor*>(base);
+    return !cursor->source || cursor->row >= cursor->source->row_count;
+}
+
+inline int column(sqlite3_vtab_cursor* base, sqlite3_context* context, int index)
+{
+    const Cursor* cursor = reinterpret_cast<Cursor*>(base);
+    if (index >= cursor->source->column_count)
+        return SQLITE_OK; // Result is NULL by default
+    const BulkColumn& source_column = cursor->source->columns[index];
+    switch (source_column.type) {
+    case BulkColumn::INTEGER:
+        sqlite3_result_int64(context, static_cast<const int64_t*>(source_column.values)[cursor->row]);
+        break;
+    case BulkColumn::REAL:
+        sqlite3_result_double(context, static_cast<const double*>(source_column.values)[cursor->row]);
+        break;
+    case BulkColumn::TEXT:
+        if (const char* text = static_cast<const char* const*>(source_column.values)[cursor->row])
+            sqlite3_result_text(context, text, -1, SQLITE_STATIC);
+        break;
+    }
+    return SQLITE_OK;
+}
+
+inline int rowid(sqlite3_vtab_cursor* base, sqlite3_int64* rowid)
+{
+    *rowid = reinterpret_cast<Cursor*>(base)->row + 1;
+    return SQLITE_OK;
+}
+
+static const sqlite3_module module = {
+    0, // iVersion
+    nullptr, // xCreate, table-valued function only
+    connect, bestIndex, disconnect, nullptr, openCursor, closeCursor, filter, next, eof, column, rowid,
+};
+
+} // namespace bulk_rows
+
+inline int registerBulkRows(sqlite3* handle)
+{
+    return sqlite3_create_module_v2(handle, "bulk_rows", &bulk_rows::module, nullptr, nullptr);
+}
+
+inline int bindBulkRows(sqlite3_stmt* statement, int index, const BulkColumns* columns)
+{
+    return sqlite3_bind_pointer(statement, index, const_cast<BulkColumns*>(columns), BULK_ROWS_POINTER_TYPE, nullptr);
+}
@@ -0,0 +1,173 @@
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+
+#include "benchmark.h"
+#include "bulk_insert.h"
+#include "overthrower.h"
+#include "test_helpers.h"
+
+#define BULK_INSERT_SQL "INSERT INTO test_table(b, c) SELECT c0, c1 FROM bulk_rows(?)"
+
+namespace {
+
+struct TestRows {
+    explicit TestRows(int count)
+        : b(count)
+        , c(count, "AAAAAAAAAAAAAAAA")
+    {
+        for (int i = 0; i < count; ++i)
+            b[i] = i;
+        columns.row_count = count;
+        columns.add(b.data());
+        columns.add(c.data());
+    }
+
+    std::vector<int64_t> b;
+    std::vector<const char*> c;
+    BulkColumns columns;
+};
+
+int countRows(sqlite3* handle)
+{
+    sqlite3_stmt* statement = nullptr;
+    int count = -1;
+    if (sqlite3_prepare_v2(handle, "SELECT count(*) FROM test_table", -1, &statement, nullptr) == SQLITE_OK && sqlite3_step(statement) == SQLITE_ROW)
+        count = sqlite3_column_int(statement, 0);
+    sqlite3_finalize(statement);
+    return count;
+}
+
+} // namespace
+
+TEST(SQLite3, BulkInsert)
+{
+    static constexpr int rows_to_insert = 1000;
+
+    const TestRows rows(rows_to_insert);
+
+    int status;
+
+    auto tryBulkInsert = [&status, &rows](DefaultOverthrower& overthrower) {
+        overthrower.activate();
+        sqlite3* handle = nullptr;
+        removeDbIfExists(overthrower);
+        {
+            OverthrowerPauser pauser;
+            ASSERT_EQ(sqlite3_open(TEST_DB_FILE_NAME, &handle), SQLITE_OK);
+            ASSERT_EQ(sqlite3_exec(handle, "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)", nullptr, nullptr, nullptr), SQLITE_OK);
+        }
+
+        sqlite3_stmt* statement = nullptr;
+        status = registerBulkRows(handle);
+        if (status == SQLITE_OK)
+            status = sqlite3_prepare_v2(handle, BULK_INSERT_SQL, -1, &statement, nullptr);
+        if (status == SQLITE_OK)
+            status = bindBulkRows(statement, 1, &rows.columns);
+        if (status == SQLITE_OK)
+            status = sqlite3_step(statement) == SQLITE_DONE ? SQLITE_OK : sqlite3_errcode(handle);
+        sqlite3_finalize(statement);
+
+        {
+            // The statement is atomic, a failure must not leave a partially inserted array behind
+            OverthrowerPauser pauser;
+            ASSERT_EQ(countRows(handle), status == SQLITE_OK ? rows_to_insert : 0);
+        }
+
+        ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    };
+
+    runOomSweeps("SQLite3.BulkInsert", status, tryBulkInsert);
+}
+
+TEST(Benchmark, BulkInsert)
+{
+    static constexpr int rows_to_insert = 1000000;
+
+    const TestRows rows(rows_to_insert);
+
+    sqlite3* handle = nullptr;
+    ASSERT_EQ(sqlite3_open(":memory:", &handle), SQLITE_OK);
+    ASSERT_EQ(registerBulkRows(handle), SQLITE_OK);
+
+    // SQLite 3.28 allows 999 parameters per statement by default
+    const int rows_per_values = sqlite3_limit(handle, SQLITE_LIMIT_VARIABLE_NUMBER, -1) / 2;
+
+    auto insertRowByRow = [&handle, &rows]() {
+        sqlite3_stmt* statement = nullptr;
+        ASSERT_EQ(sqlite3_prepare_v2(handle, "INSERT INTO test_table(b, c) VALUES (?, ?)", -1, &statement, nullptr), SQLITE_OK);
+        for (int i = 0; i < rows_to_insert; ++i) {
+            ASSERT_EQ(sqlite3_reset(statement), SQLITE_OK);
+            ASSERT_EQ(sqlite3_bind_int64(statement, 1, rows.b[i]), SQLITE_OK);
+            ASSERT_EQ(sqlite3_bind_text(statement, 2, rows.c[i], -1, SQLITE_STATIC), SQLITE_OK);
+            ASSERT_EQ(sqlite3_step(statement), SQLITE_DONE);
+        }
+        ASSERT_EQ(sqlite3_finalize(statement), SQLITE_OK);
+    };
+
+    auto insertMultiRowValues = [&handle, &rows, rows_per_values]() {
+        std::string sql = "INSERT INTO test_table(b, c) VALUES (?, ?)";
+        for (int i = 1; i < rows_per_values; ++i)
+            sql += ", (?, ?)";
+        sqlite3_stmt* statement = nullptr;
+        ASSERT_EQ(sqlite3_prepare_v2(handle, sql.c_str(), -1, &statement, nullptr), SQLITE_OK);
+        int i = 0;
+        for (; i + rows_per_values <= rows_to_insert; i += rows_per_values) {
+            ASSERT_EQ(sqlite3_reset(statement), SQLITE_OK);
+            for (int j = 0; j < rows_per_values; ++j) {
+                ASSERT_EQ(sqlite3_bind_int64(statement, j * 2 + 1, rows.b[i + j]), SQLITE_OK);
+                ASSERT_EQ(sqlite3_bind_text(statement, j * 2 + 2, rows.c[i + j], -1, SQLITE_STATIC), SQLITE_OK);
+            }
+            ASSERT_EQ(sqlite3_step(statement), SQLITE_DONE);
+        }
+        ASSERT_EQ(sqlite3_finalize(statement), SQLITE_OK);
+        // The tail which does not fill a whole statement
+        for (; i < rows_to_insert; ++i) {
+            const std::string row = "INSERT INTO test_table(b, c) VALUES (" + std::to_string(rows.b[i]) + ", '" + rows.c[i] + "')";
+            ASSERT_EQ(sqlite3_exec(handle, row.c_str(), nullptr, nullptr, nullptr), SQLITE_OK);
+        }
+    };
+
+    auto insertBulkRows = [&handle, &rows]() {
+        sqlite3_stmt* statement = nullptr;
+        ASSERT_EQ(sqlite3_prepare_v2(handle, BULK_INSERT_SQL, -1, &statement, nullptr), SQLITE_OK);
+        ASSERT_EQ(bindBulkRows(statement, 1, &rows.columns), SQLITE_OK);
+        ASSERT_EQ(sqlite3_step(statement), SQLITE_DONE);
+        ASSERT_EQ(sqlite3_finalize(statement), SQLITE_OK);
+    };
+
+    struct Method {
+        const char* name;
+        std::function<void()> insert;
+    };
+    const Method methods[] = {
+        { "row by row", insertRowByRow },
+        { "multi-row VALUES", insertMultiRowValues },
+        { "bulk_rows array", insertBulkRows },
+    };
+
+    ReportTable report("Bulk loading of " + std::to_string(rows_to_insert) + " rows in a single transaction", { "method", "seconds", "rows/s" });
+
+    for (const auto& method : methods) {
+        ASSERT_EQ(sqlite3_exec(handle, "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)", nullptr, nullptr, nullptr), SQLITE_OK);
+        ASSERT_EQ(sqlite3_exec(handle, "CREATE INDEX test_idx ON test_table(a, b, c)", nullptr, nullptr, nullptr), SQLITE_OK);
+
+        const Stopwatch stopwatch;
+        ASSERT_EQ(sqlite3_exec(handle, "BEGIN TRANSACTION", nullptr, nullptr, nullptr), SQLITE_OK);
+        method.insert();
+        ASSERT_EQ(sqlite3_exec(handle, "END TRANSACTION", nullptr, nullptr, nullptr), SQLITE_OK);
+        const double elapsed = stopwatch.seconds();
+
+        ASSERT_EQ(countRows(handle), rows_to_insert);
+        ASSERT_EQ(sqlite3_exec(handle, "DROP TABLE test_table", nullptr, nullptr, nullptr), SQLITE_OK);
+
+        report.addRow({ method.name, ReportTable::format("%.3f", elapsed), ReportTable::format("%.0f", rows_to_insert / elapsed) });
+    }
+
+    ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    report.print();
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <sqlite3.h>
+
+// Destination of one result column. All arrays are owned by the caller and must hold as many rows as requested from
+// ColumnarFetcher::fetch(), offsets one more. Text of row i occupies arena[offsets[i], offsets[i + 1]).
+struct ColumnBuffer {
+    enum Type { INTEGER, REAL, TEXT };
+
+    Type type;
+    int64_t* integers = nullptr;
+    double* reals = nullptr;
+    uint32_t* offsets = nullptr;
+    char* arena = nullptr;
+    uint32_t arena_capacity = 0;
+    uint8_t* nulls = nullptr; // Optional, set to 1 for NULL values which are stored as 0, 0.0 or empty text
+
+    static ColumnBuffer integer(int64_t* values, uint8_t* nulls = nullptr)
+    {
+        ColumnBuffer result(INTEGER, nulls);
+        result.integers = values;
+        return result;
+    }
+
+    static ColumnBuffer real(double* values, uint8_t* nulls = nullptr)
+    {
+        ColumnBuffer result(REAL, nulls);
+        result.reals = values;
+        return result;
+    }
+
+    static ColumnBuffer text(uint32_t* offsets, char* arena, uint32_t arena_capacity, uint8_t* nulls = nullptr)
+    {
+        ColumnBuffer result(TEXT, nulls);
+        result.offsets = offsets;
+        result.arena = arena;
+        result.arena_capacity = arena_capacity;
+        return result;
+    }
+
+private:
+    ColumnBuffer(Type type, uint8_t* nulls)
+        : type(type)
+        , nulls(nulls)
+    {
+    }
+};
+
+// Steps a prepared statement and stores result columns into caller provided arrays a batch of rows at a time.
+class ColumnarFetcher final {
+public:
+    ColumnarFetcher(sqlite3_stmt* statement, ColumnBuffer* columns, int column_count)
+        : statement(statement)
+        , columns(columns)
+        , column_count(column_count)
+    {
+    }
+
+    // Fills up to max_rows rows and stores their number into *rows. Returns SQLITE_ROW if more rows may follow,
+    // SQLITE_DONE once the statement is exhausted or an error code. Rows fetched before an error stay valid.
+    // A row which does not fit into a text arena or whose conversion failed is kept and stored by the next call.
+    // SQLITE_TOOBIG means that the pending row does not fit into an empty arena: it can only be fetched into larger ones.
+    int fetch(size_t max_rows, size_t* rows)
+    {
+        *rows = 0;
+        for (int i = 0; i < column_count; ++i) {
+            if (columns[i].type == ColumnBuffer::TEXT)
+                columns[i].offsets[0] = 0;
+        }
+
+        while (*rows < max_rows) {
+            if (!pending) {
+                const int status = sqlite3_step(statement);
+                if (status != SQLITE_ROW)
+                    return status;
+                pending = true;
+            }
+            const int status = storeRow(*rows);
+            if (status == SQLITE_FULL)
+                return *rows ? SQLITE_ROW : SQLITE_TOOBIG;
+            if (status != SQLITE_OK)
+                return status;
+            pending = false;
+            ++*rows;
+        }
+        return SQLITE_ROW;
+    }
+
+private:
+    int storeRow(size_t row)
+    {
+        // Text is checked first so that a row is either stored completely or not at all
+        for (int i = 0; i < column_count; ++i) {
+            ColumnBuffer& column = columns[i];
+            if (column.type != ColumnBuffer::TEXT)
+                continue;
+            // The type has to be taken before sqlite3_column_text() converts the value
+            const int type = sqlite3_column_type(statement, i);
+            const bool is_null = type == SQLITE_NULL;
+            const unsigned char* text = sqlite3_column_text(statement, i);
+            const uint32_t size = static_cast<uint32_t>(sqlite3_column_bytes(statement, i));
+            // Besides NULL only a zero-length BLOB or TEXT may come back as nullptr, for anything else the conversion failed
+            if (!text && !is_null && (size || (type != SQLITE_BLOB && type != SQLITE_TEXT)))
+                return SQLITE_NOMEM;
+            const uint32_t begin = column.offsets[row];
+            if (column.arena_capacity - begin < size)
+                return SQLITE_FULL;
+            if (size)
+                memcpy(column.arena + begin, text, size);
+            column.offsets[row + 1] = begin + size;
+            if (column.nulls)
+                column.nulls[row] = is_null;
+        }
+
+        for (int i = 0; i < column_count; ++i) {
+            ColumnBuffer& column = columns[i];
+            if (column.type == ColumnBuffer::TEXT)
+                continue;
+            if (column.nulls)
+                column.nulls[row] = sqlite3_column_type(statement, i) == SQLITE_NULL;
+            if (column.type == ColumnBuffer::INTEGER)
+                column.integers[row] = sqlite3_column_int64(statement, i);
+            else
+                column.reals[row] = sqlite3_column_double(statement, i);
+        }
+        return SQLITE_OK;
+    }
+
+    sqlite3_stmt* const statement;
+    ColumnBuffer* const columns;
+    const int column_count;
+    bool pending = false;
+};
@@ -0,0 +1,196 @@
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+
+#include "benchmark.h"
+#include "columnar_fetch.h"
+#include "overthrower.h"
+#include "test_helpers.h"
+
+#define FILL_TEST_TABLE_SQL(ROWS)                                                                                                                              \
+    "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < " #ROWS ") INSERT INTO test_table(b, c) SELECT i, 'AAAAAAAAAAAAAAAA' FROM n"
+
+TEST(SQLite3, ColumnarFetch)
+{
+    static constexpr int rows_to_insert = 1000;
+    static constexpr size_t batch_rows = 64;
+    static constexpr uint32_t arena_capacity = 512; // Too small for a whole batch of c values
+
+    std::vector<int64_t> a(batch_rows);
+    std::vector<double> b(batch_rows);
+    std::vector<uint32_t> b_offsets(batch_rows + 1);
+    std::vector<char> b_arena(arena_capacity);
+    std::vector<uint32_t> c_offsets(batch_rows + 1);
+    std::vector<char> c_arena(arena_capacity);
+
+    ColumnBuffer columns[] = {
+        ColumnBuffer::integer(a.data()),
+        ColumnBuffer::real(b.data()),
+        ColumnBuffer::text(b_offsets.data(), b_arena.data(), arena_capacity), // Forces an integer to text conversion
+        ColumnBuffer::text(c_offsets.data(), c_arena.data(), arena_capacity),
+    };
+
+    int status;
+
+    auto tryFetch = [&](DefaultOverthrower& overthrower) {
+        overthrower.activate();
+        sqlite3* handle = nullptr;
+        removeDbIfExists(overthrower);
+        {
+            OverthrowerPauser pauser;
+            ASSERT_EQ(sqlite3_open(TEST_DB_FILE_NAME, &handle), SQLITE_OK);
+            ASSERT_EQ(sqlite3_exec(handle, "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)", nullptr, nullptr, nullptr), SQLITE_OK);
+            ASSERT_EQ(sqlite3_exec(handle, FILL_TEST_TABLE_SQL(1000), nullptr, nullptr, nullptr), SQLITE_OK);
+        }
+
+        sqlite3_stmt* statement = nullptr;
+        status = sqlite3_prepare_v2(handle, "SELECT a, b, b, c FROM test_table ORDER BY a", -1, &statement, nullptr);
+        int fetched = 0;
+        if (status == SQLITE_OK) {
+            ColumnarFetcher fetcher(statement, columns, 4);
+            do {
+                size_t rows = 0;
+                status = fetcher.fetch(batch_rows, &rows);
+                OverthrowerPauser pauser;
+                for (size_t i = 0; i < rows; ++i, ++fetched) {
+                    const std::string expected = std::to_string(fetched + 1);
+                    ASSERT_EQ(a[i], fetched + 1);
+                    ASSERT_EQ(b[i], fetched + 1);
+                    ASSERT_EQ(std::string(b_arena.data() + b_offsets[i], b_arena.data() + b_offsets[i + 1]), expected);
+                    ASSERT_EQ(std::string(c_arena.data() + c_offsets[i], c_arena.data() + c_offsets[i + 1]), "AAAAAAAAAAAAAAAA");
+                }
+            } while (status == SQLITE_ROW);
+            if (status == SQLITE_DONE) {
+                OOM_SAFE_ASSERT_EQ(fetched, rows_to_insert);
+                status = SQLITE_OK;
+            }
+        }
+        if (status != SQLITE_OK)
+            OOM_SAFE_ASSERT_EQ(status, SQLITE_NOMEM);
+        sqlite3_finalize(statement);
+
+        ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    };
+
+    runOomSweeps("SQLite3.ColumnarFetch", status, tryFetch);
+}
+
+TEST(SQLite3, ColumnarFetchEmptyValues)
+{
+    static constexpr uint32_t arena_capacity = 2;
+
+    std::vector<uint32_t> offsets[4] = { std::vector<uint32_t>(2), std::vector<uint32_t>(2), std::vector<uint32_t>(2), std::vector<uint32_t>(2) };
+    std::vector<char> arenas[4] = { std::vector<char>(arena_capacity), std::vector<char>(arena_capacity), std::vector<char>(arena_capacity),
+        std::vector<char>(arena_capacity) };
+    uint8_t nulls[4] = { 2, 2, 2, 2 };
+    ColumnBuffer columns[4] = {
+        ColumnBuffer::text(offsets[0].data(), arenas[0].data(), arena_capacity, &nulls[0]),
+        ColumnBuffer::text(offsets[1].data(), arenas[1].data(), arena_capacity, &nulls[1]),
+        ColumnBuffer::text(offsets[2].data(), arenas[2].data(), arena_capacity, &nulls[2]),
+        ColumnBuffer::text(offsets[3].data(), arenas[3].data(), arena_capacity, &nulls[3]),
+    };
+
+    sqlite3* handle = nullptr;
+    ASSERT_EQ(sqlite3_open(":memory:", &handle), SQLITE_OK);
+
+    // Zero-length BLOBs and TEXT are empty values, not failed conversions
+    sqlite3_stmt* statement = nullptr;
+    ASSERT_EQ(sqlite3_prepare_v2(handle, "SELECT x'', zeroblob(0), '', NULL", -1, &statement, nullptr), SQLITE_OK);
+    {
+        ColumnarFetcher fetcher(statement, columns, 4);
+        size_t rows = 0;
+        EXPECT_EQ(fetcher.fetch(1, &rows), SQLITE_ROW);
+        EXPECT_EQ(rows, 1u);
+        for (int i = 0; i < 4; ++i) {
+            EXPECT_EQ(offsets[i][1], 0u) << i;
+            EXPECT_EQ(nulls[i], i == 3) << i;
+        }
+        EXPECT_EQ(fetcher.fetch(1, &rows), SQLITE_DONE);
+        EXPECT_EQ(rows, 0u);
+    }
+    EXPECT_EQ(sqlite3_finalize(statement), SQLITE_OK);
+
+    // A row which does not fit into an empty arena
+    ASSERT_EQ(sqlite3_prepare_v2(handle, "SELECT 'abc'", -1, &statement, nullptr), SQLITE_OK);
+    {
+        ColumnarFetcher fetcher(statement, columns, 1);
+        size_t rows = 0;
+        EXPECT_EQ(fetcher.fetch(1, &rows), SQLITE_TOOBIG);
+        EXPECT_EQ(rows, 0u);
+    }
+    EXPECT_EQ(sqlite3_finalize(statement), SQLITE_OK);
+
+    ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+}
+
+TEST(Benchmark, ColumnarFetch)
+{
+    static constexpr int rows_to_insert = 1000000;
+    static constexpr size_t batch_rows = 4096;
+
+    sqlite3* handle = nullptr;
+    ASSERT_EQ(sqlite3_open(":memory:", &handle), SQLITE_OK);
+    ASSERT_EQ(sqlite3_exec(handle, "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)", nullptr, nullptr, nullptr), SQLITE_OK);
+    ASSERT_EQ(sqlite3_exec(handle, FILL_TEST_TABLE_SQL(1000000), nullptr, nullptr, nullptr), SQLITE_OK);
+
+    const int64_t expected_sum = static_cast<int64_t>(rows_to_insert) * (rows_to_insert + 1) / 2;
+
+    ReportTable report("Scan of " + std::to_string(rows_to_insert) + " rows into arrays", { "method", "seconds", "rows/s", "sum(b)" });
+
+    auto addRow = [&report](const char* method, double elapsed, int64_t sum) {
+        report.addRow({ method, ReportTable::format("%.3f", elapsed), ReportTable::format("%.0f", rows_to_insert / elapsed), std::to_string(sum) });
+    };
+
+    sqlite3_stmt* statement = nullptr;
+    ASSERT_EQ(sqlite3_prepare_v2(handle, "SELECT a, b, c FROM test_table", -1, &statement, nullptr), SQLITE_OK);
+
+    {
+        // What the Resistance select loop does, with the values kept for a later computation
+        std::vector<int64_t> a;
+        std::vector<int64_t> b;
+        std::vector<std::string> c;
+        const Stopwatch stopwatch;
+        while (sqlite3_step(statement) == SQLITE_ROW) {
+            a.push_back(sqlite3_column_int64(statement, 0));
+            b.push_back(sqlite3_column_int64(statement, 1));
+            c.emplace_back(reinterpret_cast<const char*>(sqlite3_column_text(statement, 2)));
+        }
+        const int64_t sum = std::accumulate(b.begin(), b.end(), int64_t(0));
+        addRow("cell at a time", stopwatch.seconds(), sum);
+        ASSERT_EQ(sum, expected_sum);
+        ASSERT_EQ(sqlite3_reset(statement), SQLITE_OK);
+    }
+
+    {
+        std::vector<int64_t> a(batch_rows);
+        std::vector<int64_t> b(batch_rows);
+        std::vector<uint32_t> c_offsets(batch_rows + 1);
+        std::vector<char> c_arena(batch_rows * 32);
+        ColumnBuffer columns[] = {
+            ColumnBuffer::integer(a.data()),
+            ColumnBuffer::integer(b.data()),
+            ColumnBuffer::text(c_offsets.data(), c_arena.data(), static_cast<uint32_t>(c_arena.size())),
+        };
+        ColumnarFetcher fetcher(statement, columns, 3);
+        int64_t sum = 0;
+        int status;
+        const Stopwatch stopwatch;
+        do {
+            size_t rows = 0;
+            status = fetcher.fetch(batch_rows, &rows);
+            // A contiguous array lets the compiler vectorize the kernel
+            sum = std::accumulate(b.data(), b.data() + rows, sum);
+        } while (status == SQLITE_ROW);
+        addRow("columnar batches", stopwatch.seconds(), sum);
+        ASSERT_EQ(status, SQLITE_DONE);
+        ASSERT_EQ(sum, expected_sum);
+    }
+
+    ASSERT_EQ(sqlite3_finalize(statement), SQLITE_OK);
+    ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    report.print();
+}
@@ -0,0 +1,164 @@
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+
+#include "benchmark.h"
+#include "edge_coverage.h"
+#include "test_helpers.h"
+#include "thread_injector_gtest.h"
+
+#define COVERAGE_DB_FILE_NAME "coverage_db"
+
+#ifdef SQLITE3_EDGE_COVERAGE
+// Only the amalgamation is instrumented, see edge_coverage.h
+extern "C" void __sanitizer_cov_trace_pc()
+{
+    edge_coverage::hit(reinterpret_cast<uintptr_t>(__builtin_return_address(0)));
+}
+#endif
+
+namespace {
+
+void removeCoverageDb()
+{
+    for (const char* suffix : { "", "-journal" }) {
+        const std::string path = std::string(COVERAGE_DB_FILE_NAME) + suffix;
+        if (!access(path.c_str(), F_OK))
+            ASSERT_EQ(unlink(path.c_str()), 0);
+    }
+}
+
+// The statements of SQLite3.OpenClose and a query, every allocation from the delay of the injector on fails
+int runOpenClose(ThreadInjector& injector)
+{
+    removeCoverageDb();
+    injector.activate();
+    sqlite3* handle = nullptr;
+    int status = sqlite3_open(COVERAGE_DB_FILE_NAME, &handle);
+    if (handle) {
+        static const char* const statements[] = { "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)",
+            "CREATE INDEX test_idx ON test_table(a, b, c)", "INSERT INTO test_table(b, c) VALUES (1, 2), (3, 4), (5, 6)",
+            "SELECT b, sum(c) FROM test_table WHERE a > 1 GROUP BY b ORDER BY 2", "DROP INDEX test_idx", "DROP TABLE test_table", "VACUUM" };
+        for (const char* sql : statements) {
+            if (status == SQLITE_OK)
+                status = sqlite3_exec(handle, sql, nullptr, nullptr, nullptr);
+        }
+        EXPECT_EQ(sqlite3_close(handle), SQLITE_OK);
+    }
+    injector.deactivate();
+    return status;
+}
+
+// One run with the given delay, returns the number of edges it has reached for the first time
+size_t runDelay(unsigned int delay, EdgeCoverage& coverage)
+{
+    EdgeCoverage::reset();
+    ThreadInjectorStep injector(delay);
+    const int status = runOpenClose(injector);
+    EXPECT_TRUE(status == SQLITE_OK || status == SQLITE_NOMEM) << status;
+    return coverage.collect();
+}
+
+} // namespace
+
+TEST(Coverage, StepPrioritizer)
+{
+    // Bisection order while nothing is new, then the sweep saturates
+    StepPrioritizer bisection(8, 3);
+    unsigned int delay;
+    for (unsigned int expected : { 0u, 4u, 2u }) {
+        ASSERT_TRUE(bisection.next(delay));
+        EXPECT_EQ(delay, expected);
+        bisection.report(delay, 0);
+    }
+    EXPECT_TRUE(bisection.saturated());
+    EXPECT_FALSE(bisection.next(delay));
+    EXPECT_EQ(bisection.count(), 3u);
+
+    // New edges bring the neighbours forward, the larger gain first
+    StepPrioritizer guided(16, 4);
+    ASSERT_TRUE(guided.next(delay));
+    EXPECT_EQ(delay, 0u);
+    guided.report(0, 5);
+    ASSERT_TRUE(guided.next(delay));
+    EXPECT_EQ(delay, 1u);
+    guided.report(1, 0);
+    ASSERT_TRUE(guided.next(delay));
+    EXPECT_EQ(delay, 8u);
+    guided.report(8, 2);
+    ASSERT_TRUE(guided.next(delay));
+    EXPECT_EQ(delay, 7u);
+    guided.report(7, 9);
+    ASSERT_TRUE(guided.next(delay));
+    EXPECT_EQ(delay, 6u);
+
+    // Without a saturation window every delay runs exactly once
+    StepPrioritizer exhaustive(5, UINT_MAX);
+    std::vector<bool> seen(5);
+    while (exhaustive.next(delay)) {
+        ASSERT_LT(delay, 5u);
+        EXPECT_FALSE(seen[delay]);
+        seen[delay] = true;
+    }
+    EXPECT_EQ(exhaustive.count(), 5u);
+}
+
+// The STEP sweep of SQLite3.OpenClose in full and guided by edge coverage, which stops once
+// COVERAGE_SATURATION_WINDOW delays in a row (64 by default) have reached no new edge or after COVERAGE_SECONDS.
+// Needs the amalgamation instrumented: cmake -DSQLITE3_EDGE_COVERAGE=ON
+TEST(Benchmark, CoverageGuidedStep)
+{
+    if (!EdgeCoverage::available()) {
+        printf("Built without SQLITE3_EDGE_COVERAGE, nothing to measure\n");
+        return;
+    }
+
+    const unsigned int saturation_window = static_cast<unsigned int>(envInteger("COVERAGE_SATURATION_WINDOW", 64));
+    const double seconds_budget = envInteger("COVERAGE_SECONDS", 600);
+
+    ThreadInjectorInstaller installer;
+
+    // A run without failures: how many allocations there are to fail, and the edges which need no failure
+    EdgeCoverage clean;
+    ThreadInjectorStep no_failure(UINT_MAX);
+    EdgeCoverage::reset();
+    ASSERT_EQ(runOpenClose(no_failure), SQLITE_OK);
+    const unsigned int allocations = static_cast<unsigned int>(no_failure.allocations());
+    const size_t clean_edges = clean.collect();
+
+    struct Sweep {
+        const char* name;
+        unsigned int window;
+    };
+    ReportTable report(std::to_string(allocations) + " allocations, " + std::to_string(clean_edges) + " edges without failures",
+        { "sweep", "delays run", "seconds", "new edges", "found after" });
+    for (const Sweep& sweep : { Sweep{ "exhaustive", UINT_MAX }, Sweep{ "coverage guided", saturation_window } }) {
+        EdgeCoverage coverage;
+        EdgeCoverage::reset();
+        ASSERT_EQ(runOpenClose(no_failure), SQLITE_OK);
+        const size_t baseline = coverage.collect();
+
+        StepPrioritizer prioritizer(allocations, sweep.window);
+        const Stopwatch stopwatch;
+        unsigned int delay;
+        unsigned int last_gain_run = 0;
+        while (stopwatch.seconds() < seconds_budget && prioritizer.next(delay)) {
+            const size_t new_edges = runDelay(delay, coverage);
+            if (new_edges)
+                last_gain_run = prioritizer.count();
+            prioritizer.report(delay, new_edges);
+        }
+        report.addRow({ sweep.name, std::to_string(prioritizer.count()), ReportTable::format("%.2f", stopwatch.seconds()),
+            std::to_string(coverage.edges() - baseline), std::to_string(last_gain_run) + " delays" });
+    }
+    report.print();
+    removeCoverageDb();
+}
@@ -0,0 +1,465 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CSV_IMPORT_X86 1
+#endif
+
+#include <sqlite3.h>
+
+enum class CsvScanner { SCALAR, SSE42, AVX2, BEST };
+
+struct CsvImportOptions {
+    char delimiter = ',';
+    size_t rows_per_transaction = 100000; // Zero imports the whole file in a single transaction
+    size_t chunk_size = 1 << 20;
+    size_t queue_depth = 4;
+    CsvScanner scanner = CsvScanner::BEST;
+};
+
+namespace csv {
+
+// Returns the first delimiter, quote, CR or LF in [begin, end) or end if there is none.
+typedef char* (*ScanFunction)(char* begin, const char* end, char delimiter);
+
+inline char* scanScalar(char* begin, const char* end, char delimiter)
+{
+    for (; begin != end; ++begin) {
+        const char c = *begin;
+        if (c == delimiter || c == '"' || c == '\n' || c == '\r')
+            break;
+    }
+    return begin;
+}
+
+#ifdef CSV_IMPORT_X86
+__attribute__((target("sse4.2"))) inline char* scanSse42(char* begin, const char* end, char delimiter)
+{
+    const __m128i specials = _mm_setr_epi8(delimiter, '"', '\n', '\r', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    for (; end - begin >= 16; begin += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+        const int index = _mm_cmpestri(specials, 4, chunk, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (index != 16)
+            return begin + index;
+    }
+    return scanScalar(begin, end, delimiter);
+}
+
+__attribute__((target("avx2"))) inline char* scanAvx2(char* begin, const char* end, char delimiter)
+{
+    const __m256i delimiters = _mm256_set1_epi8(delimiter);
+    const __m256i quotes = _mm256_set1_epi8('"');
+    const __m256i line_feeds = _mm256_set1_epi8('\n');
+    const __m256i carriage_returns = _mm256_set1_epi8('\r');
+    for (; end - begin >= 32; begin += 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+        const __m256i matches = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, delimiters), _mm256_cmpeq_epi8(chunk, quotes)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, line_feeds), _mm256_cmpeq_epi8(chunk, carriage_returns)));
+        const unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(matches));
+        if (mask)
+            return begin + __builtin_ctz(mask);
+    }
+    return scanScalar(begin, end, delimiter);
+}
+#endif
+
+inline bool scannerSupported(CsvScanner scanner)
+{
+    switch (scanner) {
+    case CsvScanner::SCALAR:
+    case CsvScanner::BEST:
+        return true;
+#ifdef CSV_IMPORT_X86
+    case CsvScanner::SSE42:
+        return __builtin_cpu_supports("sse4.2");
+    case CsvScanner::AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+inline ScanFunction scanFunction(CsvScanner scanner)
+{
+    if (scanner == CsvScanner::BEST)
+        scanner = scannerSupported(CsvScanner::AVX2) ? CsvScanner::AVX2 : scannerSupported(CsvScanner::SSE42) ? CsvScanner::SSE42 : CsvScanner::SCALAR;
+#ifdef CSV_IMPORT_X86
+    if (scanner == CsvScanner::AVX2 && scannerSupported(scanner))
+        return scanAvx2;
+    if (scanner == CsvScanner::SSE42 && scannerSupported(scanner))
+        return scanSse42;
+#endif
+    return scanScalar;
+}
+
+static constexpr uint32_t NULL_FIELD = UINT32_MAX;
+
+// A piece of the input holding whole records only. Quoted fields are unescaped in place, fields refers to them by
+// begin and end offsets, column_count pairs per row. Missing trailing fields are NULL_FIELD, extra ones are dropped.
+struct Batch {
+    std::vector<char> text;
+    std::vector<uint32_t> fields;
+    size_t rows = 0;
+};
+
+// Turns "" into " in place and returns the new end of the field, the result is never longer than the source.
+inline char* unescape(char* begin, const char* end)
+{
+    char* out = begin;
+    while (const char* quote = static_cast<const char*>(memchr(begin, '"', end - begin))) {
+        const size_t length = quote + 1 - begin; // Keeps the first quote of a pair
+        memmove(out, begin, length);
+        out += length;
+        begin += length + 1;
+    }
+    memmove(out, begin, end - begin);
+    return out + (end - begin);
+}
+
+// Parses as many complete records as possible and returns the size of the consumed prefix of batch.text.
+// The rest is an incomplete record unless the end of the input has been reached.
+inline size_t parse(Batch& batch, size_t column_count, char delimiter, ScanFunction scan, bool last)
+{
+    char* const base = batch.text.data();
+    char* const end = base + batch.text.size();
+    char* p = base;
+    size_t consumed = 0;
+
+    // Quotes in the middle of an unquoted field are ordinary characters
+    auto findSeparator = [scan, end, delimiter](char* p) {
+        p = scan(p, end, delimiter);
+        while (p != end && *p == '"')
+            p = scan(p + 1, end, delimiter);
+        return p;
+    };
+
+    auto addField = [&batch, base](const char* begin, const char* end) {
+        batch.fields.push_back(static_cast<uint32_t>(begin - base));
+        batch.fields.push_back(static_cast<uint32_t>(end - base));
+    };
+
+    // Quoted fields of the current record, unescaped once the record is complete: an incomplete one goes back to the
+    // caller as it was read and is parsed again with the next chunk
+    std::vector<size_t> quoted_fields;
+
+    while (p != end) {
+        if (*p == '\n' || *p == '\r') { // Blank line
+            consumed = ++p - base;
+            continue;
+        }
+
+        const size_t fields_before = batch.fields.size();
+        quoted_fields.clear();
+        size_t field_count = 0;
+        bool complete = false;
+        while (true) {
+            if (*p == '"') {
+                // The closing quote is looked for first, so that an incomplete field is left intact for the next chunk
+                const char* quote = p + 1;
+                bool closed = false;
+                while ((quote = static_cast<const char*>(memchr(quote, '"', end - quote)))) {
+                    if (quote + 1 != end && quote[1] == '"') {
+                        quote += 2;
+                        continue;
+                    }
+                    closed = quote + 1 != end || last; // Otherwise the pair might be split between chunks
+                    break;
+                }
+                if (!closed && !last)
+                    break;
+                char* const field_end = closed ? const_cast<char*>(quote) : end; // Unterminated quote takes the rest of the input
+                if (field_count++ < column_count) {
+                    quoted_fields.push_back(batch.fields.size());
+                    addField(p + 1, field_end);
+                }
+                p = findSeparator(field_end == end ? end : field_end + 1); // Text between the quote and the separator is dropped
+            } else {
+                char* const field_end = findSeparator(p);
+                if (field_count++ < column_count)
+                    addField(p, field_end);
+                p = field_end;
+            }
+
+            if (p == end) {
+                complete = last;
+                break;
+            }
+            if (*p == delimiter) {
+                if (++p != end)
+                    continue;
+                if (last && field_count++ < column_count)
+                    addField(p, p); // Trailing empty field
+                complete = last;
+                break;
+            }
+            if (*p == '\r' && p + 1 == end && !last)
+                break; // LF might come with the next chunk
+            if (*p == '\r' && p + 1 != end && p[1] == '\n')
+                ++p;
+            ++p;
+            complete = true;
+            break;
+        }
+
+        if (!complete) {
+            batch.fields.resize(fields_before);
+            break;
+        }
+        for (size_t field : quoted_fields)
+            batch.fields[field + 1] = static_cast<uint32_t>(unescape(base + batch.fields[field], base + batch.fields[field + 1]) - base);
+        for (; field_count < column_count; ++field_count) {
+            batch.fields.push_back(NULL_FIELD);
+            batch.fields.push_back(NULL_FIELD);
+        }
+        ++batch.rows;
+        consumed = p - base;
+    }
+    return consumed;
+}
+
+template <typename T>
+class BoundedQueue final {
+public:
+    explicit BoundedQueue(size_t capacity)
+        : capacity(capacity)
+    {
+    }
+
+    // Returns false if the consumer is gone and nothing is going to be popped anymore.
+    bool push(T&& item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this]() { return items.size() < capacity || aborted; });
+        if (aborted)
+            return false;
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+        return true;
+    }
+
+    // Returns false once the producer has finished and everything has been consumed.
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this]() { return !items.empty() || closed; });
+        if (items.empty())
+            return false;
+        item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+    }
+
+    void abort()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        aborted = true;
+        not_full.notify_all();
+    }
+
+private:
+    const size_t capacity;
+    std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+    std::deque<T> items;
+    bool closed = false;
+    bool aborted = false;
+};
+
+typedef BoundedQueue<std::unique_ptr<Batch>> BatchQueue;
+
+// Reads the file chunk by chunk and hands parsed batches over to the writer.
+inline int produceBatches(FILE* file, size_t column_count, const CsvImportOptions& options, BatchQueue& queue)
+{
+    const ScanFunction scan = scanFunction(options.scanner);
+    try {
+        std::vector<char> carry;
+        size_t chunk_size = options.chunk_size;
+        bool last = false;
+        while (!last) {
+            std::unique_ptr<Batch> batch(new Batch);
+            batch->text.resize(carry.size() + chunk_size);
+            if (!carry.empty())
+                memcpy(batch->text.data(), carry.data(), carry.size());
+            const size_t read = fread(batch->text.data() + carry.size(), 1, chunk_size, file);
+            if (read < chunk_size) {
+                if (ferror(file))
+                    return SQLITE_IOERR;
+                last = true;
+            }
+            batch->text.resize(carry.size() + read);
+            batch->fields.reserve(column_count * 2 * 1024);
+
+            const size_t consumed = parse(*batch, column_count, options.delimiter, scan, last);
+            carry.assign(batch->text.begin() + consumed, batch->text.end());
+            if (!consumed && !last)
+                chunk_size *= 2; // A single record is larger than a chunk
+            if (batch->rows && !queue.push(std::move(batch)))
+                return SQLITE_OK; // Writer has given up, its status is what matters
+        }
+    }
+    catch (const std::bad_alloc&) {
+        return SQLITE_NOMEM;
+    }
+    return SQLITE_OK;
+}
+
+class Transaction final {
+public:
+    ~Transaction()
+    {
+        sqlite3_finalize(begin);
+        sqlite3_finalize(commit);
+        sqlite3_finalize(rollback);
+    }
+
+    // Everything is prepared in advance so that giving up does not need any memory.
+    int prepare(sqlite3* handle)
+    {
+        int status = sqlite3_prepare_v2(handle, "BEGIN", -1, &begin, nullptr);
+        if (status == SQLITE_OK)
+            status = sqlite3_prepare_v2(handle, "COMMIT", -1, &commit, nullptr);
+        if (status == SQLITE_OK)
+            status = sqlite3_prepare_v2(handle, "ROLLBACK", -1, &rollback, nullptr);
+        return status;
+    }
+
+    int start() { return execute(begin); }
+    int finish() { return execute(commit); }
+
+    void cancel()
+    {
+        if (!sqlite3_get_autocommit(sqlite3_db_handle(rollback)))
+            execute(rollback);
+    }
+
+private:
+    static int execute(sqlite3_stmt* statement)
+    {
+        const int status = sqlite3_step(statement);
+        sqlite3_reset(statement);
+        return status == SQLITE_DONE ? SQLITE_OK : status;
+    }
+
+    sqlite3_stmt* begin = nullptr;
+    sqlite3_stmt* commit = nullptr;
+    sqlite3_stmt* rollback = nullptr;
+};
+
+inline int insertBatch(sqlite3_stmt* insert, const Batch& batch, int column_count, size_t& rows_in_transaction, const CsvImportOptions& options,
+    Transaction& transaction, size_t* rows_committed)
+{
+    const uint32_t* field = batch.fields.data();
+    for (size_t row = 0; row < batch.rows; ++row) {
+        sqlite3_reset(insert);
+        for (int column = 1; column <= column_count; ++column, field += 2) {
+            const int status = field[0] == NULL_FIELD ? sqlite3_bind_null(insert, column)
+                                                      : sqlite3_bind_text(insert, column, batch.text.data() + field[0], field[1] - field[0], SQLITE_STATIC);
+            if (status != SQLITE_OK)
+                return status;
+        }
+        int status = sqlite3_step(insert);
+        if (status != SQLITE_DONE)
+            return sqlite3_reset(insert);
+        if (++rows_in_transaction == options.rows_per_transaction) {
+            status = transaction.finish();
+            if (status == SQLITE_OK) {
+                *rows_committed += rows_in_transaction;
+                rows_in_transaction = 0;
+                status = transaction.start();
+            }
+            if (status != SQLITE_OK)
+                return status;
+        }
+    }
+    return SQLITE_OK;
+}
+
+} // namespace csv
+
+// Imports a CSV file through insert_sql which takes one parameter per column, e.g.
+//     INSERT INTO test_table(a, b, c) VALUES (?, ?, ?)
+// Parsing runs in a separate thread. Rows are committed every options.rows_per_transaction rows, so after a failure
+// the table holds exactly *rows_committed imported rows: the transaction which was in progress is rolled back.
+inline int importCsv(sqlite3* handle, const char* path, const char* insert_sql, const CsvImportOptions& options, size_t* rows_committed)
+{
+    *rows_committed = 0;
+
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return SQLITE_CANTOPEN;
+
+    csv::Transaction transaction;
+    sqlite3_stmt* insert = nullptr;
+    int status = transaction.prepare(handle);
+    if (status == SQLITE_OK)
+        status = sqlite3_prepare_v2(handle, insert_sql, -1, &insert, nullptr);
+    if (status == SQLITE_OK)
+        status = transaction.start();
+    if (status != SQLITE_OK) {
+        sqlite3_finalize(insert);
+        fclose(file);
+        return status;
+    }
+
+    const int column_count = sqlite3_bind_parameter_count(insert);
+    std::atomic<int> parser_status(SQLITE_OK);
+    try {
+        csv::BatchQueue queue(options.queue_depth);
+        std::thread parser([&]() {
+            parser_status = csv::produceBatches(file, column_count, options, queue);
+            queue.close();
+        });
+
+        size_t rows_in_transaction = 0;
+        std::unique_ptr<csv::Batch> batch;
+        while (status == SQLITE_OK && queue.pop(batch))
+            status = csv::insertBatch(insert, *batch, column_count, rows_in_transaction, options, transaction, rows_committed);
+        batch.reset();
+
+        queue.abort();
+        parser.join();
+
+        if (status == SQLITE_OK)
+            status = parser_status;
+        if (status == SQLITE_OK) {
+            status = transaction.finish();
+            if (status == SQLITE_OK)
+                *rows_committed += rows_in_transaction;
+        }
+    }
+    catch (const std::bad_alloc&) {
+        status = SQLITE_NOMEM;
+    }
+    catch (const std::system_error&) {
+        status = SQLITE_NOMEM; // The parser thread could not be started
+    }
+
+    if (status != SQLITE_OK)
+        transaction.cancel();
+    sqlite3_finalize(insert);
+    fclose(file);
+    return status;
+}
@@ -0,0 +1,253 @@
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+
+#include "benchmark.h"
+#include "csv_import.h"
+#include "overthrower.h"
+#include "test_helpers.h"
+
+#define CSV_FILE_NAME "test_table.csv"
+#define CSV_DB_FILE_NAME "csv_db"
+#define CSV_INSERT_SQL "INSERT INTO test_table(a, b, c) VALUES (?, ?, ?)"
+
+namespace {
+
+// Value of column c for the given row, every third one needs quoting and every fifth one has escaped quotes.
+std::string expectedText(int row)
+{
+    if (row % 5 == 0)
+        return "say \"" + std::to_string(row) + "\", twice";
+    if (row % 3 == 0)
+        return "comma, " + std::to_string(row);
+    return "AAAAAAAAAAAAAAAA";
+}
+
+// Rows are numbered from 1, every other line ends with CRLF.
+void writeCsv(const char* path, int rows)
+{
+    FILE* file = fopen(path, "wb");
+    ASSERT_NE(file, nullptr);
+    for (int row = 1; row <= rows; ++row) {
+        std::string text = expectedText(row);
+        if (text.find_first_of(",\"") != std::string::npos) {
+            for (size_t i = 0; (i = text.find('"', i)) != std::string::npos; i += 2)
+                text.insert(i, 1, '"');
+            text = '"' + text + '"';
+        }
+        fprintf(file, "%d,%d,%s%s", row, row * 7, text.c_str(), row % 2 ? "\r\n" : "\n");
+    }
+    ASSERT_EQ(fclose(file), 0);
+}
+
+void createTestTable(sqlite3** handle, const char* path)
+{
+    ASSERT_EQ(sqlite3_open(path, handle), SQLITE_OK);
+    ASSERT_EQ(sqlite3_exec(*handle, "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)", nullptr, nullptr, nullptr), SQLITE_OK);
+}
+
+// Returns the number of rows or -1 if any of them differs from what writeCsv() has produced.
+int checkImportedRows(sqlite3* handle)
+{
+    sqlite3_stmt* statement = nullptr;
+    int rows = 0;
+    if (sqlite3_prepare_v2(handle, "SELECT a, b, c FROM test_table ORDER BY a", -1, &statement, nullptr) != SQLITE_OK)
+        return -1;
+    while (rows >= 0 && sqlite3_step(statement) == SQLITE_ROW) {
+        const int row = ++rows;
+        const char* text = reinterpret_cast<const char*>(sqlite3_column_text(statement, 2));
+        if (sqlite3_column_int(statement, 0) != row || sqlite3_column_int(statement, 1) != row * 7 || !text || expectedText(row) != text)
+            rows = -1;
+    }
+    sqlite3_finalize(statement);
+    return rows;
+}
+
+} // namespace
+
+TEST(SQLite3, CsvImport)
+{
+    static constexpr int rows_to_import = 1000;
+    static constexpr size_t rows_per_transaction = 100;
+
+    writeCsv(CSV_FILE_NAME, rows_to_import);
+
+    CsvImportOptions options;
+    options.rows_per_transaction = rows_per_transaction;
+    options.chunk_size = 256; // Lots of records split between chunks
+
+    int status;
+
+    auto tryImport = [&status, &options](DefaultOverthrower& overthrower) {
+        overthrower.activate();
+        sqlite3* handle = nullptr;
+        removeDbIfExists(overthrower);
+        {
+            OverthrowerPauser pauser;
+            createTestTable(&handle, TEST_DB_FILE_NAME);
+        }
+
+        size_t rows_committed = 0;
+        status = importCsv(handle, CSV_FILE_NAME, CSV_INSERT_SQL, options, &rows_committed);
+
+        {
+            // Only whole transactions may survive a failure
+            OverthrowerPauser pauser;
+            ASSERT_EQ(checkImportedRows(handle), static_cast<int>(rows_committed));
+            if (status == SQLITE_OK)
+                ASSERT_EQ(rows_committed, rows_to_import);
+            else
+                ASSERT_EQ(rows_committed % rows_per_transaction, 0);
+        }
+
+        ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    };
+
+    // Every scanner has to produce the same rows. This also leaves a cached thread stack behind, so later parser
+    // threads do not have to allocate one while allocations are being failed. The watchdog monitor is started first, so
+    // that it does not take the cached stack when the test runs on its own.
+    Watchdog::instance();
+    for (CsvScanner scanner : { CsvScanner::SCALAR, CsvScanner::SSE42, CsvScanner::AVX2 }) {
+        if (!csv::scannerSupported(scanner))
+            continue;
+        options.scanner = scanner;
+        sqlite3* handle = nullptr;
+        createTestTable(&handle, ":memory:");
+        size_t rows_committed = 0;
+        ASSERT_EQ(importCsv(handle, CSV_FILE_NAME, CSV_INSERT_SQL, options, &rows_committed), SQLITE_OK);
+        ASSERT_EQ(rows_committed, rows_to_import);
+        ASSERT_EQ(checkImportedRows(handle), rows_to_import);
+        ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    }
+
+    options.scanner = CsvScanner::BEST;
+
+    runOomSweeps("SQLite3.CsvImport", status, tryImport);
+
+    ASSERT_EQ(unlink(CSV_FILE_NAME), 0);
+}
+
+TEST(SQLite3, CsvImportSplitQuotes)
+{
+    // Escaped quotes in columns other than the last one, every chunk size puts a boundary into or next to them
+    static const char csv_text[] = "1,\"a\"\"b\",xy\n2,\"c\"\"\"\"d\",\"e\"\"f\"\n";
+
+    FILE* file = fopen(CSV_FILE_NAME, "wb");
+    ASSERT_NE(file, nullptr);
+    ASSERT_EQ(fwrite(csv_text, 1, sizeof(csv_text) - 1, file), sizeof(csv_text) - 1);
+    ASSERT_EQ(fclose(file), 0);
+
+    CsvImportOptions options;
+    options.scanner = CsvScanner::SCALAR;
+
+    for (size_t chunk_size = 1; chunk_size < sizeof(csv_text); ++chunk_size) {
+        SCOPED_TRACE("chunk_size " + std::to_string(chunk_size));
+        options.chunk_size = chunk_size;
+        sqlite3* handle = nullptr;
+        createTestTable(&handle, ":memory:");
+        size_t rows_committed = 0;
+        ASSERT_EQ(importCsv(handle, CSV_FILE_NAME, CSV_INSERT_SQL, options, &rows_committed), SQLITE_OK);
+        ASSERT_EQ(rows_committed, 2u);
+
+        sqlite3_stmt* statement = nullptr;
+        ASSERT_EQ(sqlite3_prepare_v2(handle, "SELECT group_concat(b || '|' || c, '/') FROM (SELECT b, c FROM test_table ORDER BY a)", -1, &statement, nullptr), SQLITE_OK);
+        ASSERT_EQ(sqlite3_step(statement), SQLITE_ROW);
+        EXPECT_STREQ(reinterpret_cast<const char*>(sqlite3_column_text(statement, 0)), "a\"b|xy/c\"\"d|e\"f");
+        sqlite3_finalize(statement);
+        ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    }
+
+    ASSERT_EQ(unlink(CSV_FILE_NAME), 0);
+}
+
+TEST(Benchmark, CsvImport)
+{
+    static constexpr int rows_to_import = 1000000;
+
+    writeCsv(CSV_FILE_NAME, rows_to_import);
+    const double megabytes = fileSize(CSV_FILE_NAME) / 1048576.0;
+
+    ReportTable report("Import of " + std::to_string(rows_to_import) + " CSV rows (" + ReportTable::format("%.1f", megabytes) + " MB)",
+        { "method", "scan MB/s", "seconds", "rows/s", "MB/s" });
+
+    auto removeCsvDb = []() {
+        if (!access(CSV_DB_FILE_NAME, F_OK))
+            ASSERT_EQ(unlink(CSV_DB_FILE_NAME), 0);
+    };
+
+    std::vector<char> text(static_cast<size_t>(fileSize(CSV_FILE_NAME)));
+    {
+        FILE* file = fopen(CSV_FILE_NAME, "rb");
+        ASSERT_NE(file, nullptr);
+        ASSERT_EQ(fread(text.data(), 1, text.size(), file), text.size());
+        ASSERT_EQ(fclose(file), 0);
+    }
+
+    static const struct {
+        const char* name;
+        CsvScanner scanner;
+    } scanners[] = { { "importCsv scalar", CsvScanner::SCALAR }, { "importCsv SSE4.2", CsvScanner::SSE42 }, { "importCsv AVX2", CsvScanner::AVX2 } };
+
+    for (const auto& scanner : scanners) {
+        if (!csv::scannerSupported(scanner.scanner)) {
+            report.addRow({ scanner.name, "n/a" });
+            continue;
+        }
+
+        const csv::ScanFunction scan = csv::scanFunction(scanner.scanner);
+        size_t separators = 0;
+        const Stopwatch scan_stopwatch;
+        for (char* p = text.data(); (p = scan(p, text.data() + text.size(), ',')) != text.data() + text.size(); ++p)
+            ++separators;
+        const double scan_elapsed = scan_stopwatch.seconds();
+        ASSERT_GE(separators, rows_to_import * 2u);
+
+        removeCsvDb();
+        sqlite3* handle = nullptr;
+        createTestTable(&handle, CSV_DB_FILE_NAME);
+        CsvImportOptions options;
+        options.scanner = scanner.scanner;
+        size_t rows_committed = 0;
+        const Stopwatch stopwatch;
+        ASSERT_EQ(importCsv(handle, CSV_FILE_NAME, CSV_INSERT_SQL, options, &rows_committed), SQLITE_OK);
+        const double elapsed = stopwatch.seconds();
+        ASSERT_EQ(checkImportedRows(handle), rows_to_import);
+        ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+
+        report.addRow({ scanner.name, ReportTable::format("%.0f", megabytes / scan_elapsed), ReportTable::format("%.3f", elapsed),
+            ReportTable::format("%.0f", rows_to_import / elapsed), ReportTable::format("%.1f", megabytes / elapsed) });
+    }
+
+    // The shell is built from the same amalgamation, SQLITE3_SHELL may point to another one
+    const char* shell = getenv("SQLITE3_SHELL") ? getenv("SQLITE3_SHELL") : "./sqlite3_shell";
+    if (access(shell, X_OK)) {
+        report.addRow({ "sqlite3 .import", "n/a" });
+    } else {
+        removeCsvDb();
+        sqlite3* handle = nullptr;
+        createTestTable(&handle, CSV_DB_FILE_NAME);
+        ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+
+        const Stopwatch stopwatch;
+        FILE* pipe = popen((std::string(shell) + " " CSV_DB_FILE_NAME).c_str(), "w");
+        ASSERT_NE(pipe, nullptr);
+        fputs(".mode csv\n.import " CSV_FILE_NAME " test_table\n", pipe);
+        ASSERT_EQ(pclose(pipe), 0);
+        const double elapsed = stopwatch.seconds();
+
+        ASSERT_EQ(sqlite3_open(CSV_DB_FILE_NAME, &handle), SQLITE_OK);
+        ASSERT_EQ(checkImportedRows(handle), rows_to_import);
+        ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+
+        report.addRow({ "sqlite3 .import", "-", ReportTable::format("%.3f", elapsed), ReportTable::format("%.0f", rows_to_import / elapsed),
+            ReportTable::format("%.1f", megabytes / elapsed) });
+    }
+
+    removeCsvDb();
+    ASSERT_EQ(unlink(CSV_FILE_NAME), 0);
+    report.print();
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <queue>
+#include <vector>
+
+// Edge coverage of SQLite per injection run, and the order in which a STEP sweep tries its delays based on it.
+//
+// With -DSQLITE3_EDGE_COVERAGE=ON the amalgamation is built with -fsanitize-coverage=trace-pc (gcc and clang alike),
+// which calls __sanitizer_cov_trace_pc() on every basic block. The callback, defined once by the test which uses the
+// map, marks the edge between the previous block of the thread and this one as hit, AFL style: an edge is the hash
+// of both addresses, so that a recovery path through known blocks counts as new. Without instrumentation the map stays
+// empty and available() is false.
+
+namespace edge_coverage {
+
+static constexpr size_t map_size = 1 << 16;
+
+inline uint8_t* hits()
+{
+    static uint8_t map[map_size];
+    return map;
+}
+
+inline void hit(uintptr_t location)
+{
+    static thread_local uintptr_t previous = 0;
+    hits()[(location ^ previous) & (map_size - 1)] = 1;
+    previous = location >> 1;
+}
+
+} // namespace edge_coverage
+
+// Edges hit by all the runs so far
+class EdgeCoverage final {
+public:
+    EdgeCoverage()
+        : seen(edge_coverage::map_size)
+    {
+    }
+
+    static bool available()
+    {
+#ifdef SQLITE3_EDGE_COVERAGE
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Forgets the edges hit since the last collect(), e.g. by the harness in between
+    static void reset()
+    {
+        uint8_t* hits = edge_coverage::hits();
+        std::fill(hits, hits + edge_coverage::map_size, 0);
+    }
+
+    // Adds the edges hit since the last reset() or collect() and returns how many of them have not been seen before
+    size_t collect()
+    {
+        uint8_t* hits = edge_coverage::hits();
+        size_t new_edges = 0;
+        for (size_t i = 0; i < edge_coverage::map_size; ++i) {
+            if (hits[i] && !seen[i]) {
+                seen[i] = true;
+                ++new_edges;
+            }
+        }
+        total += new_edges;
+        reset();
+        return new_edges;
+    }
+
+    size_t edges() const { return total; }
+
+private:
+    std::vector<bool> seen;
+    size_t total = 0;
+};
+
+// Picks the next delay of a STEP sweep over allocations 0 .. allocations - 1. Delays are first spread over the whole
+// range by bisection (0, N/2, N/4, 3N/4, ...), a delay which has reached new edges puts its neighbours ahead of them
+// with the number of new edges as priority: the failure points next to a new recovery path are likely to open more of
+// it. The sweep stops when saturation_window delays in a row have reached nothing new, or when every delay has run.
+class StepPrioritizer final {
+public:
+    StepPrioritizer(unsigned int allocations, unsigned int saturation_window)
+        : tried(allocations)
+        , saturation_window(saturation_window)
+    {
+        unsigned int bits = 0;
+        while ((1ull << bits) < allocations)
+            ++bits;
+        for (uint64_t i = 0; i < (1ull << bits); ++i) {
+            uint64_t reversed = 0;
+            for (unsigned int bit = 0; bit < bits; ++bit)
+                reversed |= (i >> bit & 1) << (bits - 1 - bit);
+            if (reversed < allocations)
+                queue.push({ 0, order++, static_cast<unsigned int>(reversed) });
+        }
+    }
+
+    // Returns false once the sweep is over
+    bool next(unsigned int& delay)
+    {
+        if (idle >= saturation_window)
+            return false;
+        while (!queue.empty()) {
+            const Candidate candidate = queue.top();
+            queue.pop();
+            if (tried[candidate.delay])
+                continue;
+            tried[candidate.delay] = true;
+            ++runs;
+            delay = candidate.delay;
+            return true;
+        }
+        return false;
+    }
+
+    void report(unsigned int delay, size_t new_edges)
+    {
+        if (!new_edges) {
+            ++idle;
+            return;
+        }
+        idle = 0;
+        if (delay > 0 && !tried[delay - 1])
+            queue.push({ new_edges, order++, delay - 1 });
+        if (delay + 1 < tried.size() && !tried[delay + 1])
+            queue.push({ new_edges, order++, delay + 1 });
+    }
+
+    // Delays which have run so far
+    unsigned int count() const { return runs; }
+
+    bool saturated() const { return idle >= saturation_window; }
+
+private:
+    struct Candidate {
+        size_t priority;
+        uint64_t order;
+        unsigned int delay;
+
+        // The top of the queue: highest priority, the earliest queued among equal ones
+        bool operator<(const Candidate& other) const { return priority != other.priority ? priority < other.priority : order > other.order; }
+    };
+
+    std::priority_queue<Candidate> queue;
+    std::vector<bool> tried;
+    const unsigned int saturation_window;
+    uint64_t order = 0;
+    unsigned int idle = 0;
+    unsigned int runs = 0;
+};
@@ -0,0 +1,186 @@
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+
+#include "benchmark.h"
+#include "overthrower.h"
+#include "test_helpers.h"
+
+namespace {
+
+// A JSON object of at least `size` bytes: a few scalar members followed by an "items" array of small objects, which
+// grows until the document is large enough. Returns the number of array elements through `item_count`.
+std::string makeDocument(int id, size_t size, int* item_count)
+{
+    std::string document = "{\"id\":" + std::to_string(id) + ",\"name\":\"item " + std::to_string(id) + "\",\"price\":" + std::to_string(id * 0.25)
+        + ",\"tags\":[\"red\",\"green\",\"blue\"],\"items\":[";
+    int count = 0;
+    do {
+        document += (count ? ",{\"n\":" : "{\"n\":") + std::to_string(count) + ",\"v\":\"abcdefghijklmnop\"}";
+        ++count;
+    } while (document.size() + 2 < size);
+    document += "]}";
+    *item_count = count;
+    return document;
+}
+
+// Fills test_table with documents of `min_size` up to `max_size` bytes, returns the total number of array elements.
+int64_t fillTestTable(sqlite3* handle, int rows, size_t min_size, size_t max_size)
+{
+    int64_t total_items = 0;
+    EXPECT_EQ(sqlite3_exec(handle, "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)", nullptr, nullptr, nullptr), SQLITE_OK);
+    EXPECT_EQ(sqlite3_exec(handle, "BEGIN TRANSACTION", nullptr, nullptr, nullptr), SQLITE_OK);
+    sqlite3_stmt* statement = nullptr;
+    EXPECT_EQ(sqlite3_prepare_v2(handle, "INSERT INTO test_table(b, c) VALUES (?, ?)", -1, &statement, nullptr), SQLITE_OK);
+    for (int row = 0; row < rows; ++row) {
+        int item_count = 0;
+        const size_t size = rows > 1 ? min_size + (max_size - min_size) * row / (rows - 1) : min_size;
+        const std::string document = makeDocument(row, size, &item_count);
+        total_items += item_count;
+        EXPECT_EQ(sqlite3_bind_int(statement, 1, row), SQLITE_OK);
+        EXPECT_EQ(sqlite3_bind_text(statement, 2, document.data(), static_cast<int>(document.size()), SQLITE_TRANSIENT), SQLITE_OK);
+        EXPECT_EQ(sqlite3_step(statement), SQLITE_DONE);
+        EXPECT_EQ(sqlite3_reset(statement), SQLITE_OK);
+    }
+    EXPECT_EQ(sqlite3_finalize(statement), SQLITE_OK);
+    EXPECT_EQ(sqlite3_exec(handle, "END TRANSACTION", nullptr, nullptr, nullptr), SQLITE_OK);
+    return total_items;
+}
+
+} // namespace
+
+#define INDEXED_LOOKUP "SELECT json_extract(c, '$.name') = 'item 7' FROM test_table WHERE json_extract(c, '$.id') = 7"
+
+TEST(SQLite3, Json1)
+{
+    static constexpr int rows_to_insert = 20;
+
+    int64_t total_items = 0;
+    {
+        sqlite3* handle = nullptr;
+        ASSERT_EQ(sqlite3_open(":memory:", &handle), SQLITE_OK);
+        total_items = fillTestTable(handle, rows_to_insert, 100, 2000);
+        ASSERT_EQ(sqlite3_exec(handle, "CREATE INDEX test_table_id ON test_table(json_extract(c, '$.id'))", nullptr, nullptr, nullptr), SQLITE_OK)
+            << "SQLite has been built without JSON1";
+        // The expression index answers the lookup instead of parsing every document
+        EXPECT_NE(queryPlan(handle, INDEXED_LOOKUP).find("USING INDEX test_table_id"), std::string::npos);
+        ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    }
+
+    // Statements without a result row are executed, the rest have to return `expected`
+    const struct {
+        std::string sql;
+        bool returns_row;
+        int64_t expected;
+    } queries[] = {
+        { "SELECT sum(json_extract(c, '$.id')) FROM test_table", true, rows_to_insert * (rows_to_insert - 1) / 2 },
+        { "SELECT count(*) FROM test_table, json_each(test_table.c, '$.items')", true, total_items },
+        { "SELECT count(*) FROM test_table, json_each(test_table.c, '$.items') WHERE json_extract(json_each.value, '$.v') = 'abcdefghijklmnop'", true,
+            total_items },
+        { "SELECT count(*) FROM test_table, json_tree(test_table.c) WHERE json_tree.type = 'object'", true, total_items + rows_to_insert },
+        { "CREATE INDEX test_table_id ON test_table(json_extract(c, '$.id'))", false, 0 },
+        { INDEXED_LOOKUP, true, 1 },
+        { "UPDATE test_table SET c = json_set(c, '$.price', -1, '$.extra', json('{\"a\":[1,2]}'), '$.items[0].v', 'changed')", false, 0 },
+        { "SELECT count(*) FROM test_table WHERE json_extract(c, '$.price') = -1 AND json_extract(c, '$.extra.a[1]') = 2 "
+          "AND json_extract(c, '$.items[0].v') = 'changed' AND json_valid(c)",
+            true, rows_to_insert },
+        { INDEXED_LOOKUP, true, 1 },
+    };
+
+    int status;
+
+    auto tryJson = [&](DefaultOverthrower& overthrower) {
+        overthrower.activate();
+        sqlite3* handle = nullptr;
+        removeDbIfExists(overthrower);
+        {
+            OverthrowerPauser pauser;
+            ASSERT_EQ(sqlite3_open(TEST_DB_FILE_NAME, &handle), SQLITE_OK);
+            fillTestTable(handle, rows_to_insert, 100, 2000);
+        }
+
+        status = SQLITE_OK;
+        for (const auto& query : queries) {
+            int64_t value = 0;
+            status = query.returns_row ? queryInteger(handle, query.sql.c_str(), &value) : sqlite3_exec(handle, query.sql.c_str(), nullptr, nullptr, nullptr);
+            if (status != SQLITE_OK)
+                break;
+            OverthrowerPauser pauser;
+            ASSERT_EQ(value, query.expected) << query.sql;
+        }
+        if (status != SQLITE_OK)
+            OOM_SAFE_ASSERT_EQ(status, SQLITE_NOMEM);
+
+        ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    };
+
+    runOomSweeps("SQLite3.Json1", status, tryJson);
+}
+
+TEST(Benchmark, Json1)
+{
+    static constexpr size_t bytes_per_size = 64 * 1024 * 1024;
+    static constexpr int indexed_rows = 100000;
+    static constexpr int lookups = 100;
+
+    ReportTable throughput("JSON1 functions over " + std::to_string(bytes_per_size >> 20) + "MB of documents, MB/s",
+        { "document", "rows", "json_extract", "json_each", "json_tree", "json_set" });
+
+    for (size_t size : { 100, 1000, 10000, 100000, 1000000 }) {
+        const int rows = static_cast<int>(bytes_per_size / size);
+        sqlite3* handle = nullptr;
+        ASSERT_EQ(sqlite3_open(":memory:", &handle), SQLITE_OK);
+        fillTestTable(handle, rows, size, size);
+
+        std::vector<std::string> row = { std::to_string(size) + "B", std::to_string(rows) };
+        for (const char* sql : { "SELECT sum(json_extract(c, '$.id')) FROM test_table", "SELECT count(*) FROM test_table, json_each(test_table.c, '$.items')",
+                 "SELECT count(*) FROM test_table, json_tree(test_table.c)", "UPDATE test_table SET c = json_set(c, '$.price', 0, '$.items[0].v', 'x')" }) {
+            const Stopwatch stopwatch;
+            ASSERT_EQ(sqlite3_exec(handle, sql, nullptr, nullptr, nullptr), SQLITE_OK) << sql;
+            row.push_back(ReportTable::format("%.1f", bytes_per_size / stopwatch.seconds() / (1 << 20)));
+        }
+        throughput.addRow(row);
+        ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    }
+
+    ReportTable indexed(std::to_string(indexed_rows) + " documents of 1KB, lookup by json_extract(c, '$.id')",
+        { "table", "index build s", "lookup us", "json_set update s" });
+
+    for (bool with_index : { false, true }) {
+        sqlite3* handle = nullptr;
+        ASSERT_EQ(sqlite3_open(":memory:", &handle), SQLITE_OK);
+        fillTestTable(handle, indexed_rows, 1000, 1000);
+
+        std::string build = "-";
+        if (with_index) {
+            const Stopwatch stopwatch;
+            ASSERT_EQ(sqlite3_exec(handle, "CREATE INDEX test_table_id ON test_table(json_extract(c, '$.id'))", nullptr, nullptr, nullptr), SQLITE_OK);
+            build = ReportTable::format("%.3f", stopwatch.seconds());
+        }
+
+        sqlite3_stmt* statement = nullptr;
+        ASSERT_EQ(sqlite3_prepare_v2(handle, "SELECT json_extract(c, '$.name') FROM test_table WHERE json_extract(c, '$.id') = ?", -1, &statement, nullptr),
+            SQLITE_OK);
+        const Stopwatch stopwatch;
+        for (int i = 0; i < lookups; ++i) {
+            ASSERT_EQ(sqlite3_bind_int(statement, 1, i * (indexed_rows / lookups)), SQLITE_OK);
+            ASSERT_EQ(sqlite3_step(statement), SQLITE_ROW);
+            ASSERT_EQ(sqlite3_reset(statement), SQLITE_OK);
+        }
+        const double lookup = stopwatch.seconds() * 1e6 / lookups;
+        ASSERT_EQ(sqlite3_finalize(statement), SQLITE_OK);
+
+        // Every rewritten document has to be parsed once more to maintain the index
+        const Stopwatch update_stopwatch;
+        ASSERT_EQ(sqlite3_exec(handle, "UPDATE test_table SET c = json_set(c, '$.price', 0)", nullptr, nullptr, nullptr), SQLITE_OK);
+        indexed.addRow({ with_index ? "expression index" : "no index", build, ReportTable::format("%.1f", lookup),
+            ReportTable::format("%.3f", update_stopwatch.seconds()) });
+        ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    }
+
+    throughput.print();
+    indexed.print();
+}
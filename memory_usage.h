@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include <sqlite3.h>
+
+// The memory of the process at the end of a phase of a benchmark, seen by the kernel, by the allocator and by SQLite.
+// sqlite3_memory_used() only counts what SQLite has asked for; the allocator keeps more than that (headers, rounding,
+// free chunks it cannot give back, one arena per thread), and the resident set is what it costs in the end. Heap figures
+// need glibc, mallinfo2() from 2.33 on and mallinfo() before, whose int fields wrap above 2 GB; RSS needs
+// /proc/self/statm. Whatever is missing is reported as unavailable (-1).
+struct MemorySample {
+    long long rss = -1; // Resident set of the process
+    long long heap_in_use = -1; // Allocated chunks, mmap()ed ones included
+    long long heap_free = -1; // Free chunks kept in the arenas
+    long long heap_mmapped = -1; // Chunks served by mmap() on their own
+    long long heap_system_max = -1; // The most the arenas have ever taken from the system, malloc_info()
+    int arenas = -1; // Heaps reported by malloc_info()
+    long long sqlite_used = 0; // sqlite3_memory_used()
+    long long sqlite_highwater = 0; // sqlite3_memory_highwater() since the previous sample
+
+    // Bytes the allocator holds for every byte SQLite uses, both for its own use and for the harness
+    double overhead() const { return heap_in_use >= 0 && sqlite_used > 0 ? static_cast<double>(heap_in_use) / sqlite_used : -1; }
+
+    // Share of the arenas which is free but not given back to the system
+    double fragmentation() const
+    {
+        const long long arena = heap_in_use - heap_mmapped + heap_free;
+        return heap_free >= 0 && arena > 0 ? static_cast<double>(heap_free) / arena : -1;
+    }
+
+    static std::string megabytes(long long bytes) { return bytes < 0 ? "n/a" : format("%.1f", bytes / 1048576.0); }
+    static std::string percent(double share) { return share < 0 ? "n/a" : format("%.1f%%", share * 100); }
+    static std::string ratio(double value) { return value < 0 ? "n/a" : format("%.2fx", value); }
+
+    // Takes a sample and starts the high water mark of SQLite over. The figures of the kernel and of mallinfo are read
+    // before malloc_info(), which allocates for its output.
+    static MemorySample take()
+    {
+        MemorySample sample;
+        sample.sqlite_used = sqlite3_memory_used();
+        sample.sqlite_highwater = sqlite3_memory_highwater(1);
+        sample.rss = residentSetSize();
+#if defined(__GLIBC__)
+#if __GLIBC_PREREQ(2, 33)
+        const struct mallinfo2 info = mallinfo2();
+#else
+        const struct mallinfo info = mallinfo();
+#endif
+        sample.heap_in_use = static_cast<long long>(info.uordblks) + static_cast<long long>(info.hblkhd);
+        sample.heap_free = static_cast<long long>(info.fordblks);
+        sample.heap_mmapped = static_cast<long long>(info.hblkhd);
+        readMallocInfo(&sample);
+#endif
+        return sample;
+    }
+
+private:
+    static std::string format(const char* fmt, double value)
+    {
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), fmt, value);
+        return buffer;
+    }
+
+    // Read with open() and read() rather than stdio, so that sampling does not allocate
+    static long long residentSetSize()
+    {
+        const int fd = open("/proc/self/statm", O_RDONLY);
+        if (fd < 0)
+            return -1;
+        char buffer[128];
+        const ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+        close(fd);
+        if (length <= 0)
+            return -1;
+        buffer[length] = '\0';
+        long long size_pages, resident_pages;
+        if (sscanf(buffer, "%lld %lld", &size_pages, &resident_pages) != 2)
+            return -1;
+        return resident_pages * sysconf(_SC_PAGESIZE);
+    }
+
+#if defined(__GLIBC__)
+    // The XML of malloc_info() has a <heap nr="..."> element per arena and the totals of all of them at the end
+    static void readMallocInfo(MemorySample* sample)
+    {
+        char* xml = nullptr;
+        size_t size = 0;
+        FILE* stream = open_memstream(&xml, &size);
+        if (!stream)
+            return;
+        const bool written = malloc_info(0, stream) == 0;
+        fclose(stream);
+        if (written && xml) {
+            sample->arenas = 0;
+            for (const char* heap = strstr(xml, "<heap nr="); heap; heap = strstr(heap + 1, "<heap nr="))
+                ++sample->arenas;
+            const char* system_max = nullptr;
+            for (const char* found = strstr(xml, "<system type=\"max\" size=\""); found; found = strstr(found + 1, "<system type=\"max\" size=\""))
+                system_max = found;
+            if (system_max)
+                sample->heap_system_max = atoll(system_max + strlen("<system type=\"max\" size=\""));
+        }
+        free(xml);
+    }
+#endif
+};
@@ -0,0 +1,86 @@
+#include <cstring>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+
+#include "benchmark.h"
+#include "memory_usage.h"
+
+#define MEMORY_DB_FILE_NAME "memory_db"
+
+namespace {
+
+// The phases of the Resistance workload with a sorted select, every row of the report is a sample at the end of a phase
+void runMemoryPhases(const char* title, const char* pragmas, int rows_to_insert)
+{
+    ReportTable report(title,
+        { "phase", "RSS MB", "heap in use MB", "heap free MB", "mmapped MB", "arena peak MB", "arenas", "SQLite used MB", "SQLite peak MB", "heap/SQLite",
+            "fragmentation" });
+    auto addSample = [&report](const char* phase) {
+        const MemorySample sample = MemorySample::take();
+        report.addRow({ phase, MemorySample::megabytes(sample.rss), MemorySample::megabytes(sample.heap_in_use), MemorySample::megabytes(sample.heap_free),
+            MemorySample::megabytes(sample.heap_mmapped), MemorySample::megabytes(sample.heap_system_max),
+            sample.arenas < 0 ? "n/a" : std::to_string(sample.arenas), MemorySample::megabytes(sample.sqlite_used),
+            MemorySample::megabytes(sample.sqlite_highwater), MemorySample::ratio(sample.overhead()), MemorySample::percent(sample.fragmentation()) });
+    };
+
+    ResistanceOptions options;
+    options.pragmas = pragmas;
+    options.sorted_select = true;
+
+    addSample("start");
+    runResistancePhases(
+        MEMORY_DB_FILE_NAME, rows_to_insert,
+        [&](const char* phase, sqlite3* handle, const ResistancePhase& body) {
+            if (!strcmp(phase, "close")) {
+                // What SQLite and the allocator give back without closing the connection
+                sqlite3_db_release_memory(handle);
+#if defined(__GLIBC__)
+                malloc_trim(0);
+#endif
+                addSample("release + trim");
+            }
+            body(nullptr);
+            addSample(phase);
+        },
+        options);
+    report.print();
+}
+
+} // namespace
+
+TEST(Memory, Sample)
+{
+    sqlite3* handle = nullptr;
+    ASSERT_EQ(sqlite3_open(":memory:", &handle), SQLITE_OK);
+    ASSERT_EQ(sqlite3_exec(handle, "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)", nullptr, nullptr, nullptr), SQLITE_OK);
+    const MemorySample sample = MemorySample::take();
+    EXPECT_GT(sample.sqlite_used, 0);
+    EXPECT_GE(sample.sqlite_highwater, sample.sqlite_used);
+    EXPECT_LE(MemorySample::take().sqlite_highwater, sample.sqlite_highwater); // Started over by the first sample
+#if defined(__linux__)
+    EXPECT_GT(sample.rss, 0);
+#endif
+#if defined(__GLIBC__)
+    EXPECT_GE(sample.heap_in_use, sample.sqlite_used);
+    EXPECT_GE(sample.heap_free, 0);
+    EXPECT_GE(sample.arenas, 1);
+    EXPECT_GT(sample.heap_system_max, 0);
+#endif
+    ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+}
+
+// RSS, glibc heap and SQLite's own accounting side by side at the end of every phase, with the default page cache and
+// with a cache large enough for the whole database
+TEST(Benchmark, MemoryUsage)
+{
+    static constexpr int rows_to_insert = 1000000;
+
+    const std::string rows = std::to_string(rows_to_insert) + " rows";
+    ASSERT_NO_FATAL_FAILURE(
+        runMemoryPhases(("Memory of the Resistance workload with " + rows + ", default page cache").c_str(), "PRAGMA cache_size = -2000", rows_to_insert));
+    ASSERT_NO_FATAL_FAILURE(
+        runMemoryPhases(("Memory of the Resistance workload with " + rows + ", 256 MB page cache").c_str(), "PRAGMA cache_size = -262144", rows_to_insert));
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "watchdog.h"
+
+#define STRATEGY_RANDOM 0
+#define STRATEGY_STEP 1
+
+#define TEST_DB_FILE_NAME "db"
+// #define TEST_DB_FILE_NAME ":memory:"
+
+extern "C" {
+void activateOverthrower() __attribute__((weak));
+unsigned int deactivateOverthrower() __attribute__((weak));
+void pauseOverthrower(unsigned int duration) __attribute__((weak));
+void resumeOverthrower() __attribute__((weak));
+}
+
+// The library cannot be asked about its pauses, the watchdog diagnostic gets them from here
+inline void noteOverthrowerPaused(unsigned int duration)
+{
+    WatchdogContext& context = watchdogContext();
+    if (context.overthrower_depth < WatchdogContext::max_depth)
+        context.overthrower_pauses[context.overthrower_depth] = duration;
+    ++context.overthrower_depth;
+}
+
+inline void noteOverthrowerResumed()
+{
+    --watchdogContext().overthrower_depth;
+}
+
+class OverthrowerPauser final {
+public:
+    OverthrowerPauser()
+        : paused(true)
+    {
+        pauseOverthrower(0); // Pause for forever
+        noteOverthrowerPaused(0);
+    }
+
+    OverthrowerPauser(unsigned int duration)
+        : paused(duration)
+    {
+        if (duration) { // If duration is zero no pause is required
+            pauseOverthrower(duration);
+            noteOverthrowerPaused(duration);
+        }
+    }
+
+    ~OverthrowerPauser()
+    {
+        if (paused) {
+            resumeOverthrower();
+            noteOverthrowerResumed();
+        }
+    }
+
+private:
+    const bool paused;
+};
+
+#define OOM_SAFE_ASSERT_EQ(A, B)  \
+    {                             \
+        const auto a = A;         \
+        const auto b = B;         \
+        OverthrowerPauser pauser; \
+        ASSERT_EQ(a, b);          \
+    }
+
+#define OOM_SAFE_ASSERT_NE(A, B)  \
+    {                             \
+        const auto a = A;         \
+        const auto b = B;         \
+        OverthrowerPauser pauser; \
+        ASSERT_NE(a, b);          \
+    }
+
+#define OOM_SAFE_ASSERT_TRUE(A)   \
+    {                             \
+        const auto a = A;         \
+        OverthrowerPauser pauser; \
+        ASSERT_TRUE(a);           \
+    }
+
+#define OOM_SAFE_ASSERT_FALSE(A)  \
+    {                             \
+        const auto a = A;         \
+        OverthrowerPauser pauser; \
+        ASSERT_FALSE(a);          \
+    }
+
+class DefaultOverthrower {
+public:
+    DefaultOverthrower() = default;
+
+    virtual ~DefaultOverthrower()
+    {
+        unsetEnv("OVERTHROWER_STRATEGY");
+        unsetEnv("OVERTHROWER_SEED");
+        unsetEnv("OVERTHROWER_DUTY_CYCLE");
+        unsetEnv("OVERTHROWER_DELAY");
+        unsetEnv("OVERTHROWER_DURATION");
+
+        if (activated)
+            deactivate();
+    }
+
+    void activate()
+    {
+        ASSERT_FALSE(activated);
+        activateOverthrower();
+        activated = true;
+        watchdogContext().overthrower_active = true;
+    }
+
+    void deactivate()
+    {
+        const unsigned int blocks_leaked = deactivateOverthrower();
+        const bool was_activated = activated;
+        activated = false;
+        watchdogContext().overthrower_active = false;
+        ASSERT_TRUE(was_activated);
+        ASSERT_EQ(blocks_leaked, 0);
+    }
+
+    void pause(unsigned int duration)
+    {
+        {
+            OverthrowerPauser pauser;
+            paused.push_back(duration);
+        }
+        if (duration) {
+            pauseOverthrower(duration);
+            noteOverthrowerPaused(duration);
+        }
+    }
+
+    void resume()
+    {
+        OOM_SAFE_ASSERT_FALSE(paused.empty());
+        const bool was_paused = paused.back();
+        paused.pop_back();
+        if (was_paused) {
+            resumeOverthrower();
+            noteOverthrowerResumed();
+        }
+    }
+
+protected:
+    void setEnv(const char* name, unsigned int value) { ASSERT_EQ(setenv(name, std::to_string(value).c_str(), 1), 0); }
+    void unsetEnv(const char* name) { ASSERT_EQ(unsetenv(name), 0); }
+
+    bool activated = false;
+    std::vector<bool> paused;
+};
+
+class OverthrowerStrategyRandom : public DefaultOverthrower {
+public:
+    OverthrowerStrategyRandom() = delete;
+    OverthrowerStrategyRandom(unsigned int duty_cycle)
+    {
+        setEnv("OVERTHROWER_STRATEGY", STRATEGY_RANDOM);
+        // setEnv("OVERTHROWER_SEED", 0);
+        setEnv("OVERTHROWER_DUTY_CYCLE", duty_cycle);
+    }
+};
+
+class OverthrowerStrategyStep : public DefaultOverthrower {
+public:
+    OverthrowerStrategyStep() = delete;
+    OverthrowerStrategyStep(unsigned int delay)
+    {
+        setEnv("OVERTHROWER_STRATEGY", STRATEGY_STEP);
+        setEnv("OVERTHROWER_DELAY", delay);
+    }
+};
+
+static inline void removeDbIfExists(DefaultOverthrower& overthrower)
+{
+    static const bool db_in_memory = !strcmp(TEST_DB_FILE_NAME, ":memory:");
+    if (db_in_memory)
+        return;
+    OverthrowerPauser pauser;
+    if (!access(TEST_DB_FILE_NAME, F_OK))
+        ASSERT_EQ(unlink(TEST_DB_FILE_NAME), 0);
+}
@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <dlfcn.h>
+
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#else
+#include <malloc.h>
+#endif
+
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+
+#include "benchmark.h"
+#include "overthrower.h"
+
+#define OVERHEAD_DB_FILE_NAME "overhead_db"
+
+namespace {
+
+// The allocator of the C library itself, looked up in the library so that overthrower which interposes malloc() and
+// friends is out of the way. This is what "no injector" means, the test binary refuses to run without overthrower.
+struct SystemAllocator {
+    void* (*malloc)(size_t) = nullptr;
+    void (*free)(void*) = nullptr;
+    void* (*realloc)(void*, size_t) = nullptr;
+    size_t (*usableSize)(void*) = nullptr;
+
+    static const SystemAllocator& instance()
+    {
+        static const SystemAllocator allocator;
+        return allocator;
+    }
+
+    bool available() const { return malloc && free && realloc && usableSize; }
+
+private:
+    SystemAllocator()
+    {
+#if defined(__APPLE__)
+        void* library = dlopen("/usr/lib/libSystem.B.dylib", RTLD_NOW | RTLD_NOLOAD);
+        const char* usable_size_name = "malloc_size";
+#else
+        void* library = dlopen("libc.so.6", RTLD_NOW | RTLD_NOLOAD);
+        const char* usable_size_name = "malloc_usable_size";
+#endif
+        if (!library)
+            return;
+        malloc = reinterpret_cast<void* (*)(size_t)>(dlsym(library, "malloc"));
+        free = reinterpret_cast<void (*)(void*)>(dlsym(library, "free"));
+        realloc = reinterpret_cast<void* (*)(void*, size_t)>(dlsym(library, "realloc"));
+        usableSize = reinterpret_cast<size_t (*)(void*)>(dlsym(library, usable_size_name));
+    }
+};
+
+// Memory methods which call the C library directly instead of the interposed malloc() and friends
+void useSystemAllocator(sqlite3_mem_methods* methods)
+{
+    methods->xMalloc = [](int size) { return SystemAllocator::instance().malloc(static_cast<size_t>(size)); };
+    methods->xFree = [](void* memory) { SystemAllocator::instance().free(memory); };
+    methods->xRealloc = [](void* memory, int size) { return SystemAllocator::instance().realloc(memory, static_cast<size_t>(size)); };
+    methods->xSize = [](void* memory) { return memory ? static_cast<int>(SystemAllocator::instance().usableSize(memory)) : 0; };
+    methods->xRoundup = [](int size) { return (size + 7) & ~7; };
+}
+
+// Nanoseconds per malloc() + free() pair of a small block, the pointer goes through a volatile so that the compiler
+// cannot drop the pair.
+double mallocFreeNs(void* (*allocate)(size_t), void (*release)(void*), int pairs)
+{
+    static void* volatile sink = nullptr;
+    const Stopwatch stopwatch;
+    for (int i = 0; i < pairs; ++i) {
+        sink = allocate(64);
+        release(sink);
+    }
+    return static_cast<double>(stopwatch.elapsed().count()) / pairs;
+}
+
+enum InjectorMode { NO_INJECTOR, LOADED_INACTIVE, ACTIVE_PAUSED, ACTIVE_RUNNING, MODE_COUNT };
+
+const char* const mode_names[MODE_COUNT] = { "no injector", "loaded, inactive", "active, paused", "active, running" };
+
+// Runs body() with overthrower in the given state. Nothing may fail, so the active states pause injection: forever for
+// "paused", which skips the bookkeeping of every allocation, and for UINT_MAX allocations for "running", which counts
+// each of them down the same way a retry loop or STEP strategy does.
+template <typename Function>
+void withInjector(InjectorMode mode, Function body)
+{
+    if (mode == NO_INJECTOR || mode == LOADED_INACTIVE) {
+        body();
+        return;
+    }
+    OverthrowerStrategyStep overthrower(0);
+    overthrower.activate();
+    if (mode == ACTIVE_PAUSED) {
+        OverthrowerPauser pauser;
+        body();
+    } else {
+        OverthrowerPauser pauser(UINT_MAX);
+        body();
+    }
+}
+
+} // namespace
+
+TEST(Benchmark, OverthrowerOverhead)
+{
+    static constexpr int rows_to_insert = 20000;
+    static constexpr int trials = 5;
+    static constexpr int malloc_pairs = 10000000;
+    static constexpr int pauser_pairs = 1000000;
+
+    const SystemAllocator& system = SystemAllocator::instance();
+    ASSERT_TRUE(system.available()) << "The allocator of the C library cannot be found";
+
+    ReportTable allocator_report("Cost of a 64 byte malloc() + free() pair, best of " + std::to_string(trials) + " x " + std::to_string(malloc_pairs),
+        { "mode", "ns per pair", "overhead ns" });
+    ReportTable workload_report("Resistance workload without failures, " + std::to_string(rows_to_insert) + " rows, median of " + std::to_string(trials),
+        { "mode", "seconds", "SQLite allocations", "ns per allocation", "overhead ns per allocation", "slowdown" });
+
+    double malloc_baseline = 0;
+    double workload_baseline = 0;
+    for (int mode = 0; mode < MODE_COUNT; ++mode) {
+        const InjectorMode injector_mode = static_cast<InjectorMode>(mode);
+
+        double best_pair = 1e18;
+        for (int trial = 0; trial < trials; ++trial) {
+            withInjector(injector_mode, [&]() {
+                best_pair = std::min(best_pair, injector_mode == NO_INJECTOR ? mallocFreeNs(system.malloc, system.free, malloc_pairs)
+                                                                             : mallocFreeNs(&malloc, &free, malloc_pairs));
+            });
+        }
+        if (injector_mode == NO_INJECTOR)
+            malloc_baseline = best_pair;
+        allocator_report.addRow({ mode_names[mode], ReportTable::format("%.1f", best_pair), ReportTable::format("%.1f", best_pair - malloc_baseline) });
+
+        std::vector<double> seconds;
+        long long allocations = 0;
+        {
+            CountingMemoryMethods methods(injector_mode == NO_INJECTOR ? useSystemAllocator : nullptr);
+            for (int trial = 0; trial < trials; ++trial) {
+                const long long allocations_before = CountingMemoryMethods::count();
+                const Stopwatch stopwatch;
+                withInjector(injector_mode, [&]() {
+                    runResistancePhases(OVERHEAD_DB_FILE_NAME, rows_to_insert, [](const char*, sqlite3*, const ResistancePhase& body) { body(nullptr); });
+                });
+                ASSERT_FALSE(HasFatalFailure());
+                seconds.push_back(stopwatch.seconds());
+                allocations = CountingMemoryMethods::count() - allocations_before;
+            }
+        }
+        std::sort(seconds.begin(), seconds.end());
+        const double median = seconds[seconds.size() / 2];
+        const double ns_per_allocation = median * 1e9 / std::max(1LL, allocations);
+        if (injector_mode == NO_INJECTOR)
+            workload_baseline = median;
+        workload_report.addRow({ mode_names[mode], ReportTable::format("%.3f", median), std::to_string(allocations),
+            ReportTable::format("%.1f", ns_per_allocation), ReportTable::format("%.1f", (median - workload_baseline) * 1e9 / std::max(1LL, allocations)),
+            ReportTable::format("%.2fx", median / workload_baseline) });
+    }
+    // What every OOM_SAFE_ASSERT_* and every pause of a retry loop pays on top of the check itself
+    double forever_ns = 0;
+    double counted_ns = 0;
+    {
+        OverthrowerStrategyStep overthrower(0);
+        overthrower.activate();
+        const Stopwatch forever;
+        for (int i = 0; i < pauser_pairs; ++i)
+            OverthrowerPauser pauser;
+        forever_ns = static_cast<double>(forever.elapsed().count()) / pauser_pairs;
+        const Stopwatch counted;
+        for (int i = 0; i < pauser_pairs; ++i)
+            OverthrowerPauser pauser(1);
+        counted_ns = static_cast<double>(counted.elapsed().count()) / pauser_pairs;
+    }
+    ReportTable pauser_report("OverthrowerPauser with overthrower active, " + std::to_string(pauser_pairs) + " pairs", { "call", "ns" });
+    pauser_report.addRow({ "pause until resumed + resume", ReportTable::format("%.1f", forever_ns) });
+    pauser_report.addRow({ "pause for 1 allocation + resume", ReportTable::format("%.1f", counted_ns) });
+
+    allocator_report.print();
+    workload_report.print();
+    pauser_report.print();
+}
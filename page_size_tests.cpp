@@ -0,0 +1,125 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+
+#include "benchmark.h"
+
+#define PAGE_SIZE_DB_FILE_NAME "page_size_db"
+
+namespace {
+
+struct CacheConfig {
+    const char* name;
+    int cache_size; // Value for PRAGMA cache_size: pages when positive, KB when negative
+};
+
+void removePageSizeDb()
+{
+    for (const char* suffix : { "", "-journal" }) {
+        const std::string path = std::string(PAGE_SIZE_DB_FILE_NAME) + suffix;
+        if (!access(path.c_str(), F_OK))
+            ASSERT_EQ(unlink(path.c_str()), 0);
+    }
+}
+
+// Fixed size rows with a random b, so that inserts through test_b_idx and lookups by rowid land on random pages.
+void buildDb(int page_size, int64_t rows)
+{
+    sqlite3* handle = nullptr;
+    ASSERT_EQ(sqlite3_open(PAGE_SIZE_DB_FILE_NAME, &handle), SQLITE_OK);
+    const std::string sql = "PRAGMA page_size = " + std::to_string(page_size) + "; PRAGMA synchronous = OFF; PRAGMA cache_size = -262144;"
+        "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c);"
+        "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < " + std::to_string(rows) + ") "
+        "INSERT INTO test_table(b, c) SELECT random(), randomblob(200) FROM n;"
+        "CREATE INDEX test_b_idx ON test_table(b)";
+    ASSERT_EQ(sqlite3_exec(handle, sql.c_str(), nullptr, nullptr, nullptr), SQLITE_OK);
+    ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+}
+
+} // namespace
+
+TEST(Benchmark, PageSize)
+{
+    static constexpr int64_t database_bytes = 1LL << 30;
+    static constexpr int64_t bytes_per_row = 260; // 200 byte blob, record and index overhead
+    static constexpr int64_t rows = database_bytes / bytes_per_row;
+    static constexpr int rows_to_insert = 50000;
+    static constexpr int lookups = 50000;
+
+    static const int page_sizes[] = { 1024, 2048, 4096, 8192, 16384, 32768, 65536 };
+    static const CacheConfig caches[] = {
+        { "100 pages", 100 },
+        { "2MB", -2000 },
+        { "64MB", -65536 },
+        { "1GB", -1048576 },
+    };
+
+    ReportTable report("page_size x cache_size over a " + std::to_string(database_bytes >> 20) + "MB database (" + std::to_string(rows) +
+                           " rows, synchronous=OFF)",
+        { "page_size", "cache_size", "build s", "DB MB", "inserts/s", "lookups/s", "scan MB/s", "memory high-water MB" });
+
+    for (int page_size : page_sizes) {
+        removePageSizeDb();
+        const Stopwatch build;
+        buildDb(page_size, rows);
+        const std::string build_seconds = ReportTable::format("%.1f", build.seconds());
+
+        for (const auto& cache : caches) {
+            sqlite3* handle = nullptr;
+            ASSERT_EQ(sqlite3_open(PAGE_SIZE_DB_FILE_NAME, &handle), SQLITE_OK);
+            const std::string pragmas = "PRAGMA synchronous = OFF; PRAGMA cache_size = " + std::to_string(cache.cache_size);
+            ASSERT_EQ(sqlite3_exec(handle, pragmas.c_str(), nullptr, nullptr, nullptr), SQLITE_OK);
+            sqlite3_memory_highwater(1);
+
+            // Random keys go all over test_b_idx
+            double insert_elapsed = 0;
+            {
+                const Stopwatch stopwatch;
+                const std::string sql = "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < " + std::to_string(rows_to_insert) +
+                    ") INSERT INTO test_table(b, c) SELECT random(), randomblob(200) FROM n";
+                ASSERT_EQ(sqlite3_exec(handle, sql.c_str(), nullptr, nullptr, nullptr), SQLITE_OK);
+                insert_elapsed = stopwatch.seconds();
+            }
+
+            double lookup_elapsed = 0;
+            {
+                sqlite3_stmt* statement = nullptr;
+                ASSERT_EQ(sqlite3_prepare_v2(handle, "SELECT length(c) FROM test_table WHERE a = ?", -1, &statement, nullptr), SQLITE_OK);
+                uint64_t state = 1;
+                const Stopwatch stopwatch;
+                for (int i = 0; i < lookups; ++i) {
+                    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                    ASSERT_EQ(sqlite3_bind_int64(statement, 1, static_cast<sqlite3_int64>(1 + (state >> 33) % rows)), SQLITE_OK);
+                    ASSERT_EQ(sqlite3_step(statement), SQLITE_ROW);
+                    ASSERT_EQ(sqlite3_reset(statement), SQLITE_OK);
+                }
+                lookup_elapsed = stopwatch.seconds();
+                ASSERT_EQ(sqlite3_finalize(statement), SQLITE_OK);
+            }
+
+            double scan_elapsed = 0;
+            {
+                const Stopwatch stopwatch;
+                ASSERT_EQ(sqlite3_exec(handle, "SELECT sum(length(c)) FROM test_table", nullptr, nullptr, nullptr), SQLITE_OK);
+                scan_elapsed = stopwatch.seconds();
+            }
+
+            const double memory_highwater = static_cast<double>(sqlite3_memory_highwater(0));
+            ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+            const double db_mb = static_cast<double>(fileSize(PAGE_SIZE_DB_FILE_NAME)) / (1 << 20);
+
+            report.addRow({ std::to_string(page_size), cache.name, build_seconds, ReportTable::format("%.0f", db_mb),
+                ReportTable::format("%.0f", rows_to_insert / insert_elapsed), ReportTable::format("%.0f", lookups / lookup_elapsed),
+                ReportTable::format("%.0f", db_mb / scan_elapsed), ReportTable::format("%.1f", memory_highwater / (1 << 20)) });
+        }
+    }
+
+    removePageSizeDb();
+    report.print();
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware and software counters of the calling thread around a phase of a benchmark, read through perf_event_open(2).
+// Every event is opened on its own, so whatever the kernel, the PMU of a virtual machine or perf_event_paranoid does not
+// allow is simply reported as unavailable; on other systems nothing is available at all. Only user space is counted.
+class PerfCounters final {
+public:
+    enum Event { CYCLES, INSTRUCTIONS, CACHE_MISSES, BRANCH_MISSES, PAGE_FAULTS, EVENT_COUNT };
+
+    struct Sample {
+        bool available[EVENT_COUNT] = {};
+        double values[EVENT_COUNT] = {}; // Scaled up if the kernel had to multiplex the counters
+
+        // Formats values[event] / divisor, or "n/a"
+        std::string format(Event event, double divisor, const char* fmt = "%.2f") const
+        {
+            if (!available[event] || divisor == 0)
+                return "n/a";
+            char buffer[64];
+            snprintf(buffer, sizeof(buffer), fmt, values[event] / divisor);
+            return buffer;
+        }
+
+        std::string ipc() const
+        {
+            return available[CYCLES] && available[INSTRUCTIONS] ? format(INSTRUCTIONS, values[CYCLES]) : "n/a";
+        }
+
+        // Misses per thousand instructions
+        std::string mpki(Event event) const
+        {
+            return available[event] && available[INSTRUCTIONS] ? format(event, values[INSTRUCTIONS] / 1000) : "n/a";
+        }
+    };
+
+    PerfCounters()
+    {
+#if defined(__linux__)
+        static const struct {
+            uint32_t type;
+            uint64_t config;
+        } events[EVENT_COUNT] = {
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+            { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+        };
+        for (int i = 0; i < EVENT_COUNT; ++i) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = events[i].type;
+            attr.config = events[i].config;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            descriptors[i] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+#endif
+    }
+
+    ~PerfCounters()
+    {
+#if defined(__linux__)
+        for (int descriptor : descriptors) {
+            if (descriptor >= 0)
+                close(descriptor);
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool anyAvailable() const
+    {
+        for (int descriptor : descriptors) {
+            if (descriptor >= 0)
+                return true;
+        }
+        return false;
+    }
+
+    void start()
+    {
+#if defined(__linux__)
+        for (int descriptor : descriptors) {
+            if (descriptor >= 0) {
+                ioctl(descriptor, PERF_EVENT_IOC_RESET, 0);
+                ioctl(descriptor, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    Sample stop()
+    {
+        Sample sample;
+#if defined(__linux__)
+        for (int descriptor : descriptors) {
+            if (descriptor >= 0)
+                ioctl(descriptor, PERF_EVENT_IOC_DISABLE, 0);
+        }
+        for (int i = 0; i < EVENT_COUNT; ++i) {
+            uint64_t values[3]; // value, time enabled, time running
+            if (descriptors[i] < 0 || read(descriptors[i], values, sizeof(values)) != sizeof(values) || !values[2])
+                continue;
+            sample.available[i] = true;
+            sample.values[i] = static_cast<double>(values[0]) * values[1] / values[2];
+        }
+#endif
+        return sample;
+    }
+
+private:
+    int descriptors[EVENT_COUNT] = { -1, -1, -1, -1, -1 };
+};
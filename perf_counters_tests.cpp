@@ -0,0 +1,35 @@
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+
+#include "benchmark.h"
+#include "perf_counters.h"
+
+#define PERF_DB_FILE_NAME "perf_db"
+
+TEST(Benchmark, PerfCounters)
+{
+    static constexpr int rows_to_insert = 1000000;
+
+    PerfCounters counters;
+    ReportTable report("Phases of the Resistance workload with " + std::to_string(rows_to_insert) + " rows, hardware counters of user space" +
+            (counters.anyAvailable() ? "" : " (perf events are not permitted here)"),
+        { "phase", "seconds", "cycles/row", "instructions/row", "IPC", "cache-miss MPKI", "branch-miss MPKI", "page faults" });
+
+    // Each phase is measured as a whole and its counters are spread over all rows, even for opening the database
+    ASSERT_NO_FATAL_FAILURE(runResistancePhases(PERF_DB_FILE_NAME, rows_to_insert, [&](const char* phase, sqlite3*, const ResistancePhase& body) {
+        const Stopwatch stopwatch;
+        counters.start();
+        body(nullptr);
+        const PerfCounters::Sample sample = counters.stop();
+        if (testing::Test::HasFatalFailure())
+            return;
+        report.addRow({ phase, ReportTable::format("%.3f", stopwatch.seconds()), sample.format(PerfCounters::CYCLES, rows_to_insert, "%.0f"),
+            sample.format(PerfCounters::INSTRUCTIONS, rows_to_insert, "%.0f"), sample.ipc(), sample.mpki(PerfCounters::CACHE_MISSES),
+            sample.mpki(PerfCounters::BRANCH_MISSES), sample.format(PerfCounters::PAGE_FAULTS, 1, "%.0f") });
+    }));
+    report.print();
+}
@@ -0,0 +1,201 @@
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+
+#include "benchmark.h"
+#include "overthrower.h"
+#include "sigprof_sampler.h"
+#include "test_helpers.h"
+
+#define PROFILE_DB_FILE_NAME "profile_db"
+#define DEFAULT_PROFILE_FILE_NAME "profile.folded"
+
+namespace {
+
+// Retries a call the way SQLite3.Resistance does, every retry gets i more allocations through, and labels the samples
+// taken during the call.
+class ProfiledRetry final {
+public:
+    explicit ProfiledRetry(SigprofSampler& sampler)
+        : sampler(sampler)
+    {
+    }
+
+    template <typename Function>
+    int operator()(Function function, int expected_status = SQLITE_OK)
+    {
+        int status = expected_status;
+        for (unsigned int i = 0; i == 0 || status != expected_status; ++i) {
+            OverthrowerPauser pauser(i);
+            SigprofSampler::Attempt attempt(sampler, i != 0);
+            status = function();
+            if (status != expected_status)
+                attempt.failed();
+        }
+        return status;
+    }
+
+    int exec(sqlite3* handle, const char* sql)
+    {
+        return (*this)([handle, sql]() { return sqlite3_exec(handle, sql, nullptr, nullptr, nullptr); });
+    }
+
+private:
+    SigprofSampler& sampler;
+};
+
+void openProfileDb(ProfiledRetry& retry, sqlite3** handle)
+{
+    {
+        OverthrowerPauser pauser;
+        unlink(PROFILE_DB_FILE_NAME);
+    }
+    retry([handle]() {
+        const int status = sqlite3_open(PROFILE_DB_FILE_NAME, handle);
+        if (status != SQLITE_OK) {
+            sqlite3_close(*handle);
+            *handle = nullptr;
+        }
+        return status;
+    });
+}
+
+// In one transaction, unless a failure rolls it back and the rest goes in autocommit mode
+void insertRows(ProfiledRetry& retry, sqlite3* handle, int rows)
+{
+    sqlite3_stmt* statement = nullptr;
+    retry.exec(handle, "BEGIN TRANSACTION");
+    retry([handle, &statement]() { return sqlite3_prepare_v2(handle, "INSERT INTO test_table(b, c) VALUES (?, ?)", -1, &statement, nullptr); });
+    for (int i = 0; i < rows; ++i) {
+        retry([statement]() { return sqlite3_reset(statement); });
+        retry([statement, i]() { return sqlite3_bind_int(statement, 1, i); });
+        retry([statement]() { return sqlite3_bind_text(statement, 2, "AAAAAAAAAAAAAAAA", -1, SQLITE_STATIC); });
+        retry([statement]() { return sqlite3_step(statement); }, SQLITE_DONE);
+    }
+    retry([statement]() { return sqlite3_finalize(statement); });
+    if (!sqlite3_get_autocommit(handle))
+        retry.exec(handle, "END TRANSACTION");
+}
+
+// A failed step starts the scan over, so it goes on until SQLITE_DONE rather than for a number of rows
+void selectRows(ProfiledRetry& retry, sqlite3* handle)
+{
+    sqlite3_stmt* statement = nullptr;
+    retry([handle, &statement]() { return sqlite3_prepare_v2(handle, "SELECT a, b, c FROM test_table", -1, &statement, nullptr); });
+    int status = SQLITE_ROW;
+    while (status == SQLITE_ROW) {
+        retry([statement, &status]() {
+            status = sqlite3_step(statement);
+            return status == SQLITE_ROW || status == SQLITE_DONE ? SQLITE_OK : status;
+        });
+    }
+    retry([statement]() { return sqlite3_finalize(statement); });
+}
+
+// One iteration of a workload, everything it opens is closed before it returns
+struct ProfileWorkload {
+    const char* name;
+    void (*iteration)(ProfiledRetry& retry, int rows);
+};
+
+const ProfileWorkload profile_workloads[] = {
+    { "open-close",
+        [](ProfiledRetry& retry, int) {
+            sqlite3* handle = nullptr;
+            openProfileDb(retry, &handle);
+            retry.exec(handle, "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)");
+            retry.exec(handle, "CREATE INDEX test_idx ON test_table(a, b, c)");
+            retry.exec(handle, "DROP INDEX test_idx");
+            retry.exec(handle, "DROP TABLE test_table");
+            OOM_SAFE_ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+        } },
+    { "insert",
+        [](ProfiledRetry& retry, int rows) {
+            sqlite3* handle = nullptr;
+            openProfileDb(retry, &handle);
+            retry.exec(handle, "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)");
+            retry.exec(handle, "CREATE INDEX test_idx ON test_table(a, b, c)");
+            insertRows(retry, handle, rows);
+            OOM_SAFE_ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+        } },
+    { "resistance",
+        [](ProfiledRetry& retry, int rows) {
+            sqlite3* handle = nullptr;
+            openProfileDb(retry, &handle);
+            retry.exec(handle, "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)");
+            retry.exec(handle, "CREATE INDEX test_idx ON test_table(a, b, c)");
+            insertRows(retry, handle, rows);
+            selectRows(retry, handle);
+            retry.exec(handle, "DROP INDEX test_idx");
+            retry.exec(handle, "DROP TABLE test_table");
+            retry.exec(handle, "VACUUM");
+            OOM_SAFE_ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+        } },
+};
+
+} // namespace
+
+// Runs PROFILE_WORKLOAD (open-close, insert or resistance) for PROFILE_SECONDS with one allocation out of
+// PROFILE_DUTY_CYCLE failing (0 turns fault injection off) and writes the folded stacks to PROFILE_OUTPUT, e.g.
+//   PROFILE_WORKLOAD=insert ./sqlite3_tests --gtest_filter=Benchmark.Profile && flamegraph.pl profile.folded > profile.svg
+// The root frame of every stack tells where the sample has been taken: [normal] for the first attempt of a call,
+// [injected failure] for an attempt which has failed, [recovery] for its retries and [harness] for everything else.
+TEST(Benchmark, Profile)
+{
+    static constexpr int rows_to_insert = 1000;
+
+    const char* workload_name = getenv("PROFILE_WORKLOAD") ? getenv("PROFILE_WORKLOAD") : "resistance";
+    const char* output = getenv("PROFILE_OUTPUT") ? getenv("PROFILE_OUTPUT") : DEFAULT_PROFILE_FILE_NAME;
+    const int seconds = envInteger("PROFILE_SECONDS", 10);
+    const int duty_cycle = envInteger("PROFILE_DUTY_CYCLE", 8, 0);
+    const int interval_us = envInteger("PROFILE_INTERVAL_US", 1000);
+
+    const ProfileWorkload* workload = nullptr;
+    for (const ProfileWorkload& candidate : profile_workloads) {
+        if (!strcmp(candidate.name, workload_name))
+            workload = &candidate;
+    }
+    ASSERT_NE(workload, nullptr) << "Unknown PROFILE_WORKLOAD " << workload_name;
+    ASSERT_GT(interval_us, 0);
+
+    // Twice as many samples as the timer can deliver, the rest is counted as dropped
+    SigprofSampler sampler(static_cast<size_t>(seconds) * 2000000 / interval_us + 1, interval_us);
+    ProfiledRetry retry(sampler);
+
+    int iterations = 0;
+    ASSERT_TRUE(sampler.start());
+    const Stopwatch stopwatch;
+    while (stopwatch.seconds() < seconds) {
+        if (duty_cycle > 0) {
+            OverthrowerStrategyRandom overthrower(duty_cycle);
+            overthrower.activate();
+            workload->iteration(retry, rows_to_insert);
+        } else {
+            workload->iteration(retry, rows_to_insert);
+        }
+        ++iterations;
+    }
+    sampler.stop();
+    unlink(PROFILE_DB_FILE_NAME);
+
+    ASSERT_TRUE(sampler.writeFolded(output)) << output;
+
+    ReportTable report(std::string(workload_name) + " for " + std::to_string(seconds) + "s, " + std::to_string(iterations) + " iterations, " +
+            (duty_cycle > 0 ? "1/" + std::to_string(duty_cycle) + " allocations fail" : "no fault injection") + ", folded stacks in " + output,
+        { "label", "samples", "share" });
+    const double total = static_cast<double>(sampler.sampleCount());
+    for (int label = 0; label < SigprofSampler::LABEL_COUNT; ++label) {
+        const size_t count = sampler.sampleCount(static_cast<SigprofSampler::Label>(label));
+        report.addRow({ SigprofSampler::labelName(static_cast<SigprofSampler::Label>(label)), std::to_string(count),
+            ReportTable::format("%.1f%%", total ? 100.0 * count / total : 0.0) });
+    }
+    report.addRow({ "dropped", std::to_string(sampler.droppedCount()), "" });
+    report.print();
+}
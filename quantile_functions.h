@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include <sqlite3.h>
+
+// quantile(X, P) aggregate and window function: the P-quantile (0 <= P <= 1) of the non-NULL values of X, within 1%
+// relative error. The state is a fixed size logarithmic histogram (a DDSketch) kept in sqlite3_aggregate_context(),
+// so every group costs sizeof(quantile::Sketch) bytes no matter how many rows it has. Values beyond the range of the
+// histogram are counted in its first or last bucket.
+namespace quantile {
+
+static constexpr int BUCKET_COUNT = 2048;
+static constexpr int MIN_INDEX = -690; // ceil(log(1e-6) / log(GAMMA)), smaller magnitudes share the first bucket
+static constexpr double RELATIVE_ACCURACY = 0.01;
+static constexpr double GAMMA = (1 + RELATIVE_ACCURACY) / (1 - RELATIVE_ACCURACY);
+
+struct Sketch {
+    double fraction;
+    int64_t count;
+    int64_t zeros;
+    uint32_t positive[BUCKET_COUNT];
+    uint32_t negative[BUCKET_COUNT];
+};
+
+inline int bucket(double magnitude)
+{
+    const int index = static_cast<int>(std::ceil(std::log(magnitude) / std::log(GAMMA))) - MIN_INDEX;
+    return index < 0 ? 0 : index >= BUCKET_COUNT ? BUCKET_COUNT - 1 : index;
+}
+
+inline double bucketValue(int bucket)
+{
+    return 2 * std::pow(GAMMA, bucket + MIN_INDEX) / (GAMMA + 1);
+}
+
+inline void add(Sketch* sketch, double number, int delta)
+{
+    if (number > 0)
+        sketch->positive[bucket(number)] += delta;
+    else if (number < 0)
+        sketch->negative[bucket(-number)] += delta;
+    else
+        sketch->zeros += delta;
+    sketch->count += delta;
+}
+
+inline void step(sqlite3_context* context, int, sqlite3_value** argv)
+{
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL)
+        return;
+    // Zero filled on the first call, later calls return the same memory
+    Sketch* sketch = static_cast<Sketch*>(sqlite3_aggregate_context(context, sizeof(Sketch)));
+    if (!sketch) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    if (!sketch->count) {
+        sketch->fraction = sqlite3_value_double(argv[1]);
+        if (!(sketch->fraction >= 0 && sketch->fraction <= 1)) {
+            sqlite3_result_error(context, "quantile() fraction must be between 0 and 1", -1);
+            return;
+        }
+    }
+    add(sketch, sqlite3_value_double(argv[0]), 1);
+}
+
+inline void inverse(sqlite3_context* context, int, sqlite3_value** argv)
+{
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL)
+        return;
+    // Only rows which have been stepped are removed, so the state exists
+    Sketch* sketch = static_cast<Sketch*>(sqlite3_aggregate_context(context, sizeof(Sketch)));
+    if (!sketch) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    add(sketch, sqlite3_value_double(argv[0]), -1);
+}
+
+// Walks the buckets from the most negative value up to the one holding the requested rank.
+inline void value(sqlite3_context* context)
+{
+    const Sketch* sketch = static_cast<const Sketch*>(sqlite3_aggregate_context(context, 0));
+    if (!sketch || !sketch->count)
+        return; // No rows, the result is NULL
+    const int64_t rank = static_cast<int64_t>(sketch->fraction * (sketch->count - 1));
+    int64_t seen = 0;
+    for (int i = BUCKET_COUNT - 1; i >= 0; --i) {
+        seen += sketch->negative[i];
+        if (seen > rank) {
+            sqlite3_result_double(context, -bucketValue(i));
+            return;
+        }
+    }
+    seen += sketch->zeros;
+    if (seen > rank) {
+        sqlite3_result_double(context, 0.0);
+        return;
+    }
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        seen += sketch->positive[i];
+        if (seen > rank) {
+            sqlite3_result_double(context, bucketValue(i));
+            return;
+        }
+    }
+}
+
+} // namespace quantile
+
+inline int registerQuantileFunction(sqlite3* handle)
+{
+    return sqlite3_create_window_function(
+        handle, "quantile", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, nullptr, quantile::step, quantile::value, quantile::value, quantile::inverse, nullptr);
+}
@@ -0,0 +1,136 @@
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+
+#include "benchmark.h"
+#include "overthrower.h"
+#include "quantile_functions.h"
+#include "test_helpers.h"
+
+#define FILL_TEST_TABLE_SQL(ROWS)                                                                                                                              \
+    "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < " #ROWS ") INSERT INTO test_table(b, c) SELECT i, CASE WHEN i % 10 = 0 "     \
+    "THEN NULL ELSE 'AAAAAAAAAAAAAAAA' END FROM n"
+
+namespace {
+
+int queryDouble(sqlite3* handle, const char* sql, double* value)
+{
+    sqlite3_stmt* statement = nullptr;
+    int status = sqlite3_prepare_v2(handle, sql, -1, &statement, nullptr);
+    if (status == SQLITE_OK)
+        status = sqlite3_step(statement);
+    if (status == SQLITE_ROW) {
+        *value = sqlite3_column_type(statement, 0) == SQLITE_NULL ? NAN : sqlite3_column_double(statement, 0);
+        status = SQLITE_OK;
+    }
+    sqlite3_finalize(statement);
+    return status == SQLITE_DONE ? SQLITE_ERROR : status;
+}
+
+} // namespace
+
+TEST(SQLite3, QuantileFunction)
+{
+    // Each query yields a relative error or a number of mismatches which has to stay within the limit
+    static const struct {
+        const char* sql;
+        double limit;
+    } queries[] = {
+        { "SELECT abs(quantile(b, 0.5) - 500.0) / 500.0 FROM test_table", 0.02 },
+        { "SELECT abs(quantile(-b, 0.9) + 101.0) / 101.0 FROM test_table", 0.02 },
+        { "SELECT max(abs(q - median) / median) FROM (SELECT b % 4 AS g, quantile(b, 0.5) AS q, avg(b) AS median FROM test_table GROUP BY g)", 0.02 },
+        // b is ascending, so the median of the last 100 rows is b - 49.5
+        { "SELECT max(abs(q - (b - 49.5)) / (b - 49.5)) FROM (SELECT b, quantile(b, 0.5) OVER (ORDER BY a ROWS BETWEEN 99 PRECEDING AND CURRENT ROW) AS q "
+          "FROM test_table) WHERE b >= 100",
+            0.02 },
+        { "SELECT (quantile(b - 500, 0.5) IS NOT 0.0) + (quantile(NULL, 0.5) IS NOT NULL) FROM test_table WHERE b BETWEEN 499 AND 501", 0.0 },
+        { "SELECT abs(quantile(length(c), 1.0) - 16.0) / 16.0 FROM test_table", 0.02 },
+    };
+
+    int status;
+
+    auto tryQuantiles = [&](DefaultOverthrower& overthrower) {
+        overthrower.activate();
+        sqlite3* handle = nullptr;
+        removeDbIfExists(overthrower);
+        {
+            OverthrowerPauser pauser;
+            ASSERT_EQ(sqlite3_open(TEST_DB_FILE_NAME, &handle), SQLITE_OK);
+            ASSERT_EQ(sqlite3_exec(handle, "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)", nullptr, nullptr, nullptr), SQLITE_OK);
+            ASSERT_EQ(sqlite3_exec(handle, FILL_TEST_TABLE_SQL(1000), nullptr, nullptr, nullptr), SQLITE_OK);
+        }
+
+        status = registerQuantileFunction(handle);
+        for (const auto& query : queries) {
+            if (status != SQLITE_OK)
+                break;
+            double value = NAN;
+            status = queryDouble(handle, query.sql, &value);
+            if (status == SQLITE_OK) {
+                OverthrowerPauser pauser;
+                ASSERT_LE(value, query.limit) << query.sql;
+            }
+        }
+        if (status != SQLITE_OK)
+            OOM_SAFE_ASSERT_EQ(status, SQLITE_NOMEM);
+
+        {
+            // A bad fraction is an error rather than NOMEM
+            OverthrowerPauser pauser;
+            if (status == SQLITE_OK) {
+                double value;
+                ASSERT_EQ(queryDouble(handle, "SELECT quantile(b, 2) FROM test_table", &value), SQLITE_ERROR);
+                ASSERT_STREQ(sqlite3_errmsg(handle), "quantile() fraction must be between 0 and 1");
+            }
+        }
+
+        ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    };
+
+    runOomSweeps("SQLite3.QuantileFunction", status, tryQuantiles);
+}
+
+TEST(Benchmark, QuantileFunction)
+{
+    static constexpr int rows = 10000000;
+    static constexpr int window_rows = 1000000;
+
+    sqlite3* handle = nullptr;
+    ASSERT_EQ(sqlite3_open(":memory:", &handle), SQLITE_OK);
+    ASSERT_EQ(registerQuantileFunction(handle), SQLITE_OK);
+
+    ReportTable report("Aggregates over generated rows, " + std::to_string(sizeof(quantile::Sketch)) + " bytes of quantile() state per group",
+        { "query", "rows", "groups", "seconds", "rows/s", "memory high-water KB" });
+
+    // Rows come straight from a recursive CTE, so the only memory in use is the one of the query itself
+    auto measure = [&handle, &report](const char* name, int row_count, int groups, const std::string& select) {
+        const std::string sql
+            = "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < " + std::to_string(row_count) + ") SELECT count(*) FROM (" + select + ")";
+        sqlite3_memory_highwater(1);
+        const long long used_before = sqlite3_memory_used();
+        sqlite3_stmt* statement = nullptr;
+        const Stopwatch stopwatch;
+        ASSERT_EQ(sqlite3_prepare_v2(handle, sql.c_str(), -1, &statement, nullptr), SQLITE_OK);
+        ASSERT_EQ(sqlite3_step(statement), SQLITE_ROW);
+        ASSERT_EQ(sqlite3_column_int(statement, 0), groups);
+        ASSERT_EQ(sqlite3_finalize(statement), SQLITE_OK);
+        const double elapsed = stopwatch.seconds();
+        const double high_water = static_cast<double>(sqlite3_memory_highwater(0) - used_before);
+        report.addRow({ name, std::to_string(row_count), std::to_string(groups), ReportTable::format("%.3f", elapsed), ReportTable::format("%.0f", row_count / elapsed),
+            ReportTable::format("%.1f", high_water / 1024) });
+    };
+
+    measure("avg", rows, 1, "SELECT avg(i) FROM n");
+    measure("quantile", rows, 1, "SELECT quantile(i, 0.99) FROM n");
+    // Groups are sorted and aggregated one after another, so only one sketch is alive at a time
+    measure("avg GROUP BY", rows, 1000, "SELECT avg(i) FROM n GROUP BY i % 1000");
+    measure("quantile GROUP BY", rows, 1000, "SELECT quantile(i, 0.99) FROM n GROUP BY i % 1000");
+    measure("avg window", window_rows, window_rows, "SELECT avg(i) OVER (ORDER BY i ROWS 1000 PRECEDING) FROM n");
+    measure("quantile window", window_rows, window_rows, "SELECT quantile(i, 0.5) OVER (ORDER BY i ROWS 1000 PRECEDING) FROM n");
+
+    ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    report.print();
+}
@@ -0,0 +1,189 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+
+// Where the recorded plans live, CMakeLists.txt points it at the source tree
+#ifndef QUERY_PLANS_GOLDEN
+#define QUERY_PLANS_GOLDEN "query_plans.golden"
+#endif
+
+namespace {
+
+// How much the number of VM steps or full scan steps of a query may grow before it counts as a regression
+static constexpr double step_tolerance = 0.1;
+
+struct PlanQuery {
+    const char* name;
+    const char* sql;
+};
+
+// The benchmark queries whose plans are tracked. Adding one means regenerating the golden file.
+const PlanQuery plan_queries[] = {
+    { "rowid_lookup", "SELECT c FROM test_table WHERE a = 500" },
+    { "index_equality", "SELECT count(*) FROM test_table WHERE b = 7" },
+    { "index_range", "SELECT sum(a) FROM test_table WHERE b BETWEEN 10 AND 12" },
+    { "index_order_by", "SELECT a, c FROM test_table ORDER BY b LIMIT 10" },
+    { "index_max", "SELECT max(b) FROM test_table" },
+    { "full_scan", "SELECT count(*) FROM test_table WHERE c LIKE '%99%'" },
+    { "group_by_temp_b_tree", "SELECT c, count(*) FROM test_table GROUP BY c" },
+    { "join_by_rowid", "SELECT count(*) FROM test_table t1 JOIN test_table t2 ON t2.a = t1.b WHERE t1.b < 5" },
+};
+
+struct QueryProfile {
+    std::string sql;
+    std::vector<std::string> plan;
+    int vm_steps = 0;
+    int fullscan_steps = 0;
+};
+
+// 3.28 says "SCAN TABLE x" and "SEARCH TABLE x AS y" where later versions say "SCAN x" and "SEARCH y", only the choices
+// made by the planner matter.
+std::string normalizePlanLine(std::string line)
+{
+    for (const char* prefix : { "SCAN TABLE ", "SEARCH TABLE " }) {
+        const size_t position = line.find(prefix);
+        if (position == std::string::npos)
+            continue;
+        const size_t table = position + strlen(prefix);
+        const size_t table_end = line.find(' ', table);
+        if (table_end != std::string::npos && line.compare(table_end, strlen(" AS "), " AS ") == 0)
+            line.erase(table, table_end + strlen(" AS ") - table);
+        line.erase(table - strlen("TABLE "), strlen("TABLE "));
+    }
+    return line;
+}
+
+void profileQuery(sqlite3* handle, const char* sql, QueryProfile* profile)
+{
+    profile->sql = sql;
+
+    sqlite3_stmt* statement = nullptr;
+    ASSERT_EQ(sqlite3_prepare_v2(handle, (std::string("EXPLAIN QUERY PLAN ") + sql).c_str(), -1, &statement, nullptr), SQLITE_OK);
+    std::map<int, int> depths; // Plan rows refer to their parent by id, nesting becomes indentation
+    while (sqlite3_step(statement) == SQLITE_ROW) {
+        const int depth = depths[sqlite3_column_int(statement, 1)];
+        depths[sqlite3_column_int(statement, 0)] = depth + 1;
+        profile->plan.push_back(std::string(depth * 2, ' ') + normalizePlanLine(reinterpret_cast<const char*>(sqlite3_column_text(statement, 3))));
+    }
+    ASSERT_EQ(sqlite3_finalize(statement), SQLITE_OK);
+
+    ASSERT_EQ(sqlite3_prepare_v2(handle, sql, -1, &statement, nullptr), SQLITE_OK);
+    int status;
+    while ((status = sqlite3_step(statement)) == SQLITE_ROW)
+        ;
+    ASSERT_EQ(status, SQLITE_DONE);
+    profile->vm_steps = sqlite3_stmt_status(statement, SQLITE_STMTSTATUS_VM_STEP, 0);
+    profile->fullscan_steps = sqlite3_stmt_status(statement, SQLITE_STMTSTATUS_FULLSCAN_STEP, 0);
+    ASSERT_EQ(sqlite3_finalize(statement), SQLITE_OK);
+}
+
+// The golden file names the SQLite version it has been recorded with, then comes a sequence of blocks:
+//   sqlite <version>
+//   [name]
+//   sql <statement>
+//   vm_step <count>
+//   fullscan_step <count>
+//   plan <line of EXPLAIN QUERY PLAN, nested lines are indented>
+//   ...
+std::map<std::string, QueryProfile> readGolden(const char* path, std::string* version)
+{
+    std::map<std::string, QueryProfile> profiles;
+    std::ifstream file(path);
+    std::string line;
+    QueryProfile* profile = nullptr;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        if (line[0] == '[') {
+            profile = &profiles[line.substr(1, line.find(']') - 1)];
+            continue;
+        }
+        const size_t space = line.find(' ');
+        const std::string key = line.substr(0, space);
+        const std::string value = space == std::string::npos ? "" : line.substr(space + 1);
+        if (!profile) {
+            if (key == "sqlite")
+                *version = value;
+            continue;
+        }
+        if (key == "sql")
+            profile->sql = value;
+        else if (key == "vm_step")
+            profile->vm_steps = atoi(value.c_str());
+        else if (key == "fullscan_step")
+            profile->fullscan_steps = atoi(value.c_str());
+        else if (key == "plan")
+            profile->plan.push_back(value);
+    }
+    return profiles;
+}
+
+void writeGolden(const char* path, const std::map<std::string, QueryProfile>& profiles)
+{
+    std::ofstream file(path);
+    file << "# EXPLAIN QUERY PLAN and statement counters of the queries in query_plan_tests.cpp, recorded with SQLite "
+         << sqlite3_libversion() << ".\n# Regenerate with UPDATE_GOLDEN_FILES=1 from the amalgamation CMakeLists.txt builds when a change of plan is "
+            "intended.\nsqlite "
+         << sqlite3_libversion() << "\n";
+    for (const PlanQuery& query : plan_queries) {
+        const QueryProfile& profile = profiles.at(query.name);
+        file << "\n[" << query.name << "]\nsql " << profile.sql << "\nvm_step " << profile.vm_steps << "\nfullscan_step " << profile.fullscan_steps << "\n";
+        for (const std::string& line : profile.plan)
+            file << "plan " << line << "\n";
+    }
+    ASSERT_TRUE(file.good()) << path;
+}
+
+} // namespace
+
+TEST(SQLite3, QueryPlans)
+{
+    static constexpr int rows_to_insert = 10000;
+
+    sqlite3* handle = nullptr;
+    ASSERT_EQ(sqlite3_open(":memory:", &handle), SQLITE_OK);
+    const std::string schema = "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c);"
+                               "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < "
+        + std::to_string(rows_to_insert) + ") INSERT INTO test_table(b, c) SELECT i % 100, 'text ' || (i % 1000) FROM n; CREATE INDEX test_b_idx ON test_table(b)";
+    ASSERT_EQ(sqlite3_exec(handle, schema.c_str(), nullptr, nullptr, nullptr), SQLITE_OK);
+
+    std::map<std::string, QueryProfile> profiles;
+    for (const PlanQuery& query : plan_queries)
+        profileQuery(handle, query.sql, &profiles[query.name]);
+    ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+
+    const char* update = getenv("UPDATE_GOLDEN_FILES");
+    if (update && !strcmp(update, "1")) {
+        writeGolden(QUERY_PLANS_GOLDEN, profiles);
+        return;
+    }
+
+    std::string golden_version;
+    const std::map<std::string, QueryProfile> golden = readGolden(QUERY_PLANS_GOLDEN, &golden_version);
+    ASSERT_FALSE(golden.empty()) << QUERY_PLANS_GOLDEN " is missing, run with UPDATE_GOLDEN_FILES=1 to record it";
+    // Plans are comparable across versions once normalized. The counters come from the code generator of a release, but
+    // for these queries they have not moved between the releases tried so far, a version taking more steps is reported.
+    if (golden_version != sqlite3_libversion())
+        printf("%s has been recorded with SQLite %s, this is %s\n", QUERY_PLANS_GOLDEN, golden_version.empty() ? "unknown" : golden_version.c_str(),
+            sqlite3_libversion());
+    for (const PlanQuery& query : plan_queries) {
+        const auto expected = golden.find(query.name);
+        ASSERT_NE(expected, golden.end()) << query.name << " has not been recorded, run with UPDATE_GOLDEN_FILES=1";
+        const QueryProfile& actual = profiles[query.name];
+        ASSERT_EQ(actual.sql, expected->second.sql) << query.name << " has changed, run with UPDATE_GOLDEN_FILES=1";
+        EXPECT_EQ(actual.plan, expected->second.plan) << query.name << ": " << query.sql;
+        EXPECT_LE(actual.vm_steps, static_cast<int>(expected->second.vm_steps * (1 + step_tolerance)))
+            << query.name << ": " << query.sql << ", recorded with SQLite " << golden_version;
+        EXPECT_LE(actual.fullscan_steps, static_cast<int>(expected->second.fullscan_steps * (1 + step_tolerance)))
+            << query.name << ": " << query.sql << ", recorded with SQLite " << golden_version;
+    }
+}
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Repeated trials of a benchmark and their comparison with a baseline recorded on the same machine. A single run is
+// too noisy to gate a change on, so every metric keeps all of its samples and two runs are compared with the
+// Mann-Whitney U test, which needs no assumption about how the samples are distributed.
+
+struct TrialMetric {
+    bool higher_is_better = true;
+    std::vector<double> samples;
+};
+
+// Metric name -> samples, ordered so that reports and baseline files are stable
+typedef std::map<std::string, TrialMetric> TrialMetrics;
+
+static inline double sampleMedian(std::vector<double> samples)
+{
+    if (samples.empty())
+        return 0.0;
+    std::sort(samples.begin(), samples.end());
+    const size_t middle = samples.size() / 2;
+    return samples.size() % 2 ? samples[middle] : (samples[middle - 1] + samples[middle]) / 2;
+}
+
+static inline double sampleMean(const std::vector<double>& samples)
+{
+    double sum = 0.0;
+    for (double sample : samples)
+        sum += sample;
+    return samples.empty() ? 0.0 : sum / samples.size();
+}
+
+// Half width of the 95% confidence interval of the mean, Student's t for small samples
+static inline double confidenceHalfWidth(const std::vector<double>& samples)
+{
+    static const double t975[] = { 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228, 2.201, 2.179, 2.160, 2.145, 2.131,
+        2.120, 2.110, 2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+    const size_t n = samples.size();
+    if (n < 2)
+        return 0.0;
+    const double mean = sampleMean(samples);
+    double squares = 0.0;
+    for (double sample : samples)
+        squares += (sample - mean) * (sample - mean);
+    const size_t df = n - 1;
+    const double t = df <= sizeof(t975) / sizeof(t975[0]) ? t975[df - 1] : 1.96;
+    return t * std::sqrt(squares / df / n);
+}
+
+// Two-sided p-value of the Mann-Whitney U test by the normal approximation with tie and continuity corrections.
+// Identical samples give 1.0.
+static inline double mannWhitneyPValue(const std::vector<double>& a, const std::vector<double>& b)
+{
+    const size_t n1 = a.size();
+    const size_t n2 = b.size();
+    if (!n1 || !n2)
+        return 1.0;
+
+    // Ranks of the pooled samples, ties get the average rank
+    std::vector<std::pair<double, bool>> pooled; // value, comes from a
+    pooled.reserve(n1 + n2);
+    for (double value : a)
+        pooled.emplace_back(value, true);
+    for (double value : b)
+        pooled.emplace_back(value, false);
+    std::sort(pooled.begin(), pooled.end());
+
+    const double n = static_cast<double>(n1 + n2);
+    double rank_sum_a = 0.0;
+    double ties = 0.0; // Sum of t^3 - t over the groups of ties
+    for (size_t i = 0; i < pooled.size();) {
+        size_t j = i;
+        while (j < pooled.size() && pooled[j].first == pooled[i].first)
+            ++j;
+        const double rank = (i + 1 + j) / 2.0;
+        for (size_t k = i; k < j; ++k) {
+            if (pooled[k].second)
+                rank_sum_a += rank;
+        }
+        const double t = static_cast<double>(j - i);
+        ties += t * t * t - t;
+        i = j;
+    }
+
+    const double u = rank_sum_a - n1 * (n1 + 1) / 2.0;
+    const double mean = n1 * n2 / 2.0;
+    const double variance = n1 * n2 / 12.0 * ((n + 1) - ties / (n * (n - 1)));
+    if (variance <= 0.0)
+        return 1.0;
+    const double z = std::max(0.0, std::fabs(u - mean) - 0.5) / std::sqrt(variance);
+    return std::erfc(z / std::sqrt(2.0));
+}
+
+// A metric is a regression when the change of its median goes the wrong way by more than min_change and the
+// Mann-Whitney test says that the change is significant.
+struct TrialComparison {
+    double baseline_median = 0.0;
+    double median = 0.0;
+    double change = 0.0; // Relative to the baseline, positive is better whatever the direction of the metric
+    double p_value = 1.0;
+    bool regression = false;
+    bool improvement = false;
+};
+
+static inline TrialComparison compareTrials(const TrialMetric& baseline, const TrialMetric& current, double alpha = 0.05, double min_change = 0.05)
+{
+    TrialComparison comparison;
+    comparison.baseline_median = sampleMedian(baseline.samples);
+    comparison.median = sampleMedian(current.samples);
+    comparison.p_value = mannWhitneyPValue(baseline.samples, current.samples);
+    if (comparison.baseline_median != 0.0) {
+        comparison.change = (comparison.median - comparison.baseline_median) / std::fabs(comparison.baseline_median);
+        if (!current.higher_is_better)
+            comparison.change = 0.0 - comparison.change; // Not -change, which makes "-0.0%" out of no change
+    }
+    const bool significant = comparison.p_value < alpha;
+    comparison.regression = significant && comparison.change < -min_change;
+    comparison.improvement = significant && comparison.change > min_change;
+    return comparison;
+}
+
+// The baseline is a JSON file:
+// { "sqlite": "3.28.0", "metrics": { "<name>": { "better": "higher" | "lower", "samples": [ ... ] }, ... } }
+static inline bool writeTrialBaseline(const char* path, const std::string& sqlite_version, const TrialMetrics& metrics)
+{
+    std::ofstream file(path);
+    file << "{\n  \"sqlite\": \"" << sqlite_version << "\",\n  \"metrics\": {";
+    const char* separator = "\n";
+    for (const auto& metric : metrics) {
+        file << separator << "    \"" << metric.first << "\": { \"better\": \"" << (metric.second.higher_is_better ? "higher" : "lower") << "\", \"samples\": [";
+        for (size_t i = 0; i < metric.second.samples.size(); ++i) {
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "%.17g", metric.second.samples[i]);
+            file << (i ? ", " : " ") << buffer;
+        }
+        file << " ] }";
+        separator = ",\n";
+    }
+    file << "\n  }\n}\n";
+    return file.good();
+}
+
+// Reads what writeTrialBaseline() writes; unknown keys are skipped, metric names must not contain escapes.
+// Returns false if the file is missing or malformed.
+static inline bool readTrialBaseline(const char* path, std::string* sqlite_version, TrialMetrics* metrics)
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+    std::stringstream contents;
+    contents << file.rdbuf();
+    const std::string json = contents.str();
+    size_t position = 0;
+
+    auto skipSpace = [&]() {
+        while (position < json.size() && isspace(static_cast<unsigned char>(json[position])))
+            ++position;
+    };
+    auto consume = [&](char expected) {
+        skipSpace();
+        if (position >= json.size() || json[position] != expected)
+            return false;
+        ++position;
+        return true;
+    };
+    auto readString = [&](std::string* value) {
+        if (!consume('"'))
+            return false;
+        const size_t end = json.find('"', position);
+        if (end == std::string::npos)
+            return false;
+        *value = json.substr(position, end - position);
+        position = end + 1;
+        return true;
+    };
+    auto readNumber = [&](double* value) {
+        skipSpace();
+        char* end = nullptr;
+        *value = strtod(json.c_str() + position, &end);
+        if (end == json.c_str() + position)
+            return false;
+        position = end - json.c_str();
+        return true;
+    };
+    // Skips a string, a number or a nesting of objects and arrays without strings containing brackets
+    auto skipValue = [&]() {
+        skipSpace();
+        std::string ignored;
+        if (position < json.size() && json[position] == '"')
+            return readString(&ignored);
+        int depth = 0;
+        for (; position < json.size(); ++position) {
+            const char c = json[position];
+            if (c == '{' || c == '[')
+                ++depth;
+            else if (c == '}' || c == ']') {
+                if (!depth)
+                    return true;
+                if (!--depth) {
+                    ++position;
+                    return true;
+                }
+            } else if (c == ',' && !depth)
+                return true;
+        }
+        return !depth;
+    };
+    // Calls member(key) for every member of an object
+    auto readObject = [&](const std::function<bool(const std::string&)>& member) {
+        if (!consume('{'))
+            return false;
+        if (consume('}'))
+            return true;
+        do {
+            std::string key;
+            if (!readString(&key) || !consume(':') || !member(key))
+                return false;
+        } while (consume(','));
+        return consume('}');
+    };
+
+    return readObject([&](const std::string& key) {
+        if (key == "sqlite")
+            return readString(sqlite_version);
+        if (key != "metrics")
+            return skipValue();
+        return readObject([&](const std::string& name) {
+            TrialMetric& metric = (*metrics)[name];
+            return readObject([&](const std::string& field) {
+                if (field == "better") {
+                    std::string better;
+                    if (!readString(&better))
+                        return false;
+                    metric.higher_is_better = better == "higher";
+                    return true;
+                }
+                if (field != "samples")
+                    return skipValue();
+                if (!consume('['))
+                    return false;
+                if (consume(']'))
+                    return true;
+                do {
+                    double sample;
+                    if (!readNumber(&sample))
+                        return false;
+                    metric.samples.push_back(sample);
+                } while (consume(','));
+                return consume(']');
+            });
+        });
+    });
+}
@@ -0,0 +1,169 @@
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+
+#include "benchmark.h"
+#include "regression.h"
+#include "test_helpers.h"
+
+#define REGRESSION_DB_FILE_NAME "regression_db"
+#define DEFAULT_BASELINE_FILE_NAME "benchmark_baseline.json"
+
+namespace {
+
+// One trial of the Resistance workload without fault injection, the insert, select and index build phases add their
+// throughput, the 99th percentile of a single step and the number of allocations they made.
+void runResistanceTrial(int rows_to_insert, TrialMetrics* metrics)
+{
+    auto record = [metrics](const std::string& phase, double throughput, double p99, long long allocations) {
+        TrialMetric& rows_per_second = (*metrics)[phase + " rows/s"];
+        rows_per_second.higher_is_better = true;
+        rows_per_second.samples.push_back(throughput);
+        if (p99 >= 0) {
+            TrialMetric& latency = (*metrics)[phase + " p99 us"];
+            latency.higher_is_better = false;
+            latency.samples.push_back(p99);
+        }
+        TrialMetric& allocation_count = (*metrics)[phase + " allocations"];
+        allocation_count.higher_is_better = false;
+        allocation_count.samples.push_back(static_cast<double>(allocations));
+    };
+
+    runResistancePhases(REGRESSION_DB_FILE_NAME, rows_to_insert, [&](const char* phase, sqlite3*, const ResistancePhase& body) {
+        const bool stepped = !strcmp(phase, "insert") || !strcmp(phase, "select");
+        if (!stepped && strcmp(phase, "index build")) {
+            body(nullptr);
+            return;
+        }
+        LatencyRecorder recorder;
+        recorder.reserve(rows_to_insert);
+        const long long allocations = CountingMemoryMethods::count();
+        const Stopwatch stopwatch;
+        body(stepped ? &recorder : nullptr);
+        const double seconds = stopwatch.seconds();
+        if (!testing::Test::HasFatalFailure())
+            record(phase, rows_to_insert / seconds, stepped ? recorder.percentile(0.99) : -1, CountingMemoryMethods::count() - allocations);
+    });
+}
+
+} // namespace
+
+TEST(Regression, MannWhitney)
+{
+    const std::vector<double> a = { 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0, 9.0, 10.0 };
+    const std::vector<double> shifted = { 11.0, 12.0, 13.0, 14.0, 15.0, 16.0, 17.0, 18.0, 19.0, 20.0 };
+    const std::vector<double> interleaved = { 1.5, 2.5, 3.5, 4.5, 5.5, 6.5, 7.5, 8.5, 9.5, 10.5 };
+
+    EXPECT_DOUBLE_EQ(mannWhitneyPValue(a, a), 1.0);
+    EXPECT_DOUBLE_EQ(mannWhitneyPValue(std::vector<double>(5, 3.0), std::vector<double>(5, 3.0)), 1.0);
+    // U = 0 for completely separated samples of ten, the exact two-sided p is 1.1e-5
+    EXPECT_LT(mannWhitneyPValue(a, shifted), 0.001);
+    EXPECT_NEAR(mannWhitneyPValue(a, shifted), mannWhitneyPValue(shifted, a), 1e-12);
+    EXPECT_GT(mannWhitneyPValue(a, interleaved), 0.5);
+
+    TrialMetric baseline;
+    TrialMetric current;
+    baseline.samples = shifted;
+    current.samples = a;
+    EXPECT_TRUE(compareTrials(baseline, current).regression);
+    current.higher_is_better = false;
+    EXPECT_TRUE(compareTrials(baseline, current).improvement);
+
+    EXPECT_NEAR(confidenceHalfWidth(a), 2.262 * 3.0276503540974917 / std::sqrt(10.0), 1e-9);
+}
+
+TEST(Regression, Baseline)
+{
+    static constexpr const char* path = "regression_baseline_test.json";
+
+    TrialMetrics written;
+    written["insert rows/s"].samples = { 1.5, 250000.25, 1e-3 };
+    written["insert p99 us"].higher_is_better = false;
+    written["insert p99 us"].samples = { 7.0 };
+    written["empty"].samples = {};
+    ASSERT_TRUE(writeTrialBaseline(path, "3.28.0", written));
+
+    std::string version;
+    TrialMetrics read;
+    ASSERT_TRUE(readTrialBaseline(path, &version, &read));
+    EXPECT_EQ(version, "3.28.0");
+    ASSERT_EQ(read.size(), written.size());
+    for (const auto& metric : written) {
+        EXPECT_EQ(read[metric.first].higher_is_better, metric.second.higher_is_better) << metric.first;
+        EXPECT_EQ(read[metric.first].samples, metric.second.samples) << metric.first;
+    }
+    ASSERT_EQ(unlink(path), 0);
+
+    EXPECT_FALSE(readTrialBaseline(path, &version, &read));
+}
+
+// Runs the Resistance workload BENCHMARK_TRIALS times after BENCHMARK_WARMUPS discarded runs and compares every metric
+// with the baseline in BENCHMARK_BASELINE (benchmark_baseline.json by default). UPDATE_BENCHMARK_BASELINE=1 records
+// the baseline instead. Baselines only make sense on the machine they have been recorded on.
+TEST(Benchmark, Regression)
+{
+    static constexpr int rows_to_insert = 100000;
+
+    const int warmups = envInteger("BENCHMARK_WARMUPS", 2);
+    const int trials = envInteger("BENCHMARK_TRIALS", 10);
+    const char* baseline_path = getenv("BENCHMARK_BASELINE") ? getenv("BENCHMARK_BASELINE") : DEFAULT_BASELINE_FILE_NAME;
+    const char* update = getenv("UPDATE_BENCHMARK_BASELINE");
+
+    TrialMetrics metrics;
+    {
+        CountingMemoryMethods counter;
+        for (int i = 0; i < warmups; ++i) {
+            TrialMetrics discarded;
+            ASSERT_NO_FATAL_FAILURE(runResistanceTrial(rows_to_insert, &discarded));
+        }
+        for (int i = 0; i < trials; ++i)
+            ASSERT_NO_FATAL_FAILURE(runResistanceTrial(rows_to_insert, &metrics));
+    }
+
+    if (update && !strcmp(update, "1")) {
+        ASSERT_TRUE(writeTrialBaseline(baseline_path, sqlite3_libversion(), metrics)) << baseline_path;
+        printf("Baseline of %d trials has been written to %s\n", trials, baseline_path);
+        return;
+    }
+
+    std::string baseline_version;
+    TrialMetrics baseline;
+    const bool has_baseline = readTrialBaseline(baseline_path, &baseline_version, &baseline);
+
+    ReportTable report("Resistance workload, " + std::to_string(rows_to_insert) + " rows, " + std::to_string(trials) + " trials after " + std::to_string(warmups) +
+            " warm-ups" + (has_baseline ? ", baseline " + std::string(baseline_path) + " (SQLite " + baseline_version + ")" : ", no baseline in " + std::string(baseline_path)),
+        { "metric", "mean", "95% CI", "baseline median", "median", "change", "p", "verdict" });
+
+    std::vector<std::string> regressions;
+    for (const auto& metric : metrics) {
+        const double mean = sampleMean(metric.second.samples);
+        const double half_width = confidenceHalfWidth(metric.second.samples);
+        std::vector<std::string> row = { metric.first, ReportTable::format("%.1f", mean),
+            ReportTable::format("%.1f", mean - half_width) + " .. " + ReportTable::format("%.1f", mean + half_width) };
+        const auto recorded = baseline.find(metric.first);
+        if (recorded == baseline.end() || recorded->second.samples.empty()) {
+            row.push_back("n/a");
+        } else {
+            const TrialComparison comparison = compareTrials(recorded->second, metric.second);
+            row.push_back(ReportTable::format("%.1f", comparison.baseline_median));
+            row.push_back(ReportTable::format("%.1f", comparison.median));
+            row.push_back(ReportTable::format("%+.1f%%", comparison.change * 100));
+            row.push_back(ReportTable::format("%.4f", comparison.p_value));
+            row.push_back(comparison.regression ? "REGRESSION" : comparison.improvement ? "improvement" : "same");
+            if (comparison.regression)
+                regressions.push_back(metric.first);
+        }
+        report.addRow(row);
+    }
+    report.print();
+
+    for (const std::string& name : regressions)
+        ADD_FAILURE() << name << " has regressed against " << baseline_path;
+}
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/uio.h>
+
+#include <sqlite3.h>
+
+#include "csv_import.h"
+
+// CSV follows RFC 4180 with CRLF line endings, BLOBs are written as they are. BINARY starts with the column count as
+// uint32_t followed by rows of (type byte, value) pairs: nothing for NULL, int64_t, double, or uint32_t size and bytes
+// for TEXT and BLOB. Numbers are in host byte order.
+enum class ExportFormat { CSV, BINARY };
+
+// Steps a prepared statement and writes its rows into a file descriptor. Rows are collected in a caller provided buffer
+// which is written out with writev(). Values come straight from sqlite3_column_text()/sqlite3_column_blob() and
+// sqlite3_column_bytes(), large ones are not even copied: they are handed to writev() before the next step.
+// The exporter allocates nothing.
+class ResultExporter final {
+public:
+    ResultExporter(int fd, ExportFormat format, char* buffer, size_t buffer_size)
+        : fd(fd)
+        , format(format)
+        , buffer(buffer)
+        , buffer_size(buffer_size)
+        , scan(csv::scanFunction(CsvScanner::BEST))
+    {
+    }
+
+    // Returns SQLITE_OK once the statement is exhausted and stores the number of written rows into *rows. On failure
+    // the output ends with the last complete row. SQLITE_IOERR means that writev() has failed, SQLITE_TOOBIG that a row
+    // does not fit into the buffer, values which are referenced in place do not count.
+    int exportRows(sqlite3_stmt* statement, uint64_t* rows)
+    {
+        used = 0;
+        row_start = 0;
+        external_count = 0;
+        pending_rows = 0;
+        rows_written = 0;
+        status = SQLITE_OK;
+
+        const int column_count = sqlite3_column_count(statement);
+        if (format == ExportFormat::BINARY) {
+            const uint32_t count = static_cast<uint32_t>(column_count);
+            append(&count, sizeof(count));
+            row_start = used;
+        }
+
+        int step_status = SQLITE_OK;
+        while (status == SQLITE_OK && (step_status = sqlite3_step(statement)) == SQLITE_ROW) {
+            for (int i = 0; i < column_count && status == SQLITE_OK; ++i) {
+                if (format == ExportFormat::CSV && i)
+                    append(",", 1);
+                appendColumn(statement, i);
+            }
+            if (format == ExportFormat::CSV)
+                append("\r\n", 2);
+            if (status != SQLITE_OK)
+                break;
+            row_start = used;
+            ++pending_rows;
+            // Values referenced in place are only valid until the next step
+            if (external_count)
+                flush();
+        }
+
+        // An incomplete row is dropped together with its values referenced in place, the rows before it still go out
+        used = row_start;
+        external_count = 0;
+        flush();
+        *rows = rows_written;
+
+        if (status != SQLITE_OK)
+            return status;
+        return step_status == SQLITE_DONE ? SQLITE_OK : step_status;
+    }
+
+    uint64_t bytesWritten() const { return bytes_written; }
+
+private:
+    static constexpr int MAX_EXTERNALS = 16;
+
+    // A value which is written from SQLite memory in between buffer[0, position) and the rest of the buffer
+    struct External {
+        size_t position;
+        const char* data;
+        size_t size;
+    };
+
+    void appendColumn(sqlite3_stmt* statement, int column)
+    {
+        const int type = sqlite3_column_type(statement, column);
+        if (format == ExportFormat::BINARY) {
+            const uint8_t type_byte = static_cast<uint8_t>(type);
+            append(&type_byte, 1);
+        }
+
+        switch (type) {
+        case SQLITE_NULL:
+            break;
+        case SQLITE_INTEGER: {
+            const int64_t value = sqlite3_column_int64(statement, column);
+            if (format == ExportFormat::BINARY)
+                append(&value, sizeof(value));
+            else
+                appendInteger(value);
+            break;
+        }
+        case SQLITE_FLOAT: {
+            const double value = sqlite3_column_double(statement, column);
+            if (format == ExportFormat::BINARY) {
+                append(&value, sizeof(value));
+            } else {
+                char text[32];
+                append(text, static_cast<size_t>(snprintf(text, sizeof(text), "%.17g", value)));
+            }
+            break;
+        }
+        default: {
+            // The pointer has to be taken before the size, otherwise the size may be the one of another representation
+            const void* data = type == SQLITE_TEXT ? static_cast<const void*>(sqlite3_column_text(statement, column)) : sqlite3_column_blob(statement, column);
+            const char* value = static_cast<const char*>(data);
+            const uint32_t size = static_cast<uint32_t>(sqlite3_column_bytes(statement, column));
+            if (!value && size) {
+                status = SQLITE_NOMEM;
+                break;
+            }
+            if (format == ExportFormat::BINARY) {
+                append(&size, sizeof(size));
+                appendValue(value, size);
+            } else if (scan(const_cast<char*>(value), value + size, ',') == value + size) {
+                appendValue(value, size);
+            } else {
+                appendQuoted(value, size);
+            }
+            break;
+        }
+        }
+    }
+
+    void appendInteger(int64_t value)
+    {
+        char text[24];
+        char* const end = text + sizeof(text);
+        char* begin = end;
+        uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+        do {
+            *--begin = static_cast<char>('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude);
+        if (value < 0)
+            *--begin = '-';
+        append(begin, end - begin);
+    }
+
+    void appendQuoted(const char* value, size_t size)
+    {
+        const char* const end = value + size;
+        append("\"", 1);
+        while (const char* quote = static_cast<const char*>(memchr(value, '"', end - value))) {
+            append(value, quote + 1 - value);
+            append("\"", 1);
+            value = quote + 1;
+        }
+        append(value, end - value);
+        append("\"", 1);
+    }
+
+    void appendValue(const char* value, size_t size)
+    {
+        if (size < buffer_size / 4 || external_count == MAX_EXTERNALS) {
+            append(value, size);
+            return;
+        }
+        externals[external_count++] = { used, value, size };
+    }
+
+    void append(const void* data, size_t size)
+    {
+        if (status != SQLITE_OK)
+            return;
+        if (buffer_size - used < size && !makeRoom(size))
+            return;
+        memcpy(buffer + used, data, size);
+        used += size;
+    }
+
+    // Writes out complete rows and moves the current one to the beginning of the buffer
+    bool makeRoom(size_t size)
+    {
+        if (row_start) {
+            iovec chunk = { buffer, row_start };
+            if (!writeAll(&chunk, 1))
+                return false;
+            rows_written += pending_rows;
+            pending_rows = 0;
+            memmove(buffer, buffer + row_start, used - row_start);
+            for (int i = 0; i < external_count; ++i)
+                externals[i].position -= row_start;
+            used -= row_start;
+            row_start = 0;
+        }
+        if (buffer_size - used < size) {
+            status = SQLITE_TOOBIG;
+            return false;
+        }
+        return true;
+    }
+
+    void flush()
+    {
+        if (status == SQLITE_IOERR)
+            return;
+        iovec chunks[MAX_EXTERNALS * 2 + 1];
+        int count = 0;
+        size_t position = 0;
+        for (int i = 0; i < external_count; ++i) {
+            if (externals[i].position != position)
+                chunks[count++] = { buffer + position, externals[i].position - position };
+            chunks[count++] = { const_cast<char*>(externals[i].data), externals[i].size };
+            position = externals[i].position;
+        }
+        if (used != position)
+            chunks[count++] = { buffer + position, used - position };
+
+        if (writeAll(chunks, count))
+            rows_written += pending_rows;
+        used = row_start = 0;
+        external_count = 0;
+        pending_rows = 0;
+    }
+
+    bool writeAll(iovec* chunks, int count)
+    {
+        while (count) {
+            ssize_t written = writev(fd, chunks, count);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                status = SQLITE_IOERR;
+                return false;
+            }
+            bytes_written += written;
+            for (; count && static_cast<size_t>(written) >= chunks->iov_len; ++chunks, --count)
+                written -= chunks->iov_len;
+            if (count) {
+                chunks->iov_base = static_cast<char*>(chunks->iov_base) + written;
+                chunks->iov_len -= written;
+            }
+        }
+        return true;
+    }
+
+    const int fd;
+    const ExportFormat format;
+    char* const buffer;
+    const size_t buffer_size;
+    const csv::ScanFunction scan;
+
+    size_t used = 0;
+    size_t row_start = 0; // Everything before it belongs to complete rows
+    External externals[MAX_EXTERNALS];
+    int external_count = 0;
+    uint64_t pending_rows = 0; // Complete rows which are still in the buffer
+    uint64_t rows_written = 0;
+    uint64_t bytes_written = 0;
+    int status = SQLITE_OK;
+};
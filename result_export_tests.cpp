@@ -0,0 +1,201 @@
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+
+#include "benchmark.h"
+#include "overthrower.h"
+#include "result_export.h"
+#include "test_helpers.h"
+
+#define EXPORT_FILE_NAME "export_out"
+#define EXPORT_DB_FILE_NAME "export_db"
+#define EXPORT_SQL "SELECT a, b, c, b * 0.5, b || c FROM test_table"
+
+// Every third value of c needs quoting, every fifth one has quotes to escape and every hundredth one is large enough
+// to be written from SQLite memory.
+#define FILL_TEST_TABLE_SQL(ROWS)                                                                                                                              \
+    "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < " #ROWS ") INSERT INTO test_table(b, c) SELECT i, CASE "                        \
+    "WHEN i % 100 = 0 THEN replace(hex(zeroblob(2000)), '00', 'x') WHEN i % 5 = 0 THEN 'say \"' || i || '\", twice' WHEN i % 3 = 0 THEN 'comma, ' || i "     \
+    "ELSE 'AAAAAAAAAAAAAAAA' END FROM n"
+
+namespace {
+
+std::string readFile(const char* path)
+{
+    std::string result(static_cast<size_t>(fileSize(path)), '\0');
+    FILE* file = fopen(path, "rb");
+    if (file) {
+        result.resize(fread(&result[0], 1, result.size(), file));
+        fclose(file);
+    }
+    return result;
+}
+
+// Exports the rows of the statement into EXPORT_FILE_NAME.
+int exportToFile(sqlite3_stmt* statement, ExportFormat format, std::vector<char>& buffer, uint64_t* rows)
+{
+    const int fd = open(EXPORT_FILE_NAME, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return SQLITE_CANTOPEN;
+    ResultExporter exporter(fd, format, buffer.data(), buffer.size());
+    const int status = exporter.exportRows(statement, rows);
+    close(fd);
+    return status;
+}
+
+} // namespace
+
+TEST(SQLite3, ResultExport)
+{
+    static constexpr int rows_to_export = 300;
+
+    std::vector<char> buffer(4096); // Fits a few dozen rows, large values are referenced in place
+
+    sqlite3* handle = nullptr;
+    ASSERT_EQ(sqlite3_open(":memory:", &handle), SQLITE_OK);
+    ASSERT_EQ(sqlite3_exec(handle, "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)", nullptr, nullptr, nullptr), SQLITE_OK);
+    ASSERT_EQ(sqlite3_exec(handle, FILL_TEST_TABLE_SQL(300), nullptr, nullptr, nullptr), SQLITE_OK);
+
+    for (ExportFormat format : { ExportFormat::CSV, ExportFormat::BINARY }) {
+        const size_t header_size = format == ExportFormat::BINARY ? sizeof(uint32_t) : 0;
+
+        // Rows exported one at a time tell where every row of the complete output ends
+        std::string expected = std::string(header_size, '\0');
+        std::vector<size_t> row_ends(1, header_size);
+        {
+            sqlite3_stmt* statement = nullptr;
+            ASSERT_EQ(sqlite3_prepare_v2(handle, EXPORT_SQL " WHERE a = ?", -1, &statement, nullptr), SQLITE_OK);
+            for (int row = 1; row <= rows_to_export; ++row) {
+                uint64_t rows = 0;
+                ASSERT_EQ(sqlite3_bind_int(statement, 1, row), SQLITE_OK);
+                ASSERT_EQ(exportToFile(statement, format, buffer, &rows), SQLITE_OK);
+                ASSERT_EQ(rows, 1u);
+                ASSERT_EQ(sqlite3_reset(statement), SQLITE_OK);
+                const std::string output = readFile(EXPORT_FILE_NAME);
+                if (header_size)
+                    expected.replace(0, header_size, output, 0, header_size);
+                expected.append(output, header_size, std::string::npos);
+                row_ends.push_back(expected.size());
+            }
+            ASSERT_EQ(sqlite3_finalize(statement), SQLITE_OK);
+        }
+        if (format == ExportFormat::CSV)
+            ASSERT_NE(expected.find(",\"say \"\"5\"\", twice\",2.5,\"5say \"\"5\"\", twice\"\r\n"), std::string::npos);
+
+        int status;
+
+        auto tryExport = [&](DefaultOverthrower& overthrower) {
+            overthrower.activate();
+            sqlite3_stmt* statement = nullptr;
+            uint64_t rows = 0;
+            status = sqlite3_prepare_v2(handle, EXPORT_SQL " ORDER BY a", -1, &statement, nullptr);
+            if (status == SQLITE_OK)
+                status = exportToFile(statement, format, buffer, &rows);
+            sqlite3_finalize(statement);
+
+            OverthrowerPauser pauser;
+            if (status == SQLITE_OK)
+                ASSERT_EQ(rows, rows_to_export);
+            else
+                OOM_SAFE_ASSERT_EQ(status, SQLITE_NOMEM);
+            // Whatever has been written is a sequence of complete rows
+            if (statement) {
+                const std::string output = readFile(EXPORT_FILE_NAME);
+                ASSERT_EQ(output.size(), row_ends[rows]);
+                ASSERT_EQ(output, expected.substr(0, output.size()));
+            }
+        };
+
+        runOomSweeps("SQLite3.ResultExport", status, tryExport);
+    }
+
+    ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    ASSERT_EQ(unlink(EXPORT_FILE_NAME), 0);
+}
+
+TEST(Benchmark, ResultExport)
+{
+    static constexpr int rows_to_export = 10000000;
+
+    if (!access(EXPORT_DB_FILE_NAME, F_OK))
+        ASSERT_EQ(unlink(EXPORT_DB_FILE_NAME), 0);
+
+    // Every sqlite3_column_*() call takes the connection mutex otherwise, which costs more than formatting the value
+    sqlite3* handle = nullptr;
+    ASSERT_EQ(sqlite3_open_v2(EXPORT_DB_FILE_NAME, &handle, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, nullptr), SQLITE_OK);
+    ASSERT_EQ(sqlite3_exec(handle, "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)", nullptr, nullptr, nullptr), SQLITE_OK);
+    ASSERT_EQ(sqlite3_exec(handle, FILL_TEST_TABLE_SQL(10000000), nullptr, nullptr, nullptr), SQLITE_OK);
+
+    ReportTable report("Dump of " + std::to_string(rows_to_export) + " rows", { "method", "seconds", "over step", "rows/s", "MB", "MB/s" });
+
+    sqlite3_stmt* statement = nullptr;
+    ASSERT_EQ(sqlite3_prepare_v2(handle, "SELECT a, b, c FROM test_table", -1, &statement, nullptr), SQLITE_OK);
+
+    // Stepping alone tells how much of the time is spent on formatting and writing
+    double step_elapsed;
+    {
+        const Stopwatch stopwatch;
+        while (sqlite3_step(statement) == SQLITE_ROW)
+            sqlite3_column_text(statement, 2);
+        step_elapsed = stopwatch.seconds();
+        ASSERT_EQ(sqlite3_reset(statement), SQLITE_OK);
+    }
+
+    auto addRow = [&report, step_elapsed](const char* method, double elapsed) {
+        const double megabytes = fileSize(EXPORT_FILE_NAME) / 1048576.0;
+        report.addRow({ method, ReportTable::format("%.3f", elapsed), ReportTable::format("%.3f", elapsed - step_elapsed),
+            ReportTable::format("%.0f", rows_to_export / elapsed),
+            ReportTable::format("%.1f", megabytes), ReportTable::format("%.1f", megabytes / elapsed) });
+    };
+
+    {
+        // Every value is copied into a std::string which is then handed to stdio
+        FILE* file = fopen(EXPORT_FILE_NAME, "wb");
+        ASSERT_NE(file, nullptr);
+        std::string line;
+        int rows = 0;
+        const Stopwatch stopwatch;
+        while (sqlite3_step(statement) == SQLITE_ROW) {
+            line.clear();
+            for (int i = 0; i < 3; ++i) {
+                if (i)
+                    line += ',';
+                line += reinterpret_cast<const char*>(sqlite3_column_text(statement, i));
+            }
+            line += "\r\n";
+            fwrite(line.data(), 1, line.size(), file);
+            ++rows;
+        }
+        ASSERT_EQ(fclose(file), 0);
+        addRow("std::string + fwrite", stopwatch.seconds());
+        ASSERT_EQ(rows, rows_to_export);
+        ASSERT_EQ(sqlite3_reset(statement), SQLITE_OK);
+    }
+
+    std::vector<char> buffer(64 << 10);
+    static const struct {
+        const char* name;
+        ExportFormat format;
+    } methods[] = { { "ResultExporter CSV", ExportFormat::CSV }, { "ResultExporter binary", ExportFormat::BINARY } };
+
+    for (const auto& method : methods) {
+        ASSERT_EQ(unlink(EXPORT_FILE_NAME), 0); // Truncation of the previous dump is not what is being measured
+        uint64_t rows = 0;
+        const Stopwatch stopwatch;
+        ASSERT_EQ(exportToFile(statement, method.format, buffer, &rows), SQLITE_OK);
+        addRow(method.name, stopwatch.seconds());
+        ASSERT_EQ(rows, rows_to_export);
+        ASSERT_EQ(sqlite3_reset(statement), SQLITE_OK);
+    }
+
+    ASSERT_EQ(sqlite3_finalize(statement), SQLITE_OK);
+    ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    ASSERT_EQ(unlink(EXPORT_FILE_NAME), 0);
+    ASSERT_EQ(unlink(EXPORT_DB_FILE_NAME), 0);
+    report.print();
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <climits>
+
+#include <sqlite3.h>
+
+#include "overthrower.h"
+#include "watchdog.h"
+
+// Retry loops for calls which may fail because of an injected allocation failure. What used to be a lambda taking
+// std::function<int()> per kind of call is a class template here: the operation is a template parameter of the call
+// operator, so nothing is allocated per call and the harness does not shift the allocation sequence under test, and
+// the behaviour is put together from policies:
+//
+//   Retry<LinearPause> retry(status);                                   // Until SQLITE_OK, as SQLite3.Resistance
+//   Retry<ExponentialPause, ExpectStatus<SQLITE_DONE>> retry_step(status);
+//   Retry<LinearPause, ExpectStatus<SQLITE_DONE>, SingleShot> step_once(status);
+//
+// Attempt i runs with overthrower paused for Pause::duration(i) allocations, the first attempt is never paused so
+// that it can fail. Pauser is the pause itself, ThreadInjectorPauser retries under the injector of thread_injector.h.
+// A loop aborts the process once it is over the budget of watchdog.h, and adds its attempts to the retry-count
+// distribution of the thread.
+
+// Pause policies
+
+// i allocations for attempt i
+struct LinearPause {
+    unsigned int duration(unsigned int attempt) const { return attempt; }
+    void succeeded(unsigned int) {}
+};
+
+// 1, 2, 4, ... allocations: reaches a long critical section in a few attempts
+struct ExponentialPause {
+    unsigned int duration(unsigned int attempt) const { return attempt == 0 ? 0 : attempt > 32 ? UINT_MAX : 1u << (attempt - 1); }
+    void succeeded(unsigned int) {}
+};
+
+// Linear, but retries start at half the pause the previous call of the same retrier needed, a loop over similar calls
+// does not walk up from 1 every time.
+class AdaptivePause {
+public:
+    unsigned int duration(unsigned int attempt) const { return attempt == 0 ? 0 : hint + attempt; }
+    void succeeded(unsigned int attempt) { hint = duration(attempt) / 2; }
+
+private:
+    unsigned int hint = 0;
+};
+
+// Expected status
+
+template <int Status>
+struct ExpectStatus {
+    static constexpr int value = Status;
+};
+
+// Attempt policies
+
+// Until the expected status
+struct UntilExpected {
+    static constexpr bool single_shot = false;
+};
+
+// One attempt, never paused: the caller deals with the failure, e.g. by rolling back a transaction
+struct SingleShot {
+    static constexpr bool single_shot = true;
+};
+
+// A policy for the attempt which has failed, called outside of the pause before the next attempt
+struct NoRecovery {
+    void operator()(int) const {}
+};
+
+template <typename Pause = LinearPause, typename Expect = ExpectStatus<SQLITE_OK>, typename Attempts = UntilExpected, typename Pauser = OverthrowerPauser>
+class Retry final {
+public:
+    // The status of the last attempt goes to status, several retriers may share it
+    explicit Retry(int& status)
+        : status(status)
+    {
+    }
+
+    Retry(const Retry&) = delete;
+    Retry& operator=(const Retry&) = delete;
+
+    // Returns whether the last attempt has returned the expected status, always true unless single shot
+    template <typename Operation>
+    bool operator()(Operation operation)
+    {
+        return (*this)(operation, NoRecovery());
+    }
+
+    template <typename Operation, typename Recovery>
+    bool operator()(Operation operation, Recovery recovery)
+    {
+        if (Attempts::single_shot) {
+            status = operation();
+            return status == Expect::value;
+        }
+        RetryWatch watch;
+        unsigned int attempt = 0;
+        for (;; ++attempt) {
+            {
+                Pauser pauser(pause.duration(attempt));
+                status = operation();
+            }
+            if (status == Expect::value)
+                break;
+            watch.failed(attempt, status, pause.duration(attempt + 1));
+            recovery(status);
+        }
+        pause.succeeded(attempt);
+        watch.succeeded(attempt + 1);
+        return true;
+    }
+
+    const Pause& schedule() const { return pause; }
+
+private:
+    int& status;
+    Pause pause;
+};
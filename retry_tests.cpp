@@ -0,0 +1,224 @@
+#include <functional>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+
+#include "benchmark.h"
+#include "overthrower.h"
+#include "retry.h"
+#include "watchdog.h"
+
+namespace {
+
+// Fails with SQLITE_NOMEM the given number of times, then returns the given status. Allocates nothing.
+struct FailingOperation {
+    FailingOperation(int failures, int status)
+        : failures(failures)
+        , status(status)
+    {
+    }
+
+    const int failures;
+    const int status;
+    int calls = 0;
+
+    int operator()()
+    {
+        ++calls;
+        return calls <= failures ? SQLITE_NOMEM : status;
+    }
+};
+
+// Inserts rows into an in-memory database with one allocation out of duty_cycle failing, the number of attempts its
+// retry loops have needed goes to histogram
+template <typename Pause>
+void insertUnderFailures(unsigned int duty_cycle, int rows_to_insert, RetryHistogram* histogram)
+{
+    watchdogContext().histogram.clear();
+    int status;
+    Retry<Pause> retry(status);
+    Retry<Pause, ExpectStatus<SQLITE_DONE>> retry_done(status);
+    sqlite3* handle = nullptr;
+    sqlite3_stmt* statement = nullptr;
+    {
+        WatchdogIteration iteration("Benchmark.RetryDistribution", duty_cycle);
+        OverthrowerStrategyRandom overthrower(duty_cycle);
+        overthrower.activate();
+        retry([&handle]() { return sqlite3_open(":memory:", &handle); },
+            [&handle](int) {
+                sqlite3_close(handle);
+                handle = nullptr;
+            });
+        watchdogNote("CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)");
+        retry([&handle]() { return sqlite3_exec(handle, "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)", nullptr, nullptr, nullptr); });
+        watchdogNote("INSERT INTO test_table(b, c) VALUES (?, ?)");
+        retry([&handle, &statement]() { return sqlite3_prepare_v2(handle, "INSERT INTO test_table(b, c) VALUES (?, ?)", -1, &statement, nullptr); });
+        for (int i = 0; i < rows_to_insert; ++i) {
+            retry([&statement]() { return sqlite3_reset(statement); });
+            retry([&statement, i]() { return sqlite3_bind_int(statement, 1, i); });
+            retry([&statement]() { return sqlite3_bind_text(statement, 2, "AAAAAAAAAAAAAAAA", -1, nullptr); });
+            retry_done([&statement]() { return sqlite3_step(statement); });
+        }
+        retry([&statement]() { return sqlite3_finalize(statement); });
+        OOM_SAFE_ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    }
+    *histogram = watchdogContext().histogram;
+}
+
+} // namespace
+
+TEST(Retry, PauseSchedules)
+{
+    const LinearPause linear;
+    const ExponentialPause exponential;
+    for (unsigned int attempt : { 0u, 1u, 2u, 3u, 10u })
+        EXPECT_EQ(linear.duration(attempt), attempt);
+    EXPECT_EQ(exponential.duration(0), 0u);
+    EXPECT_EQ(exponential.duration(1), 1u);
+    EXPECT_EQ(exponential.duration(4), 8u);
+    EXPECT_EQ(exponential.duration(33), UINT_MAX);
+
+    // Needed a pause of 10 allocations, the next call starts its retries at 5
+    AdaptivePause adaptive;
+    EXPECT_EQ(adaptive.duration(1), 1u);
+    adaptive.succeeded(10);
+    EXPECT_EQ(adaptive.duration(0), 0u);
+    EXPECT_EQ(adaptive.duration(1), 6u);
+}
+
+TEST(Retry, Policies)
+{
+    int status = SQLITE_ERROR;
+
+    Retry<> retry(status);
+    FailingOperation operation(3, SQLITE_OK);
+    int recoveries = 0;
+    EXPECT_TRUE(retry(std::ref(operation), [&recoveries](int failed_status) {
+        EXPECT_EQ(failed_status, SQLITE_NOMEM);
+        ++recoveries;
+    }));
+    EXPECT_EQ(operation.calls, 4);
+    EXPECT_EQ(recoveries, 3);
+    EXPECT_EQ(status, SQLITE_OK);
+
+    Retry<AdaptivePause, ExpectStatus<SQLITE_DONE>> retry_done(status);
+    FailingOperation step(2, SQLITE_DONE);
+    EXPECT_TRUE(retry_done(std::ref(step)));
+    EXPECT_EQ(step.calls, 3);
+    EXPECT_EQ(status, SQLITE_DONE);
+    EXPECT_EQ(retry_done.schedule().duration(1), 2u);
+
+    Retry<ExponentialPause, ExpectStatus<SQLITE_OK>, SingleShot> retry_once(status);
+    FailingOperation once(1, SQLITE_OK);
+    EXPECT_FALSE(retry_once(std::ref(once)));
+    EXPECT_EQ(once.calls, 1);
+    EXPECT_EQ(status, SQLITE_NOMEM);
+    EXPECT_TRUE(retry_once(std::ref(once)));
+}
+
+// With every allocation failing a retry loop around a call which does not allocate has to go through untouched, and
+// real SQLite calls have to get through once the pauses of their retries let them allocate.
+TEST(Retry, NoAllocation)
+{
+    int status = SQLITE_ERROR;
+    FailingOperation operation(100, SQLITE_OK);
+
+    OverthrowerStrategyStep overthrower(0);
+    overthrower.activate();
+
+    Retry<> retry(status);
+    retry(std::ref(operation));
+    OOM_SAFE_ASSERT_EQ(operation.calls, 101);
+
+    sqlite3* handle = nullptr;
+    Retry<ExponentialPause> retry_sql(status);
+    retry_sql([&handle]() { return sqlite3_open(":memory:", &handle); },
+        [&handle](int) {
+            sqlite3_close(handle);
+            handle = nullptr;
+        });
+    retry_sql([&handle]() { return sqlite3_exec(handle, "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)", nullptr, nullptr, nullptr); });
+    OOM_SAFE_ASSERT_EQ(status, SQLITE_OK);
+    OOM_SAFE_ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+}
+
+TEST(Retry, Distribution)
+{
+    int status = SQLITE_ERROR;
+    RetryHistogram& histogram = watchdogContext().histogram;
+    histogram.clear();
+
+    Retry<> retry(status);
+    for (int failures : { 0, 0, 0, 1, 3, 99 }) {
+        FailingOperation operation(failures, SQLITE_OK);
+        retry(std::ref(operation));
+    }
+    EXPECT_EQ(histogram.calls(), 6u);
+    EXPECT_DOUBLE_EQ(histogram.mean(), (1 + 1 + 1 + 2 + 4 + 100) / 6.0);
+    EXPECT_EQ(histogram.percentile(0.5), 2u);
+    EXPECT_EQ(histogram.percentile(0.8), 4u);
+    EXPECT_EQ(histogram.percentile(1.0), 100u);
+    EXPECT_EQ(histogram.max(), 100u);
+
+    // A single shot is no loop
+    Retry<LinearPause, ExpectStatus<SQLITE_OK>, SingleShot> retry_once(status);
+    FailingOperation once(1, SQLITE_OK);
+    retry_once(std::ref(once));
+    EXPECT_EQ(histogram.calls(), 6u);
+    histogram.clear();
+}
+
+// A retry loop which never gets through and an iteration which never ends abort with what they were doing
+TEST(Retry, Watchdog)
+{
+    testing::FLAGS_gtest_death_test_style = "threadsafe";
+
+    EXPECT_DEATH(
+        {
+            watchdogLimits().retry_attempts = 5;
+            int status;
+            Retry<> retry(status);
+            Retry<> inner(status);
+            FailingOperation operation(100, SQLITE_OK);
+            FailingOperation inner_operation(100, SQLITE_OK);
+            retry(std::ref(operation), [&inner, &inner_operation](int) { inner(std::ref(inner_operation)); });
+        },
+        "retry loop over its budget of attempts(.|\n)*attempt 1, pause 1, status 7\\] \\[attempt 5, pause 5, status 7");
+
+    EXPECT_DEATH(
+        {
+            watchdogLimits().iteration_seconds = 0.2;
+            WatchdogIteration iteration("Retry.Watchdog", 7);
+            watchdogNote("SELECT 42");
+            std::this_thread::sleep_for(std::chrono::seconds(5));
+        },
+        "iteration over its budget of seconds(.|\n)*Retry.Watchdog #7(.|\n)*last SQL: SELECT 42");
+}
+
+// How many attempts the retry loops of an insert need, by the share of failing allocations and the pause policy
+TEST(Benchmark, RetryDistribution)
+{
+    static constexpr int rows_to_insert = 10000;
+
+    ReportTable report(std::to_string(rows_to_insert) + " rows inserted with every call retried, attempts per call",
+        { "failing", "pause", "calls", "mean", "p50", "p90", "p99", "p99.9", "max" });
+    auto addRow = [&report](unsigned int duty_cycle, const char* pause, const RetryHistogram& histogram) {
+        report.addRow({ "1/" + std::to_string(duty_cycle), pause, std::to_string(histogram.calls()), ReportTable::format("%.3f", histogram.mean()),
+            std::to_string(histogram.percentile(0.5)), std::to_string(histogram.percentile(0.9)), std::to_string(histogram.percentile(0.99)),
+            std::to_string(histogram.percentile(0.999)), std::to_string(histogram.max()) });
+    };
+    for (unsigned int duty_cycle : { 4u, 8u, 32u, 128u }) {
+        RetryHistogram histogram;
+        insertUnderFailures<LinearPause>(duty_cycle, rows_to_insert, &histogram);
+        addRow(duty_cycle, "linear", histogram);
+        insertUnderFailures<ExponentialPause>(duty_cycle, rows_to_insert, &histogram);
+        addRow(duty_cycle, "exponential", histogram);
+        insertUnderFailures<AdaptivePause>(duty_cycle, rows_to_insert, &histogram);
+        addRow(duty_cycle, "adaptive", histogram);
+    }
+    watchdogContext().histogram.clear();
+    report.print();
+}
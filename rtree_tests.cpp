@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+
+#include "benchmark.h"
+#include "overthrower.h"
+#include "test_helpers.h"
+
+namespace {
+
+struct Box {
+    int64_t id;
+    int min_x, max_x, min_y, max_y;
+};
+
+// Small boxes scattered over a `space` x `space` square. Integer coordinates survive the 32-bit floats of R*Tree.
+std::vector<Box> makeBoxes(int count, int space)
+{
+    std::vector<Box> boxes(count);
+    uint32_t state = 1;
+    auto next = [&state]() {
+        state = state * 1103515245 + 12345;
+        return state >> 8;
+    };
+    for (int i = 0; i < count; ++i) {
+        boxes[i].id = i + 1;
+        boxes[i].min_x = static_cast<int>(next() % space);
+        boxes[i].max_x = boxes[i].min_x + 1 + static_cast<int>(next() % 10);
+        boxes[i].min_y = static_cast<int>(next() % space);
+        boxes[i].max_y = boxes[i].min_y + 1 + static_cast<int>(next() % 10);
+    }
+    return boxes;
+}
+
+int64_t countOverlapping(const std::vector<Box>& boxes, const Box& window, int skip_modulo)
+{
+    int64_t count = 0;
+    for (const Box& box : boxes) {
+        if (skip_modulo && box.id % skip_modulo == 0)
+            continue;
+        count += box.max_x >= window.min_x && box.min_x <= window.max_x && box.max_y >= window.min_y && box.min_y <= window.max_y;
+    }
+    return count;
+}
+
+int insertBoxes(sqlite3* handle, const std::vector<Box>& boxes)
+{
+    sqlite3_stmt* statement = nullptr;
+    int status = sqlite3_prepare_v2(handle, "INSERT INTO boxes VALUES (?, ?, ?, ?, ?)", -1, &statement, nullptr);
+    for (size_t i = 0; i < boxes.size() && status == SQLITE_OK; ++i) {
+        const Box& box = boxes[i];
+        sqlite3_bind_int64(statement, 1, box.id);
+        sqlite3_bind_int(statement, 2, box.min_x);
+        sqlite3_bind_int(statement, 3, box.max_x);
+        sqlite3_bind_int(statement, 4, box.min_y);
+        sqlite3_bind_int(statement, 5, box.max_y);
+        status = sqlite3_step(statement);
+        if (status == SQLITE_DONE)
+            status = sqlite3_reset(statement);
+    }
+    sqlite3_finalize(statement);
+    return status;
+}
+
+int countInWindow(sqlite3_stmt* statement, const Box& window, int64_t* count)
+{
+    sqlite3_bind_int(statement, 1, window.min_x);
+    sqlite3_bind_int(statement, 2, window.max_x);
+    sqlite3_bind_int(statement, 3, window.min_y);
+    sqlite3_bind_int(statement, 4, window.max_y);
+    int status = sqlite3_step(statement);
+    if (status == SQLITE_ROW) {
+        *count = sqlite3_column_int64(statement, 0);
+        status = SQLITE_OK;
+    }
+    const int reset_status = sqlite3_reset(statement);
+    return status == SQLITE_OK ? reset_status : status;
+}
+
+#define COUNT_IN_WINDOW "SELECT count(*) FROM boxes WHERE max_x >= ?1 AND min_x <= ?2 AND max_y >= ?3 AND min_y <= ?4"
+
+} // namespace
+
+TEST(SQLite3, Rtree)
+{
+    static constexpr int boxes_to_insert = 500;
+    static constexpr int space = 1000;
+    static constexpr int delete_modulo = 3;
+
+    const std::vector<Box> boxes = makeBoxes(boxes_to_insert, space);
+    const std::vector<Box> windows = { { 0, 0, space, 0, space }, { 0, 100, 300, 200, 400 }, { 0, 500, 510, 500, 510 }, { 0, -10, -1, -10, -1 } };
+
+    const std::string delete_sql = "DELETE FROM boxes WHERE id % " + std::to_string(delete_modulo) + " = 0";
+
+    int status;
+
+    auto tryRtree = [&](DefaultOverthrower& overthrower) {
+        overthrower.activate();
+        sqlite3* handle = nullptr;
+        removeDbIfExists(overthrower);
+        {
+            OverthrowerPauser pauser;
+            ASSERT_EQ(sqlite3_open(TEST_DB_FILE_NAME, &handle), SQLITE_OK);
+            // Nodes of 512 byte pages hold 18 boxes, so a few hundred inserts split nodes on every level
+            ASSERT_EQ(sqlite3_exec(handle, "PRAGMA page_size = 512; CREATE VIRTUAL TABLE boxes USING rtree(id, min_x, max_x, min_y, max_y)", nullptr,
+                          nullptr, nullptr),
+                SQLITE_OK)
+                << "SQLite has been built without R*Tree";
+        }
+
+        status = sqlite3_exec(handle, "BEGIN TRANSACTION", nullptr, nullptr, nullptr);
+        if (status == SQLITE_OK)
+            status = insertBoxes(handle, boxes);
+        if (status == SQLITE_OK)
+            status = sqlite3_exec(handle, "END TRANSACTION", nullptr, nullptr, nullptr);
+        // Removing entries condenses the tree and reinserts the orphaned ones
+        if (status == SQLITE_OK)
+            status = sqlite3_exec(handle, delete_sql.c_str(), nullptr, nullptr, nullptr);
+
+        sqlite3_stmt* statement = nullptr;
+        if (status == SQLITE_OK)
+            status = sqlite3_prepare_v2(handle, COUNT_IN_WINDOW, -1, &statement, nullptr);
+        for (const Box& window : windows) {
+            if (status != SQLITE_OK)
+                break;
+            int64_t count = -1;
+            status = countInWindow(statement, window, &count);
+            if (status == SQLITE_OK) {
+                OverthrowerPauser pauser;
+                ASSERT_EQ(count, countOverlapping(boxes, window, delete_modulo));
+            }
+        }
+        sqlite3_finalize(statement);
+
+        if (status != SQLITE_OK) {
+            OOM_SAFE_ASSERT_EQ(status, SQLITE_NOMEM);
+            OverthrowerPauser pauser;
+            sqlite3_exec(handle, "ROLLBACK", nullptr, nullptr, nullptr);
+        }
+        {
+            // Whatever has been committed, the tree has to be consistent
+            OverthrowerPauser pauser;
+            sqlite3_stmt* check = nullptr;
+            ASSERT_EQ(sqlite3_prepare_v2(handle, "SELECT rtreecheck('boxes')", -1, &check, nullptr), SQLITE_OK);
+            ASSERT_EQ(sqlite3_step(check), SQLITE_ROW);
+            ASSERT_STREQ(reinterpret_cast<const char*>(sqlite3_column_text(check, 0)), "ok");
+            ASSERT_EQ(sqlite3_finalize(check), SQLITE_OK);
+        }
+
+        ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    };
+
+    runOomSweeps("SQLite3.Rtree", status, tryRtree);
+}
+
+TEST(Benchmark, Rtree)
+{
+    static constexpr int boxes_to_insert = 1000000;
+    static constexpr int space = 1000000;
+    static constexpr int queries = 10000;
+    static constexpr const char* db_file_name = "rtree_db";
+
+    const std::vector<Box> random_boxes = makeBoxes(boxes_to_insert, space);
+    std::vector<Box> sorted_boxes = random_boxes;
+    std::sort(sorted_boxes.begin(), sorted_boxes.end(), [](const Box& a, const Box& b) { return a.min_x < b.min_x; });
+    const std::vector<Box> centres = makeBoxes(queries, space);
+
+    ReportTable report(std::to_string(boxes_to_insert) + " boxes bulk loaded into a file DB, " + std::to_string(queries) + " windows of 1000x1000",
+        { "order", "cache", "insert boxes/s", "DB MB", "query p50 us", "query p99 us", "boxes/query", "cache hit %", "misses/query" });
+
+    static const struct {
+        const char* name;
+        int cache_kb;
+    } caches[] = { { "2MB", 2000 }, { "64MB", 64000 } };
+
+    for (const auto& cache : caches) {
+        for (const std::vector<Box>* boxes : std::vector<const std::vector<Box>*>{ &random_boxes, &sorted_boxes }) {
+            unlink(db_file_name);
+            sqlite3* handle = nullptr;
+            ASSERT_EQ(sqlite3_open(db_file_name, &handle), SQLITE_OK);
+            ASSERT_EQ(sqlite3_exec(handle, ("PRAGMA cache_size = -" + std::to_string(cache.cache_kb)).c_str(), nullptr, nullptr, nullptr), SQLITE_OK);
+            ASSERT_EQ(sqlite3_exec(handle, "CREATE VIRTUAL TABLE boxes USING rtree(id, min_x, max_x, min_y, max_y)", nullptr, nullptr, nullptr),
+                SQLITE_OK);
+
+            std::vector<std::string> row = { boxes == &random_boxes ? "random" : "by min_x", cache.name };
+            {
+                const Stopwatch stopwatch;
+                ASSERT_EQ(sqlite3_exec(handle, "BEGIN TRANSACTION", nullptr, nullptr, nullptr), SQLITE_OK);
+                ASSERT_EQ(insertBoxes(handle, *boxes), SQLITE_OK);
+                ASSERT_EQ(sqlite3_exec(handle, "END TRANSACTION", nullptr, nullptr, nullptr), SQLITE_OK);
+                row.push_back(ReportTable::format("%.0f", boxes_to_insert / stopwatch.seconds()));
+            }
+            row.push_back(ReportTable::format("%.1f", static_cast<double>(fileSize(db_file_name)) / (1 << 20)));
+
+            int current = 0, highwater = 0;
+            sqlite3_db_status(handle, SQLITE_DBSTATUS_CACHE_HIT, &current, &highwater, 1);
+            sqlite3_db_status(handle, SQLITE_DBSTATUS_CACHE_MISS, &current, &highwater, 1);
+
+            sqlite3_stmt* statement = nullptr;
+            ASSERT_EQ(sqlite3_prepare_v2(handle, COUNT_IN_WINDOW, -1, &statement, nullptr), SQLITE_OK);
+            LatencyRecorder latencies;
+            latencies.reserve(queries);
+            int64_t found = 0;
+            for (const Box& centre : centres) {
+                int64_t count = 0;
+                const Stopwatch stopwatch;
+                ASSERT_EQ(countInWindow(statement, { 0, centre.min_x - 500, centre.min_x + 500, centre.min_y - 500, centre.min_y + 500 }, &count),
+                    SQLITE_OK);
+                latencies.add(stopwatch.elapsed());
+                found += count;
+            }
+            ASSERT_EQ(sqlite3_finalize(statement), SQLITE_OK);
+
+            int hits = 0, misses = 0;
+            sqlite3_db_status(handle, SQLITE_DBSTATUS_CACHE_HIT, &hits, &highwater, 0);
+            sqlite3_db_status(handle, SQLITE_DBSTATUS_CACHE_MISS, &misses, &highwater, 0);
+            row.push_back(ReportTable::format("%.1f", latencies.percentile(0.5)));
+            row.push_back(ReportTable::format("%.1f", latencies.percentile(0.99)));
+            row.push_back(ReportTable::format("%.1f", static_cast<double>(found) / queries));
+            row.push_back(ReportTable::format("%.1f", hits + misses ? 100.0 * hits / (hits + misses) : 0.0));
+            row.push_back(ReportTable::format("%.2f", static_cast<double>(misses) / queries));
+            report.addRow(row);
+
+            ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+        }
+    }
+
+    unlink(db_file_name);
+    report.print();
+}
@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+
+#include "benchmark.h"
+#include "overthrower.h"
+#include "test_helpers.h"
+
+namespace {
+
+// The schema of SQLite3.Resistance, its INTEGER PRIMARY KEY is what the session extension identifies rows by
+#define CREATE_TEST_TABLE "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c); CREATE INDEX test_idx ON test_table(a, b, c)"
+#define TEST_TABLE_CHECKSUM "SELECT count(*), sum(a), sum(b), sum(length(c)) FROM test_table"
+
+// The insert loop of SQLite3.Resistance in a single transaction, with a distinct b per row.
+int insertRows(sqlite3* handle, int rows)
+{
+    sqlite3_stmt* statement = nullptr;
+    int status = sqlite3_exec(handle, "BEGIN TRANSACTION", nullptr, nullptr, nullptr);
+    if (status == SQLITE_OK)
+        status = sqlite3_prepare_v2(handle, "INSERT INTO test_table(b, c) VALUES (?, ?)", -1, &statement, nullptr);
+    for (int row = 0; row < rows && status == SQLITE_OK; ++row) {
+        status = sqlite3_bind_int(statement, 1, row);
+        if (status == SQLITE_OK)
+            status = sqlite3_bind_text(statement, 2, "AAAAAAAAAAAAAAAA", -1, nullptr);
+        if (status == SQLITE_OK)
+            status = sqlite3_step(statement);
+        if (status == SQLITE_DONE)
+            status = sqlite3_reset(statement);
+    }
+    sqlite3_finalize(statement);
+    if (status == SQLITE_OK)
+        status = sqlite3_exec(handle, "END TRANSACTION", nullptr, nullptr, nullptr);
+    if (status != SQLITE_OK && !sqlite3_get_autocommit(handle)) {
+        OverthrowerPauser pauser;
+        sqlite3_exec(handle, "ROLLBACK TRANSACTION", nullptr, nullptr, nullptr);
+    }
+    return status;
+}
+
+// Every row of a changeset recorded from inserts into an empty table applies cleanly, anything else is a failure.
+int abortOnConflict(void*, int, sqlite3_changeset_iter*)
+{
+    return SQLITE_CHANGESET_ABORT;
+}
+
+// A changeset produced by sqlite3session_changeset_strm() and consumed by sqlite3changeset_apply_strm().
+struct ChangesetStream {
+    std::string data;
+    size_t read_position = 0;
+
+    static int output(void* context, const void* data, int size)
+    {
+        OverthrowerPauser pauser; // Stands for a socket or a file, only SQLite allocations are of interest
+        static_cast<ChangesetStream*>(context)->data.append(static_cast<const char*>(data), size);
+        return SQLITE_OK;
+    }
+
+    static int input(void* context, void* data, int* size)
+    {
+        ChangesetStream* stream = static_cast<ChangesetStream*>(context);
+        const size_t available = stream->data.size() - stream->read_position;
+        *size = static_cast<int>(std::min(available, static_cast<size_t>(*size)));
+        memcpy(data, stream->data.data() + stream->read_position, *size);
+        stream->read_position += *size;
+        return SQLITE_OK;
+    }
+};
+
+// Records the inserts into test_table and turns them into a changeset, either as a single buffer or streamed.
+int recordChangeset(sqlite3* handle, int rows, bool streamed, void** changeset, int* changeset_size, ChangesetStream* stream)
+{
+    sqlite3_session* session = nullptr;
+    int status = sqlite3session_create(handle, "main", &session);
+    if (status == SQLITE_OK)
+        status = sqlite3session_attach(session, "test_table");
+    if (status == SQLITE_OK)
+        status = insertRows(handle, rows);
+    if (status == SQLITE_OK && streamed)
+        status = sqlite3session_changeset_strm(session, ChangesetStream::output, stream);
+    else if (status == SQLITE_OK)
+        status = sqlite3session_changeset(session, changeset_size, changeset);
+    if (session) // Unlike most destructors of SQLite it does not accept NULL
+        sqlite3session_delete(session);
+    return status;
+}
+
+int applyChangeset(sqlite3* replica, bool streamed, void* changeset, int changeset_size, ChangesetStream* stream)
+{
+    if (streamed) {
+        stream->read_position = 0;
+        return sqlite3changeset_apply_strm(replica, ChangesetStream::input, stream, nullptr, abortOnConflict, nullptr);
+    }
+    return sqlite3changeset_apply(replica, changeset_size, changeset, nullptr, abortOnConflict, nullptr);
+}
+
+std::vector<int64_t> queryChecksum(sqlite3* handle)
+{
+    std::vector<int64_t> checksum;
+    sqlite3_stmt* statement = nullptr;
+    EXPECT_EQ(sqlite3_prepare_v2(handle, TEST_TABLE_CHECKSUM, -1, &statement, nullptr), SQLITE_OK);
+    EXPECT_EQ(sqlite3_step(statement), SQLITE_ROW);
+    for (int i = 0; i < sqlite3_column_count(statement); ++i)
+        checksum.push_back(sqlite3_column_int64(statement, i));
+    EXPECT_EQ(sqlite3_finalize(statement), SQLITE_OK);
+    return checksum;
+}
+
+} // namespace
+
+TEST(SQLite3, Session)
+{
+    static constexpr int rows_to_insert = 100;
+
+    int status;
+
+    for (bool streamed : { false, true }) {
+        auto tryChangeset = [&](DefaultOverthrower& overthrower) {
+            overthrower.activate();
+            sqlite3* handle = nullptr;
+            sqlite3* replica = nullptr;
+            void* changeset = nullptr;
+            int changeset_size = 0;
+            ChangesetStream stream;
+            removeDbIfExists(overthrower);
+            {
+                OverthrowerPauser pauser;
+                ASSERT_EQ(sqlite3_open(TEST_DB_FILE_NAME, &handle), SQLITE_OK);
+                ASSERT_EQ(sqlite3_open(":memory:", &replica), SQLITE_OK);
+                ASSERT_EQ(sqlite3_exec(handle, CREATE_TEST_TABLE, nullptr, nullptr, nullptr), SQLITE_OK);
+                ASSERT_EQ(sqlite3_exec(replica, CREATE_TEST_TABLE, nullptr, nullptr, nullptr), SQLITE_OK);
+            }
+
+            status = recordChangeset(handle, rows_to_insert, streamed, &changeset, &changeset_size, &stream);
+            if (status == SQLITE_OK)
+                status = applyChangeset(replica, streamed, changeset, changeset_size, &stream);
+            sqlite3_free(changeset);
+
+            // Both connections are closed before anything is asserted, an assertion returns from the lambda
+            OverthrowerPauser pauser;
+            // An apply is atomic: whether it fails or not, it must not leave the replica inside its savepoint
+            const bool autocommit = sqlite3_get_autocommit(replica) != 0;
+            const std::vector<int64_t> replicated = queryChecksum(replica);
+            const std::vector<int64_t> original = queryChecksum(handle);
+            EXPECT_EQ(sqlite3_close(replica), SQLITE_OK);
+            EXPECT_EQ(sqlite3_close(handle), SQLITE_OK);
+            ASSERT_TRUE(autocommit) << "the apply has left the replica inside a transaction, status " << status;
+            if (status == SQLITE_OK) {
+                ASSERT_EQ(replicated, original);
+            } else {
+                ASSERT_EQ(status, SQLITE_NOMEM);
+                ASSERT_EQ(replicated[0], 0);
+            }
+        };
+
+        runOomSweeps("SQLite3.Session", status, tryChangeset);
+    }
+}
+
+TEST(Benchmark, Session)
+{
+    static constexpr const char* db_file_name = "session_db";
+    static constexpr const char* replica_file_name = "session_replica";
+
+    ReportTable report("Resistance inserts recorded by a session and applied to a replica",
+        { "rows", "changeset", "insert s", "generate s", "changeset KB", "apply s", "apply rows/s", "generate peak KB", "apply peak KB" });
+
+    // Peak SQLite heap above what was in use when `start` was taken
+    auto peakKb = [](sqlite3_int64 start) { return ReportTable::format("%.0f", static_cast<double>(sqlite3_memory_highwater(1) - start) / 1024); };
+
+    for (int rows : { 100000, 1000000 }) {
+        for (int method = 0; method < 3; ++method) {
+            const bool recorded = method > 0;
+            const bool streamed = method == 2;
+            for (const char* name : { db_file_name, replica_file_name })
+                unlink(name);
+            sqlite3* handle = nullptr;
+            sqlite3* replica = nullptr;
+            ASSERT_EQ(sqlite3_open(db_file_name, &handle), SQLITE_OK);
+            ASSERT_EQ(sqlite3_open(replica_file_name, &replica), SQLITE_OK);
+            ASSERT_EQ(sqlite3_exec(handle, CREATE_TEST_TABLE, nullptr, nullptr, nullptr), SQLITE_OK);
+            ASSERT_EQ(sqlite3_exec(replica, CREATE_TEST_TABLE, nullptr, nullptr, nullptr), SQLITE_OK);
+
+            std::vector<std::string> row = { std::to_string(rows), !recorded ? "no session" : streamed ? "_strm" : "buffer" };
+            if (!recorded) {
+                const Stopwatch stopwatch;
+                ASSERT_EQ(insertRows(handle, rows), SQLITE_OK);
+                row.push_back(ReportTable::format("%.3f", stopwatch.seconds()));
+                row.insert(row.end(), 6, "-");
+                report.addRow(row);
+                ASSERT_EQ(sqlite3_close(replica), SQLITE_OK);
+                ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+                continue;
+            }
+
+            void* changeset = nullptr;
+            int changeset_size = 0;
+            ChangesetStream stream;
+            sqlite3_session* session = nullptr;
+            ASSERT_EQ(sqlite3session_create(handle, "main", &session), SQLITE_OK);
+            ASSERT_EQ(sqlite3session_attach(session, "test_table"), SQLITE_OK);
+            {
+                const Stopwatch stopwatch;
+                ASSERT_EQ(insertRows(handle, rows), SQLITE_OK);
+                row.push_back(ReportTable::format("%.3f", stopwatch.seconds()));
+            }
+            std::string generate_peak;
+            {
+                const sqlite3_int64 start = sqlite3_memory_used();
+                sqlite3_memory_highwater(1);
+                const Stopwatch stopwatch;
+                if (streamed)
+                    ASSERT_EQ(sqlite3session_changeset_strm(session, ChangesetStream::output, &stream), SQLITE_OK);
+                else
+                    ASSERT_EQ(sqlite3session_changeset(session, &changeset_size, &changeset), SQLITE_OK);
+                row.push_back(ReportTable::format("%.3f", stopwatch.seconds()));
+                generate_peak = peakKb(start);
+            }
+            sqlite3session_delete(session);
+            row.push_back(ReportTable::format("%.0f", static_cast<double>(streamed ? stream.data.size() : changeset_size) / 1024));
+            {
+                const sqlite3_int64 start = sqlite3_memory_used();
+                sqlite3_memory_highwater(1);
+                const Stopwatch stopwatch;
+                ASSERT_EQ(applyChangeset(replica, streamed, changeset, changeset_size, &stream), SQLITE_OK);
+                const double elapsed = stopwatch.seconds();
+                row.push_back(ReportTable::format("%.3f", elapsed));
+                row.push_back(ReportTable::format("%.0f", rows / elapsed));
+                row.push_back(generate_peak);
+                row.push_back(peakKb(start));
+            }
+            sqlite3_free(changeset);
+            ASSERT_EQ(queryChecksum(replica), queryChecksum(handle));
+            report.addRow(row);
+
+            ASSERT_EQ(sqlite3_close(replica), SQLITE_OK);
+            ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+        }
+    }
+
+    for (const char* name : { db_file_name, replica_file_name })
+        unlink(name);
+    report.print();
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <sys/time.h>
+
+// Statistical profiler of the calling process: ITIMER_PROF delivers SIGPROF every interval of consumed CPU time and the
+// handler stores the stack into memory allocated up front, so that it never calls malloc() which overthrower may fail.
+// Every sample carries the label of the attempt it has been taken in, see Attempt.
+//
+// backtrace() is not async-signal-safe on paper, it allocates on the first call only and the constructor makes that
+// call. Only one sampler can run at a time.
+class SigprofSampler final {
+public:
+    enum Label { HARNESS, NORMAL, RECOVERY, INJECTED_FAILURE, LABEL_COUNT };
+
+    static const char* labelName(Label label)
+    {
+        static const char* const names[LABEL_COUNT] = { "[harness]", "[normal]", "[recovery]", "[injected failure]" };
+        return names[label];
+    }
+
+    // Scope of one call that may fail and be retried. Samples are labelled [normal] for the first attempt and
+    // [recovery] for the retries. Once the call has failed, the samples of the attempt become [injected failure].
+    class Attempt final {
+    public:
+        Attempt(SigprofSampler& sampler, bool retry)
+            : sampler(sampler)
+            , first_sample(sampler.sample_count)
+        {
+            sampler.label = retry ? RECOVERY : NORMAL;
+        }
+
+        ~Attempt() { sampler.label = HARNESS; }
+
+        Attempt(const Attempt&) = delete;
+        Attempt& operator=(const Attempt&) = delete;
+
+        void failed()
+        {
+            // A sample taken while this loop runs still belongs to the attempt, so the bound is read every time
+            for (size_t i = first_sample; i < sampler.sample_count; ++i)
+                sampler.samples[i].label = INJECTED_FAILURE;
+        }
+
+    private:
+        SigprofSampler& sampler;
+        const size_t first_sample;
+    };
+
+    SigprofSampler(size_t max_samples, unsigned int interval_us)
+        : samples(max_samples)
+        , interval_us(interval_us)
+    {
+        void* warm_up[max_depth];
+        backtrace(warm_up, max_depth);
+    }
+
+    ~SigprofSampler() { stop(); }
+
+    SigprofSampler(const SigprofSampler&) = delete;
+    SigprofSampler& operator=(const SigprofSampler&) = delete;
+
+    bool start()
+    {
+        if (current())
+            return false;
+        current() = this;
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = &SigprofSampler::handler;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        if (sigaction(SIGPROF, &action, &previous_action)) {
+            current() = nullptr;
+            return false;
+        }
+        // setitimer() rejects tv_usec from one second on
+        const struct timeval interval = { static_cast<time_t>(interval_us / 1000000), static_cast<suseconds_t>(interval_us % 1000000) };
+        const struct itimerval timer = { interval, interval };
+        if (setitimer(ITIMER_PROF, &timer, nullptr)) {
+            sigaction(SIGPROF, &previous_action, nullptr);
+            current() = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    void stop()
+    {
+        if (current() != this)
+            return;
+        const struct itimerval timer = {};
+        setitimer(ITIMER_PROF, &timer, nullptr);
+        sigaction(SIGPROF, &previous_action, nullptr);
+        current() = nullptr;
+    }
+
+    size_t sampleCount() const { return sample_count; }
+    size_t droppedCount() const { return dropped_count; }
+
+    size_t sampleCount(Label label) const
+    {
+        size_t count = 0;
+        for (size_t i = 0; i < sample_count; ++i)
+            count += samples[i].label == label;
+        return count;
+    }
+
+    // Collapsed stacks "label;root;...;leaf count", the input of flamegraph.pl and of most flame graph viewers.
+    // Frames without a dynamic symbol are printed as module+offset, link with -rdynamic to have more of them named.
+    std::map<std::string, size_t> fold() const
+    {
+        std::map<std::string, size_t> stacks;
+        std::map<void*, std::string> symbols;
+        for (size_t i = 0; i < sample_count; ++i) {
+            const Sample& sample = samples[i];
+            std::string stack = labelName(sample.label);
+            // The handler and the signal trampoline are on top of every stack
+            for (int depth = sample.depth - 1; depth >= skipped_frames; --depth) {
+                std::string& symbol = symbols[sample.frames[depth]];
+                if (symbol.empty())
+                    symbol = symbolize(sample.frames[depth]);
+                stack += ";" + symbol;
+            }
+            ++stacks[stack];
+        }
+        return stacks;
+    }
+
+    bool writeFolded(const char* path) const
+    {
+        FILE* file = fopen(path, "w");
+        if (!file)
+            return false;
+        for (const auto& stack : fold())
+            fprintf(file, "%s %zu\n", stack.first.c_str(), stack.second);
+        return fclose(file) == 0;
+    }
+
+private:
+    static constexpr int max_depth = 64;
+    static constexpr int skipped_frames = 2;
+
+    struct Sample {
+        void* frames[max_depth];
+        int depth = 0;
+        Label label = HARNESS;
+    };
+
+    static void handler(int)
+    {
+        SigprofSampler* sampler = current();
+        if (!sampler)
+            return;
+        const size_t index = sampler->sample_count;
+        if (index >= sampler->samples.size()) {
+            ++sampler->dropped_count;
+            return;
+        }
+        Sample& sample = sampler->samples[index];
+        sample.depth = backtrace(sample.frames, max_depth);
+        sample.label = sampler->label;
+        sampler->sample_count = index + 1;
+    }
+
+    static std::string symbolize(void* address)
+    {
+        // Return addresses point after the call, look up the call itself
+        void* const call = static_cast<char*>(address) - 1;
+        Dl_info info;
+        if (!dladdr(call, &info))
+            return "[unknown]";
+        if (info.dli_sname) {
+            int status = 0;
+            char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+            std::string name = status == 0 && demangled ? demangled : info.dli_sname;
+            free(demangled);
+            // A semicolon would start a new frame
+            for (char& c : name) {
+                if (c == ';')
+                    c = ':';
+            }
+            return name;
+        }
+        const char* module = info.dli_fname ? strrchr(info.dli_fname, '/') : nullptr;
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "+0x%zx", static_cast<size_t>(static_cast<char*>(call) - static_cast<char*>(info.dli_fbase)));
+        return std::string(module ? module + 1 : info.dli_fname ? info.dli_fname : "?") + buffer;
+    }
+
+    // A function local static keeps the header free of definitions that would clash between translation units
+    static SigprofSampler* volatile& current()
+    {
+        static SigprofSampler* volatile instance = nullptr;
+        return instance;
+    }
+
+    std::vector<Sample> samples;
+    const unsigned int interval_us;
+    volatile size_t sample_count = 0;
+    volatile size_t dropped_count = 0;
+    volatile Label label = HARNESS;
+    struct sigaction previous_action;
+};
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SIMD_FUNCTIONS_X86 1
+#endif
+
+#include <sqlite3.h>
+
+// SQL functions and a collation with hand vectorized implementations:
+//     crc32c(X)             CRC-32C (Castagnoli) of a blob or of the UTF-8 text, NULL for NULL
+//     simd_instr(X, Y)      Same as the built-in instr()
+//     COLLATE ASCII_NOCASE  Same order as the built-in NOCASE
+// The implementation is picked when they are registered, so scalar and vector versions can be compared.
+enum class SimdLevel { SCALAR, SSE42, AVX2, BEST };
+
+namespace simd_functions {
+
+struct Implementation {
+    uint32_t (*crc32c)(const uint8_t* data, size_t size);
+    const uint8_t* (*find)(const uint8_t* haystack, size_t size, const uint8_t* needle, size_t needle_size); // nullptr if not found
+    int (*compareNoCase)(const uint8_t* left, const uint8_t* right, size_t size); // Like memcmp() of ASCII lower case
+};
+
+inline uint8_t lower(uint8_t c)
+{
+    return c >= 'A' && c <= 'Z' ? static_cast<uint8_t>(c + ('a' - 'A')) : c;
+}
+
+inline uint32_t crc32cScalar(const uint8_t* data, size_t size)
+{
+    struct Table {
+        uint32_t entries[256];
+        Table()
+        {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t crc = i;
+                for (int bit = 0; bit < 8; ++bit)
+                    crc = crc & 1 ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+                entries[i] = crc;
+            }
+        }
+    };
+    static const Table table;
+
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; ++i)
+        crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+inline const uint8_t* findScalar(const uint8_t* haystack, size_t size, const uint8_t* needle, size_t needle_size)
+{
+    for (size_t i = 0; i + needle_size <= size; ++i) {
+        if (haystack[i] == needle[0] && !memcmp(haystack + i + 1, needle + 1, needle_size - 1))
+            return haystack + i;
+    }
+    return nullptr;
+}
+
+inline int compareNoCaseScalar(const uint8_t* left, const uint8_t* right, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) {
+        const int difference = lower(left[i]) - lower(right[i]);
+        if (difference)
+            return difference;
+    }
+    return 0;
+}
+
+#ifdef SIMD_FUNCTIONS_X86
+__attribute__((target("sse4.2"))) inline uint32_t crc32cSse42(const uint8_t* data, size_t size)
+{
+    uint64_t crc = 0xFFFFFFFF;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t chunk;
+        memcpy(&chunk, data, sizeof(chunk));
+        crc = _mm_crc32_u64(crc, chunk);
+    }
+    uint32_t tail = static_cast<uint32_t>(crc);
+    for (; size; ++data, --size)
+        tail = _mm_crc32_u8(tail, *data);
+    return ~tail;
+}
+
+// Candidates are positions where both the first and the last byte of the needle match, 16 of them are checked at once.
+__attribute__((target("sse4.2"))) inline const uint8_t* findSse42(const uint8_t* haystack, size_t size, const uint8_t* needle, size_t needle_size)
+{
+    const __m128i first = _mm_set1_epi8(static_cast<char>(needle[0]));
+    const __m128i last = _mm_set1_epi8(static_cast<char>(needle[needle_size - 1]));
+    size_t i = 0;
+    for (; i + needle_size + 15 <= size; i += 16) {
+        const __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i));
+        const __m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i + needle_size - 1));
+        unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last))));
+        for (; mask; mask &= mask - 1) {
+            const size_t candidate = i + __builtin_ctz(mask);
+            if (!memcmp(haystack + candidate + 1, needle + 1, needle_size - 1))
+                return haystack + candidate;
+        }
+    }
+    return findScalar(haystack + i, size - i, needle, needle_size);
+}
+
+// Signed comparisons leave bytes >= 0x80 alone, they are negative
+__attribute__((target("sse4.2"))) inline __m128i lowerSse42(__m128i block)
+{
+    const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(block, _mm_set1_epi8('Z' + 1)));
+    return _mm_or_si128(block, _mm_and_si128(upper, _mm_set1_epi8('a' - 'A')));
+}
+
+__attribute__((target("sse4.2"))) inline int compareNoCaseSse42(const uint8_t* left, const uint8_t* right, size_t size)
+{
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        const __m128i a = lowerSse42(_mm_loadu_si128(reinterpret_cast<const __m128i*>(left + i)));
+        const __m128i b = lowerSse42(_mm_loadu_si128(reinterpret_cast<const __m128i*>(right + i)));
+        const unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b))) ^ 0xFFFF;
+        if (mask) {
+            const size_t index = i + __builtin_ctz(mask);
+            return lower(left[index]) - lower(right[index]);
+        }
+    }
+    return compareNoCaseScalar(left + i, right + i, size - i);
+}
+
+__attribute__((target("avx2"))) inline const uint8_t* findAvx2(const uint8_t* haystack, size_t size, const uint8_t* needle, size_t needle_size)
+{
+    const __m256i first = _mm256_set1_epi8(static_cast<char>(needle[0]));
+    const __m256i last = _mm256_set1_epi8(static_cast<char>(needle[needle_size - 1]));
+    size_t i = 0;
+    for (; i + needle_size + 31 <= size; i += 32) {
+        const __m256i block_first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(haystack + i));
+        const __m256i block_last = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(haystack + i + needle_size - 1));
+        unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, block_first), _mm256_cmpeq_epi8(last, block_last))));
+        for (; mask; mask &= mask - 1) {
+            const size_t candidate = i + __builtin_ctz(mask);
+            if (!memcmp(haystack + candidate + 1, needle + 1, needle_size - 1))
+                return haystack + candidate;
+        }
+    }
+    return findSse42(haystack + i, size - i, needle, needle_size);
+}
+
+__attribute__((target("avx2"))) inline __m256i lowerAvx2(__m256i block)
+{
+    const __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(block, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), block));
+    return _mm256_or_si256(block, _mm256_and_si256(upper, _mm256_set1_epi8('a' - 'A')));
+}
+
+__attribute__((target("avx2"))) inline int compareNoCaseAvx2(const uint8_t* left, const uint8_t* right, size_t size)
+{
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        const __m256i a = lowerAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(left + i)));
+        const __m256i b = lowerAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(right + i)));
+        const unsigned int mask = ~static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)));
+        if (mask) {
+            const size_t index = i + __builtin_ctz(mask);
+            return lower(left[index]) - lower(right[index]);
+        }
+    }
+    return compareNoCaseSse42(left + i, right + i, size - i);
+}
+#endif
+
+inline bool levelSupported(SimdLevel level)
+{
+    switch (level) {
+    case SimdLevel::SCALAR:
+    case SimdLevel::BEST:
+        return true;
+#ifdef SIMD_FUNCTIONS_X86
+    case SimdLevel::SSE42:
+        return __builtin_cpu_supports("sse4.2");
+    case SimdLevel::AVX2:
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("sse4.2");
+#endif
+    default:
+        return false;
+    }
+}
+
+inline const Implementation* implementation(SimdLevel level)
+{
+    static const Implementation scalar = { crc32cScalar, findScalar, compareNoCaseScalar };
+#ifdef SIMD_FUNCTIONS_X86
+    static const Implementation sse42 = { crc32cSse42, findSse42, compareNoCaseSse42 };
+    static const Implementation avx2 = { crc32cSse42, findAvx2, compareNoCaseAvx2 };
+    if (level == SimdLevel::BEST)
+        level = levelSupported(SimdLevel::AVX2) ? SimdLevel::AVX2 : levelSupported(SimdLevel::SSE42) ? SimdLevel::SSE42 : SimdLevel::SCALAR;
+    if (level == SimdLevel::AVX2 && levelSupported(level))
+        return &avx2;
+    if (level == SimdLevel::SSE42 && levelSupported(level))
+        return &sse42;
+#endif
+    return &scalar;
+}
+
+inline const Implementation* implementation(sqlite3_context* context)
+{
+    return static_cast<const Implementation*>(sqlite3_user_data(context));
+}
+
+inline void crc32c(sqlite3_context* context, int, sqlite3_value** argv)
+{
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL)
+        return;
+    // Numbers are hashed as their text, which needs a conversion and so may fail
+    const uint8_t* data = static_cast<const uint8_t*>(sqlite3_value_blob(argv[0]));
+    const int size = sqlite3_value_bytes(argv[0]);
+    if (!data && size) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    sqlite3_result_int64(context, implementation(context)->crc32c(data, static_cast<size_t>(size)));
+}
+
+inline void instr(sqlite3_context* context, int, sqlite3_value** argv)
+{
+    const int haystack_type = sqlite3_value_type(argv[0]);
+    const int needle_type = sqlite3_value_type(argv[1]);
+    if (haystack_type == SQLITE_NULL || needle_type == SQLITE_NULL)
+        return;
+
+    // Like instr(), two blobs are searched for bytes and anything else for characters
+    const bool bytes = haystack_type == SQLITE_BLOB && needle_type == SQLITE_BLOB;
+    const uint8_t* haystack = static_cast<const uint8_t*>(bytes ? sqlite3_value_blob(argv[0]) : sqlite3_value_text(argv[0]));
+    const size_t haystack_size = static_cast<size_t>(sqlite3_value_bytes(argv[0]));
+    const uint8_t* needle = static_cast<const uint8_t*>(bytes ? sqlite3_value_blob(argv[1]) : sqlite3_value_text(argv[1]));
+    const size_t needle_size = static_cast<size_t>(sqlite3_value_bytes(argv[1]));
+    if ((!haystack && haystack_size) || (!needle && needle_size)) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    if (!needle_size) {
+        sqlite3_result_int(context, 1);
+        return;
+    }
+
+    const uint8_t* found = needle_size <= haystack_size ? implementation(context)->find(haystack, haystack_size, needle, needle_size) : nullptr;
+    if (!found) {
+        sqlite3_result_int(context, 0);
+        return;
+    }
+    int64_t position = found - haystack + 1;
+    if (!bytes) {
+        for (const uint8_t* p = haystack; p != found; ++p)
+            position -= (*p & 0xC0) == 0x80; // UTF-8 continuation bytes
+    }
+    sqlite3_result_int64(context, position);
+}
+
+inline int compareNoCase(void* user_data, int left_size, const void* left, int right_size, const void* right)
+{
+    const int size = left_size < right_size ? left_size : right_size;
+    const int result = static_cast<const Implementation*>(user_data)->compareNoCase(static_cast<const uint8_t*>(left), static_cast<const uint8_t*>(right), size);
+    return result ? result : left_size - right_size;
+}
+
+} // namespace simd_functions
+
+inline int registerSimdFunctions(sqlite3* handle, SimdLevel level = SimdLevel::BEST)
+{
+    void* implementation = const_cast<simd_functions::Implementation*>(simd_functions::implementation(level));
+    const int flags = SQLITE_UTF8 | SQLITE_DETERMINISTIC;
+    int status = sqlite3_create_function_v2(handle, "crc32c", 1, flags, implementation, simd_functions::crc32c, nullptr, nullptr, nullptr);
+    if (status == SQLITE_OK)
+        status = sqlite3_create_function_v2(handle, "simd_instr", 2, flags, implementation, simd_functions::instr, nullptr, nullptr, nullptr);
+    if (status == SQLITE_OK)
+        status = sqlite3_create_collation_v2(handle, "ASCII_NOCASE", SQLITE_UTF8, implementation, simd_functions::compareNoCase, nullptr);
+    return status;
+}
@@ -0,0 +1,190 @@
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+
+#include "benchmark.h"
+#include "overthrower.h"
+#include "simd_functions.h"
+#include "test_helpers.h"
+
+#define NEEDLE "needle"
+
+namespace {
+
+// Pseudo random mixed case ASCII with an occasional two byte character, every third value contains NEEDLE and every
+// fifth one is the previous value with the case of its letters swapped.
+std::string makeText(int row, size_t max_length)
+{
+    static const char alphabet[] = "abcdefghijKLMNOPQRSTuvwxyz0123456789 _-";
+    if (row % 5 == 0 && row > 0) {
+        std::string text = makeText(row - 1, max_length);
+        for (char& c : text)
+            c = c >= 'a' && c <= 'z' ? c - ('a' - 'A') : c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+        return text;
+    }
+    uint32_t state = static_cast<uint32_t>(row) * 2654435761u + 1;
+    auto next = [&state]() {
+        state = state * 1103515245 + 12345;
+        return state >> 16;
+    };
+    const size_t length = 8 + next() % (max_length - 8);
+    const size_t needle_at = row % 3 == 0 ? next() % length : length;
+    std::string text;
+    for (size_t i = 0; i < length; ++i) {
+        if (i == needle_at)
+            text += NEEDLE;
+        if (next() % 16 == 0)
+            text += "\xc3\xa9";
+        else
+            text += alphabet[next() % (sizeof(alphabet) - 1)];
+    }
+    return text;
+}
+
+void fillTestTable(sqlite3* handle, int rows, size_t max_length)
+{
+    ASSERT_EQ(sqlite3_exec(handle, "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)", nullptr, nullptr, nullptr), SQLITE_OK);
+    ASSERT_EQ(sqlite3_exec(handle, "BEGIN TRANSACTION", nullptr, nullptr, nullptr), SQLITE_OK);
+    sqlite3_stmt* statement = nullptr;
+    ASSERT_EQ(sqlite3_prepare_v2(handle, "INSERT INTO test_table(b, c) VALUES (?, ?)", -1, &statement, nullptr), SQLITE_OK);
+    for (int row = 0; row < rows; ++row) {
+        const std::string text = makeText(row, max_length);
+        ASSERT_EQ(sqlite3_bind_int(statement, 1, row), SQLITE_OK);
+        ASSERT_EQ(sqlite3_bind_text(statement, 2, text.data(), static_cast<int>(text.size()), SQLITE_TRANSIENT), SQLITE_OK);
+        ASSERT_EQ(sqlite3_step(statement), SQLITE_DONE);
+        ASSERT_EQ(sqlite3_reset(statement), SQLITE_OK);
+    }
+    ASSERT_EQ(sqlite3_finalize(statement), SQLITE_OK);
+    ASSERT_EQ(sqlite3_exec(handle, "END TRANSACTION", nullptr, nullptr, nullptr), SQLITE_OK);
+}
+
+} // namespace
+
+TEST(SQLite3, SimdFunctions)
+{
+    static constexpr int rows_to_insert = 100;
+
+    // Every query compares a function with its built-in or scalar counterpart
+    static const struct {
+        const char* sql;
+        int64_t expected;
+    } queries[] = {
+        { "SELECT crc32c('123456789') = 3808858755 AND crc32c(x'') = 0 AND crc32c(NULL) IS NULL AND crc32c(123456789) = crc32c('123456789')", 1 },
+        { "SELECT count(*) FROM test_table WHERE simd_instr(c, '" NEEDLE "') IS NOT instr(c, '" NEEDLE "') OR simd_instr(c, 'é') IS NOT instr(c, 'é') "
+          "OR simd_instr(c, substr(c, 5, 20)) IS NOT instr(c, substr(c, 5, 20)) OR simd_instr(c, c || 'x') IS NOT instr(c, c || 'x') "
+          "OR simd_instr(CAST(c AS BLOB), CAST('" NEEDLE "' AS BLOB)) IS NOT instr(CAST(c AS BLOB), CAST('" NEEDLE "' AS BLOB))",
+            0 },
+        { "SELECT count(*) > 0 FROM test_table WHERE simd_instr(c, '" NEEDLE "') > 0", 1 },
+        { "SELECT (SELECT group_concat(a) FROM (SELECT a FROM test_table ORDER BY c COLLATE ASCII_NOCASE, a)) "
+          "= (SELECT group_concat(a) FROM (SELECT a FROM test_table ORDER BY c COLLATE NOCASE, a))",
+            1 },
+        { "SELECT count(*) FROM test_table WHERE c = upper(c) COLLATE ASCII_NOCASE", rows_to_insert },
+    };
+
+    auto runQueries = [](sqlite3* handle) {
+        int status = SQLITE_OK;
+        for (const auto& query : queries) {
+            int64_t value = -1;
+            status = queryInteger(handle, query.sql, &value);
+            if (status != SQLITE_OK)
+                break;
+            OverthrowerPauser pauser;
+            EXPECT_EQ(value, query.expected) << query.sql;
+        }
+        return status;
+    };
+
+    // Every level has to give the same answers, including checksums of the whole table
+    int64_t expected_checksum = -1;
+    for (SimdLevel level : { SimdLevel::SCALAR, SimdLevel::SSE42, SimdLevel::AVX2 }) {
+        if (!simd_functions::levelSupported(level))
+            continue;
+        sqlite3* handle = nullptr;
+        ASSERT_EQ(sqlite3_open(":memory:", &handle), SQLITE_OK);
+        fillTestTable(handle, rows_to_insert, 200);
+        ASSERT_EQ(registerSimdFunctions(handle, level), SQLITE_OK);
+        ASSERT_EQ(runQueries(handle), SQLITE_OK);
+        int64_t checksum = -1;
+        ASSERT_EQ(queryInteger(handle, "SELECT sum(crc32c(c)) FROM test_table", &checksum), SQLITE_OK);
+        if (expected_checksum < 0)
+            expected_checksum = checksum;
+        ASSERT_EQ(checksum, expected_checksum);
+        ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    }
+
+    int status;
+
+    auto tryFunctions = [&](DefaultOverthrower& overthrower) {
+        overthrower.activate();
+        sqlite3* handle = nullptr;
+        removeDbIfExists(overthrower);
+        {
+            OverthrowerPauser pauser;
+            ASSERT_EQ(sqlite3_open(TEST_DB_FILE_NAME, &handle), SQLITE_OK);
+            fillTestTable(handle, rows_to_insert, 200);
+        }
+
+        status = registerSimdFunctions(handle);
+        if (status == SQLITE_OK)
+            status = runQueries(handle);
+        if (status != SQLITE_OK)
+            OOM_SAFE_ASSERT_EQ(status, SQLITE_NOMEM);
+
+        ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    };
+
+    runOomSweeps("SQLite3.SimdFunctions", status, tryFunctions);
+}
+
+TEST(Benchmark, SimdFunctions)
+{
+    static constexpr int rows_to_insert = 1000000;
+
+    sqlite3* handle = nullptr;
+    ASSERT_EQ(sqlite3_open(":memory:", &handle), SQLITE_OK);
+    fillTestTable(handle, rows_to_insert, 400);
+
+    // Values which only differ in case make the collation look at every byte
+    ASSERT_EQ(sqlite3_exec(handle, "ALTER TABLE test_table ADD COLUMN d; UPDATE test_table SET d = upper(c)", nullptr, nullptr, nullptr), SQLITE_OK);
+
+    static const struct {
+        const char* name;
+        const char* sql;
+        const char* builtin_sql;
+    } operations[] = {
+        { "crc32c(c)", "SELECT sum(crc32c(c)) FROM test_table", nullptr },
+        { "instr(c, '" NEEDLE "')", "SELECT sum(simd_instr(c, '" NEEDLE "')) FROM test_table", "SELECT sum(instr(c, '" NEEDLE "')) FROM test_table" },
+        { "instr(c, 'absent')", "SELECT sum(simd_instr(c, 'absent')) FROM test_table", "SELECT sum(instr(c, 'absent')) FROM test_table" },
+        { "c = d COLLATE", "SELECT count(*) FROM test_table WHERE c = d COLLATE ASCII_NOCASE", "SELECT count(*) FROM test_table WHERE c = d COLLATE NOCASE" },
+        { "ORDER BY c COLLATE", "SELECT a FROM test_table ORDER BY c COLLATE ASCII_NOCASE LIMIT 1",
+            "SELECT a FROM test_table ORDER BY c COLLATE NOCASE LIMIT 1" },
+    };
+
+    ReportTable report(std::to_string(rows_to_insert) + " rows of 8-400 bytes, ns per row", { "operation", "built-in", "scalar", "SSE4.2", "AVX2" });
+
+    auto measure = [&handle](const char* sql) {
+        int64_t value = 0;
+        const Stopwatch stopwatch;
+        EXPECT_EQ(queryInteger(handle, sql, &value), SQLITE_OK) << sql;
+        return ReportTable::format("%.1f", static_cast<double>(stopwatch.elapsed().count()) / rows_to_insert);
+    };
+
+    for (const auto& operation : operations) {
+        std::vector<std::string> row = { operation.name, operation.builtin_sql ? measure(operation.builtin_sql) : "n/a" };
+        for (SimdLevel level : { SimdLevel::SCALAR, SimdLevel::SSE42, SimdLevel::AVX2 }) {
+            if (!simd_functions::levelSupported(level)) {
+                row.push_back("n/a");
+                continue;
+            }
+            ASSERT_EQ(registerSimdFunctions(handle, level), SQLITE_OK);
+            row.push_back(measure(operation.sql));
+        }
+        report.addRow(row);
+    }
+
+    ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    report.print();
+}
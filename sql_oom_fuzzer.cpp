@@ -0,0 +1,109 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "thread_injector.h"
+
+// libFuzzer target: the input is a SQL script over test_table together with the allocations which fail while it runs.
+// The in-memory database is opened and filled without injection, the script runs with the schedule, and the process
+// aborts if a block allocated meanwhile is left behind once the connection is closed, or if a failure leaves the
+// database corrupt. Overthrower interposes malloc() with LD_PRELOAD, which does not go together with the sanitizers of
+// libFuzzer, so the failures come from the injector of thread_injector.h.
+//
+// Input: a byte whose low 4 bits give the number n of failing allocations, n little endian 16 bit allocation indices,
+// then the script. A minimal corpus entry is "\0SELECT * FROM test_table".
+
+namespace {
+
+constexpr int max_progress_steps = 100000; // Per 1000 VDBE operations, bounds recursive CTEs and the like
+constexpr int max_length = 1 << 20; // Bounds zeroblob(), randomblob(), printf('%*s') and the like
+
+const char* const setup[] = { "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)", "CREATE INDEX test_idx ON test_table(a, b, c)",
+    "INSERT INTO test_table(b, c) VALUES (1, 2), (3, 4), (5, 6), ('AAAAAAAAAAAAAAAA', x'00FF'), (NULL, 0.5)" };
+
+int progressHandler(void* steps)
+{
+    return ++*static_cast<int*>(steps) > max_progress_steps;
+}
+
+// The script stays within the in-memory database: no files through ATTACH or VACUUM INTO, no extensions. Nor may it
+// set the directories of the process: SQLite keeps them in globals which outlive the connection and would count as
+// leaked.
+int authorizer(void*, int action, const char* name, const char*, const char*, const char*)
+{
+    if (action == SQLITE_ATTACH || action == SQLITE_DETACH)
+        return SQLITE_DENY;
+    if (action == SQLITE_PRAGMA && (!sqlite3_stricmp(name, "temp_store_directory") || !sqlite3_stricmp(name, "data_store_directory")))
+        return SQLITE_DENY;
+    return SQLITE_OK;
+}
+
+void check(bool condition, const char* what)
+{
+    if (condition)
+        return;
+    fprintf(stderr, "sql_oom_fuzzer: %s\n", what);
+    abort();
+}
+
+bool integrityOk(sqlite3* handle)
+{
+    sqlite3_stmt* statement = nullptr;
+    bool ok = sqlite3_prepare_v2(handle, "PRAGMA integrity_check", -1, &statement, nullptr) == SQLITE_OK && sqlite3_step(statement) == SQLITE_ROW &&
+        !strcmp(reinterpret_cast<const char*>(sqlite3_column_text(statement, 0)), "ok");
+    sqlite3_finalize(statement);
+    return ok;
+}
+
+} // namespace
+
+extern "C" int LLVMFuzzerInitialize(int*, char***)
+{
+    check(thread_injector::install() == SQLITE_OK, "cannot install the memory methods");
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    if (size < 1)
+        return 0;
+    const size_t failures = data[0] & 15;
+    if (size < 1 + 2 * failures)
+        return 0;
+    thread_injector::Settings settings;
+    settings.strategy = thread_injector::SCHEDULE;
+    for (size_t i = 0; i < failures; ++i)
+        settings.schedule.push_back(data[1 + 2 * i] | data[2 + 2 * i] << 8);
+    const std::string script(reinterpret_cast<const char*>(data) + 1 + 2 * failures, size - 1 - 2 * failures);
+
+    sqlite3* handle = nullptr;
+    check(sqlite3_open(":memory:", &handle) == SQLITE_OK, "cannot open the database");
+    for (const char* sql : setup)
+        check(sqlite3_exec(handle, sql, nullptr, nullptr, nullptr) == SQLITE_OK, "cannot fill test_table");
+    int steps = 0;
+    sqlite3_progress_handler(handle, 1000, progressHandler, &steps);
+    sqlite3_limit(handle, SQLITE_LIMIT_LENGTH, max_length);
+    sqlite3_limit(handle, SQLITE_LIMIT_ATTACHED, 0);
+    sqlite3_set_authorizer(handle, authorizer, nullptr);
+    sqlite3_db_config(handle, SQLITE_DBCONFIG_DEFENSIVE, 1, nullptr); // No corruption on purpose with writable_schema
+
+    check(thread_injector::activate(settings), "the injector is active already");
+    check(sqlite3_exec(handle, script.c_str(), nullptr, nullptr, nullptr) != SQLITE_CORRUPT, "the script has corrupted the database");
+    {
+        ThreadInjectorPauser pauser;
+        sqlite3_progress_handler(handle, 0, nullptr, nullptr);
+        check(integrityOk(handle), "integrity check failed");
+    }
+    check(sqlite3_close(handle) == SQLITE_OK, "cannot close the database");
+    const long blocks_leaked = thread_injector::deactivate();
+    if (blocks_leaked) {
+        fprintf(stderr, "sql_oom_fuzzer: %ld blocks leaked, schedule of %zu failures\n", blocks_leaked, failures);
+        abort();
+    }
+    return 0;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+
+#include "overthrower.h"
+#include "watchdog.h"
+
+// The value of an integer environment variable, default_value when it is unset, not a number or below minimum
+static inline int envInteger(const char* name, int default_value, int minimum = 1)
+{
+    const char* value = getenv(name);
+    if (!value || !*value)
+        return default_value;
+    char* end = nullptr;
+    const long number = strtol(value, &end, 10);
+    return *end || number < minimum || number > INT_MAX ? default_value : static_cast<int>(number);
+}
+
+// Runs a query returning a single integer, SQLITE_ERROR if it returns no row
+static inline int queryInteger(sqlite3* handle, const char* sql, int64_t* value)
+{
+    sqlite3_stmt* statement = nullptr;
+    int status = sqlite3_prepare_v2(handle, sql, -1, &statement, nullptr);
+    if (status == SQLITE_OK)
+        status = sqlite3_step(statement);
+    if (status == SQLITE_ROW) {
+        *value = sqlite3_column_int64(statement, 0);
+        status = SQLITE_OK;
+    }
+    sqlite3_finalize(statement);
+    return status == SQLITE_DONE ? SQLITE_ERROR : status;
+}
+
+// EXPLAIN QUERY PLAN on a single line, the lines of the plan are separated by "; "
+static inline std::string queryPlan(sqlite3* handle, const char* sql)
+{
+    std::string plan;
+    sqlite3_stmt* statement = nullptr;
+    if (sqlite3_prepare_v2(handle, (std::string("EXPLAIN QUERY PLAN ") + sql).c_str(), -1, &statement, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(statement) == SQLITE_ROW)
+            plan += (plan.empty() ? "" : "; ") + std::string(reinterpret_cast<const char*>(sqlite3_column_text(statement, 3)));
+    }
+    sqlite3_finalize(statement);
+    return plan;
+}
+
+// The fault injection of an OOM suite: iteration_count runs with the default strategy of overthrower, then the STEP
+// sweep, every allocation from delay 0, 1, 2, ... on failing, until a run gets through. tryCase(overthrower) activates
+// the overthrower, runs the case and leaves the status of its last SQLite call in status. Every run is a watchdog
+// iteration named after the suite; the sweep stops at the first fatal failure, which would repeat for every delay left.
+template <typename TryCase>
+void runOomSweeps(const char* name, const int& status, TryCase tryCase, int iteration_count = 100)
+{
+    const std::string random_name = std::string(name) + " random";
+    const std::string step_name = std::string(name) + " step";
+
+    for (int i = 0; i < iteration_count; ++i) {
+        WatchdogIteration iteration(random_name.c_str(), i);
+        {
+            DefaultOverthrower overthrower;
+            tryCase(overthrower);
+        }
+        if (testing::Test::HasFatalFailure())
+            return;
+    }
+
+    unsigned int delay = 0;
+    do {
+        WatchdogIteration iteration(step_name.c_str(), delay);
+        {
+            OverthrowerStrategyStep overthrower(delay++);
+            tryCase(overthrower);
+        }
+        if (testing::Test::HasFatalFailure())
+            return;
+    } while (status != SQLITE_OK);
+}
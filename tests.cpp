@@ -6,73 +6,9 @@
 
 #include <sqlite3.h>
 
-#define STRATEGY_RANDOM 0
-#define STRATEGY_STEP 1
-
-#define TEST_DB_FILE_NAME "db"
-// #define TEST_DB_FILE_NAME ":memory:"
-
-extern "C" {
-void activateOverthrower() __attribute__((weak));
-unsigned int deactivateOverthrower() __attribute__((weak));
-void pauseOverthrower(unsigned int duration) __attribute__((weak));
-void resumeOverthrower() __attribute__((weak));
-}
-
-class OverthrowerPauser final {
-public:
-    OverthrowerPauser()
-        : paused(true)
-    {
-        pauseOverthrower(0); // Pause for forever
-    }
-
-    OverthrowerPauser(unsigned int duration)
-        : paused(duration)
-    {
-        if (duration) // If duration is zero no pause is required
-            pauseOverthrower(duration);
-    }
-
-    ~OverthrowerPauser()
-    {
-        if (paused)
-            resumeOverthrower();
-    }
-
-private:
-    const bool paused;
-};
-
-#define OOM_SAFE_ASSERT_EQ(A, B)  \
-    {                             \
-        const auto a = A;         \
-        const auto b = B;         \
-        OverthrowerPauser pauser; \
-        ASSERT_EQ(a, b);          \
-    }
-
-#define OOM_SAFE_ASSERT_NE(A, B)  \
-    {                             \
-        const auto a = A;         \
-        const auto b = B;         \
-        OverthrowerPauser pauser; \
-        ASSERT_NE(a, b);          \
-    }
-
-#define OOM_SAFE_ASSERT_TRUE(A)   \
-    {                             \
-        const auto a = A;         \
-        OverthrowerPauser pauser; \
-        ASSERT_TRUE(a);           \
-    }
-
-#define OOM_SAFE_ASSERT_FALSE(A)  \
-    {                             \
-        const auto a = A;         \
-        OverthrowerPauser pauser; \
-        ASSERT_FALSE(a);          \
-    }
+#include "overthrower.h"
+#include "retry.h"
+#include "watchdog.h"
 
 GTEST_API_ int main(int argc, char** argv)
 {
@@ -85,96 +21,6 @@ GTEST_API_ int main(int argc, char** argv)
     return RUN_ALL_TESTS();
 }
 
-class DefaultOverthrower {
-public:
-    DefaultOverthrower() = default;
-
-    virtual ~DefaultOverthrower()
-    {
-        unsetEnv("OVERTHROWER_STRATEGY");
-        unsetEnv("OVERTHROWER_SEED");
-        unsetEnv("OVERTHROWER_DUTY_CYCLE");
-        unsetEnv("OVERTHROWER_DELAY");
-        unsetEnv("OVERTHROWER_DURATION");
-
-        if (activated)
-            deactivate();
-    }
-
-    void activate()
-    {
-        ASSERT_FALSE(activated);
-        activateOverthrower();
-        activated = true;
-    }
-
-    void deactivate()
-    {
-        const unsigned int blocks_leaked = deactivateOverthrower();
-        const bool was_activated = activated;
-        activated = false;
-        ASSERT_TRUE(was_activated);
-        ASSERT_EQ(blocks_leaked, 0);
-    }
-
-    void pause(unsigned int duration)
-    {
-        {
-            OverthrowerPauser pauser;
-            paused.push_back(duration);
-        }
-        if (duration)
-            pauseOverthrower(duration);
-    }
-
-    void resume()
-    {
-        OOM_SAFE_ASSERT_FALSE(paused.empty());
-        const bool was_paused = paused.back();
-        paused.pop_back();
-        if (was_paused)
-            resumeOverthrower();
-    }
-
-protected:
-    void setEnv(const char* name, unsigned int value) { ASSERT_EQ(setenv(name, std::to_string(value).c_str(), 1), 0); }
-    void unsetEnv(const char* name) { ASSERT_EQ(unsetenv(name), 0); }
-
-    bool activated = false;
-    std::vector<bool> paused;
-};
-
-class OverthrowerStrategyRandom : public DefaultOverthrower {
-public:
-    OverthrowerStrategyRandom() = delete;
-    OverthrowerStrategyRandom(unsigned int duty_cycle)
-    {
-        setEnv("OVERTHROWER_STRATEGY", STRATEGY_RANDOM);
-        // setEnv("OVERTHROWER_SEED", 0);
-        setEnv("OVERTHROWER_DUTY_CYCLE", duty_cycle);
-    }
-};
-
-class OverthrowerStrategyStep : public DefaultOverthrower {
-public:
-    OverthrowerStrategyStep() = delete;
-    OverthrowerStrategyStep(unsigned int delay)
-    {
-        setEnv("OVERTHROWER_STRATEGY", STRATEGY_STEP);
-        setEnv("OVERTHROWER_DELAY", delay);
-    }
-};
-
-static void removeDbIfExists(DefaultOverthrower& overthrower)
-{
-    static const bool db_in_memory = !strcmp(TEST_DB_FILE_NAME, ":memory:");
-    if (db_in_memory)
-        return;
-    OverthrowerPauser pauser;
-    if (!access(TEST_DB_FILE_NAME, F_OK))
-        ASSERT_EQ(unlink(TEST_DB_FILE_NAME), 0);
-}
-
 TEST(SQLite3, OpenClose)
 {
     static constexpr int iteration_count = 100;
@@ -207,12 +53,14 @@ TEST(SQLite3, OpenClose)
     };
 
     for (int i = 0; i < iteration_count; ++i) {
+        WatchdogIteration iteration("SQLite3.OpenClose random", i);
         DefaultOverthrower overthrower;
         tryOpen(overthrower);
     }
 
     unsigned int delay = 0;
     do {
+        WatchdogIteration iteration("SQLite3.OpenClose step", delay);
         OverthrowerStrategyStep overthrower(delay++);
         tryOpen(overthrower);
     } while (status != SQLITE_OK);
@@ -228,41 +76,35 @@ TEST(SQLite3, Resistance)
     sqlite3* handle = nullptr;
     sqlite3_stmt* prepared_statement = nullptr;
 
-    auto retryOpen = [&handle, &status, &overthrower]() {
-        for (unsigned int i = 0; i == 0 || status != SQLITE_OK; ++i) {
-            removeDbIfExists(overthrower);
-            {
-                OverthrowerPauser pauser(i);
-                status = sqlite3_open(TEST_DB_FILE_NAME, &handle);
-            }
-            if (status != SQLITE_OK && handle) {
-                OOM_SAFE_ASSERT_NE(status, SQLITE_NOMEM);
-                OOM_SAFE_ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
-            }
-        }
+    // Every call is retried with one more allocation let through each time, see retry.h
+    Retry<> retry(status);
+    Retry<LinearPause, ExpectStatus<SQLITE_OK>, SingleShot> retry_once(status);
+    Retry<LinearPause, ExpectStatus<SQLITE_DONE>> retry_done(status);
+    Retry<LinearPause, ExpectStatus<SQLITE_DONE>, SingleShot> retry_done_once(status);
+    Retry<LinearPause, ExpectStatus<SQLITE_ROW>> retry_row(status);
+    Retry<LinearPause, ExpectStatus<1>> retry_true(status);
 
-        OOM_SAFE_ASSERT_NE(handle, nullptr);
-    };
+    auto retryOpen = [&handle, &overthrower, &retry]() {
+        removeDbIfExists(overthrower);
+        retry([&handle]() { return sqlite3_open(TEST_DB_FILE_NAME, &handle); },
+            [&handle, &overthrower](int failed_status) {
+                if (handle) {
+                    OOM_SAFE_ASSERT_NE(failed_status, SQLITE_NOMEM);
+                    OOM_SAFE_ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+                }
+                removeDbIfExists(overthrower);
+            });
 
-    auto retryExecCommand = [&handle, &status, &overthrower](const char* sql) {
-        for (unsigned int i = 0; i == 0 || status != SQLITE_OK; ++i) {
-            OverthrowerPauser pauser(i);
-            status = sqlite3_exec(handle, sql, nullptr, nullptr, nullptr);
-        }
+        OOM_SAFE_ASSERT_NE(handle, nullptr);
     };
 
-    auto retryCommand = [&status, &overthrower](std::function<int()> func, bool do_single_attempt = false, int expected_status = SQLITE_OK) {
-        if (do_single_attempt) {
-            status = func();
-        }
-        for (unsigned int i = 0; !do_single_attempt && (i == 0 || status != expected_status); ++i) {
-            OverthrowerPauser pauser(i);
-            status = func();
-        }
-        return status == expected_status;
+    auto retryExecCommand = [&handle, &retry](const char* sql) {
+        watchdogNote(sql);
+        retry([&handle, sql]() { return sqlite3_exec(handle, sql, nullptr, nullptr, nullptr); });
     };
 
     auto prepare_insert = [&handle, &prepared_statement]() {
+        watchdogNote("INSERT INTO test_table(b, c) VALUES (?, ?)");
         return sqlite3_prepare_v2(handle, "INSERT INTO test_table(b, c) VALUES (?, ?)", -1, &prepared_statement, nullptr);
     };
 
@@ -272,11 +114,13 @@ TEST(SQLite3, Resistance)
     auto step = [&prepared_statement]() { return sqlite3_step(prepared_statement); };
 
     auto prepare_select = [&handle, &prepared_statement]() {
+        watchdogNote("SELECT a, b, c FROM test_table");
         return sqlite3_prepare_v2(handle, "SELECT a, b, c FROM test_table", -1, &prepared_statement, nullptr);
     };
     auto get_1st_column = [&prepared_statement]() { return sqlite3_column_int(prepared_statement, 1); };
     auto get_2nd_column = [&prepared_statement]() { return sqlite3_column_text(prepared_statement, 2) == nullptr ? 0 : 1; };
 
+    WatchdogIteration iteration("SQLite3.Resistance", 0);
     overthrower.activate();
 
     retryOpen();
@@ -291,7 +135,7 @@ TEST(SQLite3, Resistance)
     for (bool single_transaction : { false, true }) {
         prepared_statement = nullptr;
 
-        retryCommand(prepare_insert);
+        retry(prepare_insert);
 
         OOM_SAFE_ASSERT_NE(prepared_statement, nullptr);
 
@@ -303,8 +147,8 @@ TEST(SQLite3, Resistance)
             }
 
             for (int j = 0; j < rows_to_insert; ++j) {
-                if (!retryCommand(reset, single_transaction) || !retryCommand(bind_1st_column, single_transaction) ||
-                    !retryCommand(bind_2nd_column, single_transaction) || !retryCommand(step, single_transaction, SQLITE_DONE))
+                if (single_transaction ? !retry_once(reset) || !retry_once(bind_1st_column) || !retry_once(bind_2nd_column) || !retry_done_once(step)
+                                       : !retry(reset) || !retry(bind_1st_column) || !retry(bind_2nd_column) || !retry_done(step))
                     break;
             }
 
@@ -315,20 +159,20 @@ TEST(SQLite3, Resistance)
                 retryExecCommand("ROLLBACK TRANSACTION");
         }
 
-        retryCommand([&prepared_statement]() { return sqlite3_finalize(prepared_statement); });
+        retry([&prepared_statement]() { return sqlite3_finalize(prepared_statement); });
 
         if (single_transaction)
             retryExecCommand("END TRANSACTION");
     }
 
-    retryCommand(prepare_select);
+    retry(prepare_select);
     for (int i = 0; i < rows_to_insert * 2; ++i) {
-        OOM_SAFE_ASSERT_TRUE(retryCommand(step, false, SQLITE_ROW));
-        OOM_SAFE_ASSERT_TRUE(retryCommand(get_1st_column, false, 1));
-        OOM_SAFE_ASSERT_TRUE(retryCommand(get_2nd_column, false, 1));
+        OOM_SAFE_ASSERT_TRUE(retry_row(step));
+        OOM_SAFE_ASSERT_TRUE(retry_true(get_1st_column));
+        OOM_SAFE_ASSERT_TRUE(retry_true(get_2nd_column));
     }
-    OOM_SAFE_ASSERT_TRUE(retryCommand(step, false, SQLITE_DONE));
-    retryCommand([&prepared_statement]() { return sqlite3_finalize(prepared_statement); });
+    OOM_SAFE_ASSERT_TRUE(retry_done(step));
+    retry([&prepared_statement]() { return sqlite3_finalize(prepared_statement); });
 
     retryExecCommand("DROP INDEX test_idx");
     retryExecCommand("DROP TABLE test_table");
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include <sqlite3.h>
+
+// Allocation failure injection for SQLite whose state belongs to the calling thread, so that independent OOM cases can
+// run on several threads of one process. Overthrower interposes malloc() for the whole process and has a single
+// strategy, counter and pause stack; this injector sits in the memory methods of SQLite instead and keeps all of them
+// in thread_local storage. Only allocations made by SQLite can fail, which is what the suites test anyway.
+//
+// ThreadInjectorInstaller puts the methods in place for its lifetime, ThreadInjector is the per thread counterpart of
+// DefaultOverthrower and ThreadInjectorPauser the one of OverthrowerPauser. The first two fail the test on errors and
+// live in thread_injector_gtest.h:
+//
+//   ThreadInjectorInstaller installer;              // Once, with no connection open
+//   ...                                             // On any thread:
+//   ThreadInjectorStep injector(delay);
+//   injector.activate();
+//   ...                                             // SQLite calls of this thread fail from allocation "delay" on
+//   injector.deactivate();                          // Fails the test if a block allocated since activate() is left
+//
+// This header does not depend on gtest: the fuzzer uses the functions of namespace thread_injector and the pauser.
+
+// The functions have external linkage, so that every translation unit shares the state of a thread and the methods.
+namespace thread_injector {
+
+// Every block gets a header in front of it: the activation which has allocated it, if any, and the size asked for.
+// The header keeps the 8 byte alignment SQLite needs.
+struct Activation {
+    std::atomic<long> references{ 1 }; // The injector and every block allocated while it was active
+};
+
+struct BlockHeader {
+    Activation* owner;
+    uint64_t size;
+};
+
+static_assert(sizeof(BlockHeader) == 16, "The header has to keep blocks 8 byte aligned");
+
+enum Strategy { RANDOM, STEP, SCHEDULE };
+
+struct Settings {
+    Strategy strategy = RANDOM;
+    unsigned int duty_cycle = 1024; // RANDOM: one allocation out of duty_cycle fails
+    unsigned int delay = 0; // STEP: allocations from this index on fail
+    uint64_t seed = 0; // RANDOM
+    std::vector<uint32_t> schedule; // SCHEDULE: sorted indices of the allocations which fail
+};
+
+struct Pause {
+    bool forever;
+    unsigned int left; // Allocations still let through by a counted pause
+};
+
+struct ThreadState {
+    Activation* activation = nullptr;
+    Settings settings;
+    uint64_t random_state = 0;
+    uint64_t allocations = 0; // Since activation, paused ones excluded
+    std::vector<Pause> pauses; // Only the innermost one counts
+};
+
+inline ThreadState& threadState()
+{
+    static thread_local ThreadState state;
+    return state;
+}
+
+inline sqlite3_mem_methods& originalMethods()
+{
+    static sqlite3_mem_methods methods;
+    return methods;
+}
+
+inline void release(Activation* activation)
+{
+    if (activation && --activation->references == 0)
+        delete activation;
+}
+
+// Whether the next allocation of the calling thread fails; consumes one allocation of the innermost counted pause
+inline bool shouldFail()
+{
+    ThreadState& state = threadState();
+    if (!state.activation)
+        return false;
+    if (!state.pauses.empty()) {
+        Pause& pause = state.pauses.back();
+        if (pause.forever)
+            return false;
+        if (pause.left) { // A used up pause lets failures through until it is resumed
+            --pause.left;
+            return false;
+        }
+    }
+    const uint64_t index = state.allocations++;
+    if (state.settings.strategy == STEP)
+        return index >= state.settings.delay;
+    if (state.settings.strategy == SCHEDULE)
+        return index <= UINT32_MAX && std::binary_search(state.settings.schedule.begin(), state.settings.schedule.end(), static_cast<uint32_t>(index));
+    // xorshift64*, per thread so that threads do not disturb the sequences of each other
+    state.random_state ^= state.random_state >> 12;
+    state.random_state ^= state.random_state << 25;
+    state.random_state ^= state.random_state >> 27;
+    return (state.random_state * 2685821657736338717ULL >> 32) % state.settings.duty_cycle == 0;
+}
+
+inline void* track(void* raw, int size)
+{
+    if (!raw)
+        return nullptr;
+    BlockHeader* header = static_cast<BlockHeader*>(raw);
+    header->owner = threadState().activation;
+    header->size = static_cast<uint64_t>(size);
+    if (header->owner)
+        ++header->owner->references;
+    return header + 1;
+}
+
+inline BlockHeader* headerOf(void* memory)
+{
+    return static_cast<BlockHeader*>(memory) - 1;
+}
+
+inline void* xMalloc(int size)
+{
+    if (shouldFail())
+        return nullptr;
+    return track(originalMethods().xMalloc(size + static_cast<int>(sizeof(BlockHeader))), size);
+}
+
+inline void xFree(void* memory)
+{
+    if (!memory)
+        return;
+    BlockHeader* header = headerOf(memory);
+    Activation* owner = header->owner;
+    originalMethods().xFree(header);
+    release(owner);
+}
+
+inline void* xRealloc(void* memory, int size)
+{
+    if (shouldFail())
+        return nullptr;
+    BlockHeader* header = headerOf(memory);
+    void* raw = originalMethods().xRealloc(header, size + static_cast<int>(sizeof(BlockHeader)));
+    if (!raw)
+        return nullptr;
+    static_cast<BlockHeader*>(raw)->size = static_cast<uint64_t>(size);
+    return static_cast<BlockHeader*>(raw) + 1;
+}
+
+inline int xSize(void* memory)
+{
+    return memory ? static_cast<int>(headerOf(memory)->size) : 0;
+}
+
+inline int xRoundup(int size)
+{
+    return (size + 7) & ~7;
+}
+
+inline int xInit(void* data)
+{
+    return originalMethods().xInit(data);
+}
+
+inline void xShutdown(void* data)
+{
+    originalMethods().xShutdown(data);
+}
+
+// Installs the thread local memory methods, which needs sqlite3_shutdown(): no connection may be open around. Statistics
+// of memory usage are turned off meanwhile, they take a global mutex on every allocation and threads would queue on it.
+// Returns the first status other than SQLITE_OK.
+inline int install()
+{
+    static const sqlite3_mem_methods methods = { xMalloc, xFree, xRealloc, xSize, xRoundup, xInit, xShutdown, nullptr };
+    int status = sqlite3_shutdown();
+    if (status == SQLITE_OK)
+        status = sqlite3_config(SQLITE_CONFIG_GETMALLOC, &originalMethods());
+    if (status == SQLITE_OK)
+        status = sqlite3_config(SQLITE_CONFIG_MALLOC, &methods);
+    if (status == SQLITE_OK)
+        status = sqlite3_config(SQLITE_CONFIG_MEMSTATUS, 0);
+    return status == SQLITE_OK ? sqlite3_initialize() : status;
+}
+
+inline int uninstall()
+{
+    int status = sqlite3_shutdown();
+    if (status == SQLITE_OK)
+        status = sqlite3_config(SQLITE_CONFIG_MALLOC, &originalMethods());
+    if (status == SQLITE_OK)
+        status = sqlite3_config(SQLITE_CONFIG_MEMSTATUS, 1);
+    return status == SQLITE_OK ? sqlite3_initialize() : status;
+}
+
+// Starts injecting into the allocations of the calling thread, returns false if it does already
+inline bool activate(const Settings& settings)
+{
+    ThreadState& state = threadState();
+    if (state.activation)
+        return false;
+    state.settings = settings;
+    if (!state.settings.duty_cycle)
+        state.settings.duty_cycle = 1;
+    std::sort(state.settings.schedule.begin(), state.settings.schedule.end());
+    state.random_state = settings.seed ? settings.seed : 0x9E3779B97F4A7C15ULL;
+    state.allocations = 0;
+    state.pauses.reserve(16);
+    state.activation = new Activation;
+    return true;
+}
+
+// Stops injecting and returns the number of blocks allocated since activate() which have not been freed, or -1 if
+// there was no activation
+inline long deactivate()
+{
+    ThreadState& state = threadState();
+    Activation* activation = state.activation;
+    if (!activation)
+        return -1;
+    state.activation = nullptr;
+    const long blocks_leaked = activation->references - 1;
+    release(activation);
+    return blocks_leaked;
+}
+
+} // namespace thread_injector
+
+// Pauses injection on the calling thread: for ever by default, for the given number of allocations otherwise, where
+// zero means no pause at all, the same as OverthrowerPauser.
+class ThreadInjectorPauser final {
+public:
+    ThreadInjectorPauser()
+        : paused(true)
+    {
+        thread_injector::threadState().pauses.push_back({ true, 0 });
+    }
+
+    ThreadInjectorPauser(unsigned int duration)
+        : paused(duration)
+    {
+        if (duration)
+            thread_injector::threadState().pauses.push_back({ false, duration });
+    }
+
+    ~ThreadInjectorPauser()
+    {
+        if (paused)
+            thread_injector::threadState().pauses.pop_back();
+    }
+
+    ThreadInjectorPauser(const ThreadInjectorPauser&) = delete;
+    ThreadInjectorPauser& operator=(const ThreadInjectorPauser&) = delete;
+
+private:
+    const bool paused;
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include <gtest/gtest.h>
+
+#include "thread_injector.h"
+
+// The injector of thread_injector.h for the suites, failing the test on errors and leaks
+
+// Puts the memory methods of thread_injector in place for its lifetime
+class ThreadInjectorInstaller final {
+public:
+    ThreadInjectorInstaller() { EXPECT_EQ(thread_injector::install(), SQLITE_OK); }
+    ~ThreadInjectorInstaller() { EXPECT_EQ(thread_injector::uninstall(), SQLITE_OK); }
+
+    ThreadInjectorInstaller(const ThreadInjectorInstaller&) = delete;
+    ThreadInjectorInstaller& operator=(const ThreadInjectorInstaller&) = delete;
+};
+
+class ThreadInjector {
+public:
+    ThreadInjector() = default;
+
+    virtual ~ThreadInjector()
+    {
+        if (activated)
+            deactivate();
+    }
+
+    ThreadInjector(const ThreadInjector&) = delete;
+    ThreadInjector& operator=(const ThreadInjector&) = delete;
+
+    void activate()
+    {
+        ASSERT_FALSE(activated);
+        ASSERT_TRUE(thread_injector::activate(settings)) << "Another injector is active on this thread";
+        activated = true;
+    }
+
+    // Returns the number of blocks allocated since activate() which have not been freed, and fails the test if any
+    long deactivate()
+    {
+        const long blocks_leaked = thread_injector::deactivate();
+        const bool was_activated = activated;
+        activated = false;
+        EXPECT_TRUE(was_activated);
+        if (blocks_leaked < 0)
+            return 0;
+        EXPECT_EQ(blocks_leaked, 0);
+        return blocks_leaked;
+    }
+
+    // Allocations SQLite has made on this thread since activate(), not counting paused ones
+    uint64_t allocations() const { return thread_injector::threadState().allocations; }
+
+protected:
+    thread_injector::Settings settings;
+    bool activated = false;
+};
+
+class ThreadInjectorRandom : public ThreadInjector {
+public:
+    ThreadInjectorRandom(unsigned int duty_cycle, uint64_t seed = 0)
+    {
+        settings.strategy = thread_injector::RANDOM;
+        settings.duty_cycle = duty_cycle;
+        settings.seed = seed;
+    }
+};
+
+class ThreadInjectorStep : public ThreadInjector {
+public:
+    ThreadInjectorStep(unsigned int delay)
+    {
+        settings.strategy = thread_injector::STEP;
+        settings.delay = delay;
+    }
+};
+
+// The allocations with the given indices fail, and no other
+class ThreadInjectorSchedule : public ThreadInjector {
+public:
+    ThreadInjectorSchedule(std::vector<uint32_t> schedule)
+    {
+        settings.strategy = thread_injector::SCHEDULE;
+        settings.schedule = std::move(schedule);
+    }
+};
@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <gtest/gtest-spi.h>
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+
+#include "benchmark.h"
+#include "retry.h"
+#include "thread_injector_gtest.h"
+#include "watchdog.h"
+
+namespace {
+
+template <typename Expect = ExpectStatus<SQLITE_OK>>
+using ThreadRetry = Retry<LinearPause, Expect, UntilExpected, ThreadInjectorPauser>;
+
+std::string threadDbFileName(int thread)
+{
+    return std::string(TEST_DB_FILE_NAME) + "_thread_" + std::to_string(thread);
+}
+
+void removeFileIfExists(const std::string& path)
+{
+    if (!access(path.c_str(), F_OK))
+        ASSERT_EQ(unlink(path.c_str()), 0);
+}
+
+// Runs body(thread) on the given number of threads at once and waits for all of them
+template <typename Function>
+void runOnThreads(int threads, Function body)
+{
+    std::vector<std::thread> workers;
+    for (int thread = 0; thread < threads; ++thread)
+        workers.emplace_back(body, thread);
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+// SQLite3.OpenClose on its own database with the injector of the calling thread
+int tryOpenClose(ThreadInjector& injector, const std::string& db_file_name)
+{
+    int status = SQLITE_OK;
+    injector.activate();
+    removeFileIfExists(db_file_name);
+    sqlite3* handle = nullptr;
+    status = sqlite3_open(db_file_name.c_str(), &handle);
+    if (status == SQLITE_NOMEM)
+        EXPECT_EQ(handle, nullptr);
+    else
+        EXPECT_NE(handle, nullptr);
+    if (handle) {
+        static const char* const statements[] = { "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)",
+            "CREATE INDEX test_idx ON test_table(a, b, c)", "INSERT INTO test_table(b, c) VALUES (1, 2), (3, 4), (5, 6)", "DROP INDEX test_idx",
+            "DROP TABLE test_table", "VACUUM" };
+        for (const char* sql : statements) {
+            if (status == SQLITE_OK)
+                status = sqlite3_exec(handle, sql, nullptr, nullptr, nullptr);
+        }
+        EXPECT_EQ(sqlite3_close(handle), SQLITE_OK);
+    }
+    injector.deactivate();
+    return status;
+}
+
+void openCloseSuite(int thread, int iteration_count)
+{
+    const std::string db_file_name = threadDbFileName(thread);
+    for (int i = 0; i < iteration_count; ++i) {
+        WatchdogIteration iteration("ThreadInjector open-close random", i);
+        ThreadInjectorRandom injector(1024, static_cast<uint64_t>(thread) << 32 | (i + 1));
+        const int status = tryOpenClose(injector, db_file_name);
+        EXPECT_TRUE(status == SQLITE_OK || status == SQLITE_NOMEM) << status;
+    }
+
+    unsigned int delay = 0;
+    int status;
+    do {
+        WatchdogIteration iteration("ThreadInjector open-close step", delay);
+        ThreadInjectorStep injector(delay++);
+        status = tryOpenClose(injector, db_file_name);
+        EXPECT_TRUE(status == SQLITE_OK || status == SQLITE_NOMEM) << status;
+    } while (status != SQLITE_OK);
+    removeFileIfExists(db_file_name);
+}
+
+int64_t countRows(sqlite3* handle)
+{
+    sqlite3_stmt* statement = nullptr;
+    int64_t count = -1;
+    if (sqlite3_prepare_v2(handle, "SELECT count(*) FROM test_table", -1, &statement, nullptr) == SQLITE_OK && sqlite3_step(statement) == SQLITE_ROW)
+        count = sqlite3_column_int64(statement, 0);
+    sqlite3_finalize(statement);
+    return count;
+}
+
+// SQLite3.Resistance in short: one allocation out of eight fails and every call is retried until it goes through
+void resistanceSuite(int thread, int rows_to_insert)
+{
+    const std::string db_file_name = threadDbFileName(thread);
+    WatchdogIteration iteration("ThreadInjector resistance", thread);
+    ThreadInjectorRandom injector(8, static_cast<uint64_t>(thread) + 1);
+    injector.activate();
+
+    int status;
+    ThreadRetry<> retry(status);
+    ThreadRetry<ExpectStatus<SQLITE_DONE>> retry_done(status);
+    sqlite3* handle = nullptr;
+    sqlite3_stmt* statement = nullptr;
+
+    removeFileIfExists(db_file_name);
+    retry([&handle, &db_file_name]() { return sqlite3_open(db_file_name.c_str(), &handle); },
+        [&handle](int) {
+            sqlite3_close(handle);
+            handle = nullptr;
+        });
+    auto exec = [&handle, &retry](const char* sql) {
+        watchdogNote(sql);
+        retry([&handle, sql]() { return sqlite3_exec(handle, sql, nullptr, nullptr, nullptr); });
+    };
+    exec("CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)");
+    exec("CREATE INDEX test_idx ON test_table(a, b, c)");
+
+    watchdogNote("INSERT INTO test_table(b, c) VALUES (?, ?)");
+    retry([&handle, &statement]() { return sqlite3_prepare_v2(handle, "INSERT INTO test_table(b, c) VALUES (?, ?)", -1, &statement, nullptr); });
+    for (int i = 0; i < rows_to_insert; ++i) {
+        retry([&statement]() { return sqlite3_reset(statement); });
+        retry([&statement, i]() { return sqlite3_bind_int(statement, 1, i); });
+        retry([&statement]() { return sqlite3_bind_text(statement, 2, "AAAAAAAAAAAAAAAA", -1, nullptr); });
+        retry_done([&statement]() { return sqlite3_step(statement); });
+    }
+    retry([&statement]() { return sqlite3_finalize(statement); });
+
+    {
+        ThreadInjectorPauser pauser;
+        EXPECT_EQ(countRows(handle), rows_to_insert);
+    }
+
+    exec("DROP INDEX test_idx");
+    exec("DROP TABLE test_table");
+    exec("VACUUM");
+    EXPECT_EQ(sqlite3_close(handle), SQLITE_OK);
+    EXPECT_GT(injector.allocations(), 0u);
+    injector.deactivate();
+    removeFileIfExists(db_file_name);
+}
+
+int testThreadCount()
+{
+    return static_cast<int>(std::max(2u, std::min(8u, std::thread::hardware_concurrency())));
+}
+
+// CPU time of all the threads of the process, user and system
+double processCpuSeconds()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage))
+        return 0;
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+} // namespace
+
+TEST(ThreadInjector, Pauses)
+{
+    ThreadInjectorInstaller installer;
+
+    // Every allocation fails until a pause, nested pauses count on their own
+    ThreadInjectorStep injector(0);
+    injector.activate();
+    EXPECT_EQ(sqlite3_malloc(16), nullptr);
+    {
+        ThreadInjectorPauser pauser;
+        void* first = sqlite3_malloc(16);
+        EXPECT_NE(first, nullptr);
+        {
+            ThreadInjectorPauser counted(1);
+            void* second = sqlite3_malloc(16);
+            EXPECT_NE(second, nullptr);
+            EXPECT_EQ(sqlite3_malloc(16), nullptr);
+            sqlite3_free(second);
+        }
+        sqlite3_free(first);
+    }
+    EXPECT_EQ(sqlite3_malloc(16), nullptr);
+
+    // Other threads are not affected
+    std::thread([]() {
+        void* memory = sqlite3_malloc(16);
+        EXPECT_NE(memory, nullptr);
+        sqlite3_free(memory);
+    }).join();
+    EXPECT_EQ(injector.deactivate(), 0);
+
+    // A block left behind is reported
+    ThreadInjectorRandom leaking(1000000);
+    leaking.activate();
+    void* leaked = sqlite3_malloc(16);
+    ASSERT_NE(leaked, nullptr);
+    EXPECT_NONFATAL_FAILURE(EXPECT_EQ(leaking.deactivate(), 1), "blocks_leaked");
+    sqlite3_free(leaked);
+}
+
+TEST(ThreadInjector, Schedule)
+{
+    ThreadInjectorInstaller installer;
+
+    // Only the listed allocations fail, in whatever order they are given, paused ones are not counted
+    ThreadInjectorSchedule injector({ 3, 1 });
+    injector.activate();
+    std::vector<void*> blocks;
+    for (int i = 0; i < 5; ++i) {
+        if (i == 2) {
+            ThreadInjectorPauser pauser;
+            blocks.push_back(sqlite3_malloc(16));
+            EXPECT_NE(blocks.back(), nullptr);
+        }
+        blocks.push_back(sqlite3_malloc(16));
+        EXPECT_EQ(blocks.back() == nullptr, i == 1 || i == 3) << i;
+    }
+    EXPECT_EQ(injector.allocations(), 5u);
+    for (void* block : blocks)
+        sqlite3_free(block);
+    EXPECT_EQ(injector.deactivate(), 0);
+}
+
+TEST(ThreadInjector, ParallelOpenClose)
+{
+    static constexpr int iteration_count = 100;
+
+    ThreadInjectorInstaller installer;
+    runOnThreads(testThreadCount(), [](int thread) { openCloseSuite(thread, iteration_count); });
+}
+
+TEST(ThreadInjector, ParallelResistance)
+{
+    static constexpr int rows_to_insert = 1000;
+
+    ThreadInjectorInstaller installer;
+    runOnThreads(testThreadCount(), [](int thread) { resistanceSuite(thread, rows_to_insert); });
+}
+
+// The same amount of OOM cases on 1, 2, 4, ... threads, each thread with its own database. Separate connections and
+// files still meet on the locks SQLite keeps for the whole process, so the speedup is not linear by construction:
+//   - the unix VFS takes its static inode mutex (SQLITE_MUTEX_STATIC_VFS1) on every open, close, lock and unlock of a
+//     file, i.e. several times per transaction;
+//   - sqlite3_open() and sqlite3_close() take the master mutex, sqlite3_randomness() the PRNG one;
+//   - pcache1 takes its global mutex to account for every page it allocates outside of a SQLITE_CONFIG_PAGECACHE
+//     buffer. Page caches are separate per connection in a threadsafe build, their group mutex is not shared;
+//   - the memory statistics mutex would be taken on every allocation, install() turns the statistics off.
+// Waiting on these mutexes puts a thread to sleep, as does waiting for fsync(), so the CPU column is the share of the
+// threads' wall time spent on a CPU. The serial row gives the share left by I/O, a column which drops below it as
+// threads are added points at lock contention, one which stays with a low speedup at memory bandwidth. With a single
+// hardware thread there is only the serial row.
+TEST(Benchmark, ThreadInjector)
+{
+    static constexpr int cases = 32;
+    static constexpr int iteration_count = 100;
+    static constexpr int rows_to_insert = 1000;
+
+    const int max_threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    ReportTable report(std::to_string(cases) + " OpenClose and Resistance cases with thread local fault injection, " + std::to_string(max_threads) +
+            " hardware threads",
+        { "threads", "seconds", "speedup", "efficiency", "CPU" });
+
+    ThreadInjectorInstaller installer;
+    double serial = 0;
+    for (int threads = 1; threads <= std::min(max_threads, cases); threads *= 2) {
+        const Stopwatch stopwatch;
+        const double cpu_started = processCpuSeconds();
+        runOnThreads(threads, [threads](int thread) {
+            for (int i = thread; i < cases; i += threads) {
+                openCloseSuite(thread, iteration_count);
+                resistanceSuite(thread, rows_to_insert);
+            }
+        });
+        const double seconds = stopwatch.seconds();
+        const double cpu_seconds = processCpuSeconds() - cpu_started;
+        if (threads == 1)
+            serial = seconds;
+        report.addRow({ std::to_string(threads), ReportTable::format("%.2f", seconds), ReportTable::format("%.2fx", serial / seconds),
+            ReportTable::format("%.0f%%", 100 * serial / seconds / threads), ReportTable::format("%.0f%%", 100 * cpu_seconds / seconds / threads) });
+    }
+    report.print();
+}
@@ -0,0 +1,401 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+// Eponymous virtual table over a std::vector of structs, e.g.
+//     struct Item { int64_t id; double price; std::string name; };
+//     static const VectorTableColumn item_columns[] = { VECTOR_TABLE_COLUMN(Item, id), VECTOR_TABLE_COLUMN(Item, price), VECTOR_TABLE_COLUMN(Item, name) };
+//     const VectorTableSource source = vectorTableSource(items, item_columns, 3, 0); // items are sorted by id
+//     registerVectorTable(handle, "items", &source);
+// after which "SELECT name FROM items WHERE id = ?" is a binary search. The rowid of items[i] is i + 1, rowid ranges
+// and equality are served without a scan. Text and blobs are returned with SQLITE_STATIC, so neither the vector nor its
+// elements may change while a statement reads them. Members may be int64_t, int, double, std::string or
+// std::vector<uint8_t> (a BLOB).
+struct VectorTableColumn {
+    const char* name;
+    int type; // SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT or SQLITE_BLOB
+    void (*result)(sqlite3_context* context, const void* row);
+    int (*compare)(const void* row, sqlite3_value* value); // Like memcmp(row member, value), value has the same type
+};
+
+struct VectorTableSource {
+    const void* vector;
+    const void* (*data)(const void* vector);
+    size_t (*size)(const void* vector);
+    size_t row_size;
+    const VectorTableColumn* columns;
+    int column_count;
+    int sorted_column; // Index of the column the vector is sorted by in ascending order or -1
+};
+
+namespace vector_table {
+
+inline int compareNumbers(double member, sqlite3_value* value)
+{
+    const double other = sqlite3_value_double(value);
+    return member < other ? -1 : member > other ? 1 : 0;
+}
+
+inline int compareInteger(int64_t member, sqlite3_value* value)
+{
+    if (sqlite3_value_type(value) == SQLITE_FLOAT)
+        return compareNumbers(static_cast<double>(member), value);
+    const int64_t other = sqlite3_value_int64(value);
+    return member < other ? -1 : member > other ? 1 : 0;
+}
+
+// The value has been converted by filter() already, see valueBytes(): nothing allocates here and other is not NULL
+// unless the value is empty.
+inline int compareBytes(const void* member, size_t size, int type, sqlite3_value* value)
+{
+    const void* other = type == SQLITE_TEXT ? static_cast<const void*>(sqlite3_value_text(value)) : sqlite3_value_blob(value);
+    const size_t other_size = other ? static_cast<size_t>(sqlite3_value_bytes(value)) : 0;
+    const size_t common_size = size < other_size ? size : other_size;
+    const int result = common_size ? memcmp(member, other, common_size) : 0;
+    return result ? result : size < other_size ? -1 : size > other_size ? 1 : 0;
+}
+
+inline void result(sqlite3_context* context, int64_t value) { sqlite3_result_int64(context, value); }
+inline void result(sqlite3_context* context, int value) { sqlite3_result_int(context, value); }
+inline void result(sqlite3_context* context, double value) { sqlite3_result_double(context, value); }
+inline void result(sqlite3_context* context, const std::string& value) { sqlite3_result_text(context, value.data(), static_cast<int>(value.size()), SQLITE_STATIC); }
+inline void result(sqlite3_context* context, const std::vector<uint8_t>& value)
+{
+    sqlite3_result_blob(context, value.data(), static_cast<int>(value.size()), SQLITE_STATIC);
+}
+
+inline int compare(int64_t member, sqlite3_value* value) { return compareInteger(member, value); }
+inline int compare(int member, sqlite3_value* value) { return compareInteger(member, value); }
+inline int compare(double member, sqlite3_value* value) { return compareNumbers(member, value); }
+inline int compare(const std::string& member, sqlite3_value* value) { return compareBytes(member.data(), member.size(), SQLITE_TEXT, value); }
+inline int compare(const std::vector<uint8_t>& member, sqlite3_value* value) { return compareBytes(member.data(), member.size(), SQLITE_BLOB, value); }
+
+inline int type(const int64_t*) { return SQLITE_INTEGER; }
+inline int type(const int*) { return SQLITE_INTEGER; }
+inline int type(const double*) { return SQLITE_FLOAT; }
+inline int type(const std::string*) { return SQLITE_TEXT; }
+inline int type(const std::vector<uint8_t>*) { return SQLITE_BLOB; }
+
+inline const char* declaredType(int type)
+{
+    return type == SQLITE_INTEGER ? "INTEGER" : type == SQLITE_FLOAT ? "REAL" : type == SQLITE_TEXT ? "TEXT" : "BLOB";
+}
+
+template <typename Row, typename T, T Row::*member>
+void resultMember(sqlite3_context* context, const void* row)
+{
+    result(context, static_cast<const Row*>(row)->*member);
+}
+
+template <typename Row, typename T, T Row::*member>
+int compareMember(const void* row, sqlite3_value* value)
+{
+    return compare(static_cast<const Row*>(row)->*member, value);
+}
+
+template <typename Row>
+const void* vectorData(const void* vector)
+{
+    return static_cast<const std::vector<Row>*>(vector)->data();
+}
+
+template <typename Row>
+size_t vectorSize(const void* vector)
+{
+    return static_cast<const std::vector<Row>*>(vector)->size();
+}
+
+// Bits of idxNum, the arguments of xFilter() follow in the same order
+enum : int {
+    ROWID_EQ = 1,
+    ROWID_LOWER = 2,
+    ROWID_LOWER_STRICT = 4,
+    ROWID_UPPER = 8,
+    ROWID_UPPER_STRICT = 16,
+    SORTED_EQ = 32,
+};
+
+struct Table {
+    sqlite3_vtab base;
+    const VectorTableSource* source;
+};
+
+struct Cursor {
+    sqlite3_vtab_cursor base;
+    const char* rows;
+    size_t row_size;
+    size_t current;
+    size_t end;
+};
+
+inline int connect(sqlite3* handle, void* client_data, int, const char* const*, sqlite3_vtab** vtab, char**)
+{
+    const VectorTableSource* source = static_cast<const VectorTableSource*>(client_data);
+
+    sqlite3_str* schema = sqlite3_str_new(handle);
+    sqlite3_str_appendall(schema, "CREATE TABLE x(");
+    for (int i = 0; i < source->column_count; ++i)
+        sqlite3_str_appendf(schema, "%s\"%w\" %s", i ? ", " : "", source->columns[i].name, declaredType(source->columns[i].type));
+    sqlite3_str_appendall(schema, ")");
+    char* sql = sqlite3_str_finish(schema);
+    if (!sql)
+        return SQLITE_NOMEM;
+    const int status = sqlite3_declare_vtab(handle, sql);
+    sqlite3_free(sql);
+    if (status != SQLITE_OK)
+        return status;
+
+    Table* table = static_cast<Table*>(sqlite3_malloc(sizeof(Table)));
+    if (!table)
+        return SQLITE_NOMEM;
+    memset(table, 0, sizeof(Table));
+    table->source = source;
+    *vtab = &table->base;
+    return SQLITE_OK;
+}
+
+inline int disconnect(sqlite3_vtab* vtab)
+{
+    sqlite3_free(vtab);
+    return SQLITE_OK;
+}
+
+// Constraints are not omitted, SQLite checks them once more and so takes care of affinity corner cases.
+inline int bestIndex(sqlite3_vtab* vtab, sqlite3_index_info* info)
+{
+    const VectorTableSource* source = reinterpret_cast<Table*>(vtab)->source;
+    int rowid_eq = -1, lower = -1, upper = -1, sorted_eq = -1;
+    for (int i = 0; i < info->nConstraint; ++i) {
+        const auto& constraint = info->aConstraint[i];
+        if (!constraint.usable)
+            continue;
+        if (constraint.iColumn < 0) {
+            switch (constraint.op) {
+            case SQLITE_INDEX_CONSTRAINT_EQ:
+                rowid_eq = rowid_eq < 0 ? i : rowid_eq;
+                break;
+            case SQLITE_INDEX_CONSTRAINT_GT:
+            case SQLITE_INDEX_CONSTRAINT_GE:
+                lower = lower < 0 ? i : lower;
+                break;
+            case SQLITE_INDEX_CONSTRAINT_LT:
+            case SQLITE_INDEX_CONSTRAINT_LE:
+                upper = upper < 0 ? i : upper;
+                break;
+            }
+        } else if (constraint.iColumn == source->sorted_column && constraint.op == SQLITE_INDEX_CONSTRAINT_EQ && sorted_eq < 0
+            && !sqlite3_stricmp(sqlite3_vtab_collation(info, i), "BINARY")) {
+            sorted_eq = i;
+        }
+    }
+
+    const double row_count = static_cast<double>(source->size(source->vector));
+    int argument = 0;
+    info->idxNum = 0;
+    info->estimatedCost = row_count;
+    info->estimatedRows = static_cast<sqlite3_int64>(row_count);
+    if (rowid_eq >= 0) {
+        info->idxNum = ROWID_EQ;
+        info->aConstraintUsage[rowid_eq].argvIndex = ++argument;
+        info->estimatedCost = 1;
+        info->estimatedRows = 1;
+        info->idxFlags = SQLITE_INDEX_SCAN_UNIQUE;
+    } else {
+        if (lower >= 0) {
+            info->idxNum |= ROWID_LOWER | (info->aConstraint[lower].op == SQLITE_INDEX_CONSTRAINT_GT ? ROWID_LOWER_STRICT : 0);
+            info->aConstraintUsage[lower].argvIndex = ++argument;
+            info->estimatedCost /= 4;
+        }
+        if (upper >= 0) {
+            info->idxNum |= ROWID_UPPER | (info->aConstraint[upper].op == SQLITE_INDEX_CONSTRAINT_LT ? ROWID_UPPER_STRICT : 0);
+            info->aConstraintUsage[upper].argvIndex = ++argument;
+            info->estimatedCost /= 4;
+        }
+        if (sorted_eq >= 0) {
+            info->idxNum |= SORTED_EQ;
+            info->aConstraintUsage[sorted_eq].argvIndex = ++argument;
+            info->estimatedCost = 20;
+            info->estimatedRows = 10;
+        }
+        info->estimatedRows = static_cast<sqlite3_int64>(info->estimatedCost);
+    }
+
+    // Rows come out in rowid order, which is also the order of the sorted column
+    if (info->nOrderBy == 1 && !info->aOrderBy[0].desc && (info->aOrderBy[0].iColumn < 0 || info->aOrderBy[0].iColumn == source->sorted_column))
+        info->orderByConsumed = 1;
+    return SQLITE_OK;
+}
+
+inline int openCursor(sqlite3_vtab*, sqlite3_vtab_cursor** cursor)
+{
+    Cursor* result = static_cast<Cursor*>(sqlite3_malloc(sizeof(Cursor)));
+    if (!result)
+        return SQLITE_NOMEM;
+    memset(result, 0, sizeof(Cursor));
+    *cursor = &result->base;
+    return SQLITE_OK;
+}
+
+inline int closeCursor(sqlite3_vtab_cursor* cursor)
+{
+    sqlite3_free(cursor);
+    return SQLITE_OK;
+}
+
+// Brings a text value to UTF-8 or expands a zeroblob, the text first and the size then as sqlite3_value_bytes()
+// documents it. Both may allocate, false means that SQLite has run out of memory.
+inline bool valueBytes(sqlite3_value* value, int type)
+{
+    if (type == SQLITE_TEXT)
+        return sqlite3_value_text(value) != nullptr;
+    return sqlite3_value_blob(value) != nullptr || sqlite3_value_bytes(value) == 0;
+}
+
+// Narrows [*begin, *end) down to the rows whose rowid satisfies "rowid op value".
+inline void applyRowidBound(sqlite3_value* value, int op, size_t* begin, size_t* end)
+{
+    const int type = sqlite3_value_numeric_type(value);
+    if (type != SQLITE_INTEGER && type != SQLITE_FLOAT) {
+        // NULL matches nothing, text and blobs are greater than any number
+        if (type == SQLITE_NULL || (op != SQLITE_INDEX_CONSTRAINT_LT && op != SQLITE_INDEX_CONSTRAINT_LE))
+            *end = *begin;
+        return;
+    }
+
+    // Row i has rowid i + 1, rows [first, last) satisfy the constraint
+    const double bound = sqlite3_value_double(value);
+    double first = 0.0;
+    double last = static_cast<double>(*end);
+    switch (op) {
+    case SQLITE_INDEX_CONSTRAINT_EQ:
+        if (bound == std::floor(bound))
+            first = bound - 1, last = bound;
+        else
+            last = first;
+        break;
+    case SQLITE_INDEX_CONSTRAINT_GT:
+        first = std::floor(bound);
+        break;
+    case SQLITE_INDEX_CONSTRAINT_GE:
+        first = std::ceil(bound) - 1;
+        break;
+    case SQLITE_INDEX_CONSTRAINT_LT:
+        last = std::ceil(bound) - 1;
+        break;
+    case SQLITE_INDEX_CONSTRAINT_LE:
+        last = std::floor(bound);
+        break;
+    }
+    if (first > static_cast<double>(*begin))
+        *begin = first < static_cast<double>(*end) ? static_cast<size_t>(first) : *end;
+    if (last < static_cast<double>(*end))
+        *end = last > static_cast<double>(*begin) ? static_cast<size_t>(last) : *begin;
+}
+
+inline int filter(sqlite3_vtab_cursor* base, int index_number, const char*, int, sqlite3_value** argv)
+{
+    Cursor* cursor = reinterpret_cast<Cursor*>(base);
+    const VectorTableSource* source = reinterpret_cast<Table*>(base->pVtab)->source;
+    cursor->rows = static_cast<const char*>(source->data(source->vector));
+    cursor->row_size = source->row_size;
+    cursor->current = 0;
+    cursor->end = source->size(source->vector);
+
+    int argument = 0;
+    if (index_number & ROWID_EQ)
+        applyRowidBound(argv[argument++], SQLITE_INDEX_CONSTRAINT_EQ, &cursor->current, &cursor->end);
+    if (index_number & ROWID_LOWER)
+        applyRowidBound(argv[argument++], index_number & ROWID_LOWER_STRICT ? SQLITE_INDEX_CONSTRAINT_GT : SQLITE_INDEX_CONSTRAINT_GE, &cursor->current, &cursor->end);
+    if (index_number & ROWID_UPPER)
+        applyRowidBound(argv[argument++], index_number & ROWID_UPPER_STRICT ? SQLITE_INDEX_CONSTRAINT_LT : SQLITE_INDEX_CONSTRAINT_LE, &cursor->current, &cursor->end);
+    if (index_number & SORTED_EQ) {
+        sqlite3_value* value = argv[argument++];
+        const VectorTableColumn& column = source->columns[source->sorted_column];
+        const bool numeric = column.type == SQLITE_INTEGER || column.type == SQLITE_FLOAT;
+        // Numeric affinity is applied as SQLite would do it, text affinity would need an allocation and is left to the scan
+        const int type = numeric ? sqlite3_value_numeric_type(value) : sqlite3_value_type(value);
+        if (type == SQLITE_NULL || (numeric && type != SQLITE_INTEGER && type != SQLITE_FLOAT)) {
+            cursor->end = cursor->current;
+            return SQLITE_OK;
+        }
+        if (!numeric && type != column.type)
+            return SQLITE_OK;
+        if (!numeric && !valueBytes(value, type))
+            return SQLITE_NOMEM;
+        const auto compare = column.compare;
+        auto bound = [cursor, compare, value](size_t low, size_t high, bool upper) {
+            while (low < high) {
+                const size_t middle = low + (high - low) / 2;
+                const int result = compare(cursor->rows + middle * cursor->row_size, value);
+                if (result < 0 || (upper && result == 0))
+                    low = middle + 1;
+                else
+                    high = middle;
+            }
+            return low;
+        };
+        const size_t first = bound(cursor->current, cursor->end, false);
+        cursor->end = bound(first, cursor->end, true);
+        cursor->current = first;
+    }
+    return SQLITE_OK;
+}
+
+inline int next(sqlite3_vtab_cursor* base)
+{
+    ++reinterpret_cast<Cursor*>(base)->current;
+    return SQLITE_OK;
+}
+
+inline int eof(sqlite3_vtab_cursor* base)
+{
+    const Cursor* cursor = reinterpret_cast<Cursor*>(base);
+    return cursor->current >= cursor->end;
+}
+
+inline int column(sqlite3_vtab_cursor* base, sqlite3_context* context, int index)
+{
+    const Cursor* cursor = reinterpret_cast<Cursor*>(base);
+    const VectorTableSource* source = reinterpret_cast<Table*>(base->pVtab)->source;
+    source->columns[index].result(context, cursor->rows + cursor->current * cursor->row_size);
+    return SQLITE_OK;
+}
+
+inline int rowid(sqlite3_vtab_cursor* base, sqlite3_int64* rowid)
+{
+    *rowid = static_cast<sqlite3_int64>(reinterpret_cast<Cursor*>(base)->current) + 1;
+    return SQLITE_OK;
+}
+
+static const sqlite3_module module = {
+    0, // iVersion
+    nullptr, // xCreate, eponymous only
+    connect, bestIndex, disconnect, nullptr, openCursor, closeCursor, filter, next, eof, column, rowid,
+};
+
+} // namespace vector_table
+
+#define VECTOR_TABLE_COLUMN(ROW, MEMBER)                                                                                                                       \
+    {                                                                                                                                                          \
+        #MEMBER, vector_table::type(static_cast<decltype(ROW::MEMBER)*>(nullptr)), &vector_table::resultMember<ROW, decltype(ROW::MEMBER), &ROW::MEMBER>, \
+            &vector_table::compareMember<ROW, decltype(ROW::MEMBER), &ROW::MEMBER>                                                                             \
+    }
+
+template <typename Row>
+VectorTableSource vectorTableSource(const std::vector<Row>& rows, const VectorTableColumn* columns, int column_count, int sorted_column = -1)
+{
+    return { &rows, vector_table::vectorData<Row>, vector_table::vectorSize<Row>, sizeof(Row), columns, column_count, sorted_column };
+}
+
+// The source has to outlive the connection.
+inline int registerVectorTable(sqlite3* handle, const char* name, const VectorTableSource* source)
+{
+    return sqlite3_create_module_v2(handle, name, &vector_table::module, const_cast<VectorTableSource*>(source), nullptr);
+}
@@ -0,0 +1,248 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+
+#include "benchmark.h"
+#include "overthrower.h"
+#include "test_helpers.h"
+#include "vector_table.h"
+
+namespace {
+
+struct Item {
+    int64_t id;
+    double price;
+    std::string name;
+    std::vector<uint8_t> payload;
+};
+
+const VectorTableColumn item_columns[] = {
+    VECTOR_TABLE_COLUMN(Item, id),
+    VECTOR_TABLE_COLUMN(Item, price),
+    VECTOR_TABLE_COLUMN(Item, name),
+    VECTOR_TABLE_COLUMN(Item, payload),
+};
+
+// Ids are even and ascending, so every other key of a join misses.
+std::vector<Item> makeItems(int count)
+{
+    std::vector<Item> items(count);
+    for (int i = 0; i < count; ++i) {
+        items[i].id = i * 2;
+        items[i].price = i * 0.5;
+        items[i].name = "item " + std::to_string(i);
+        items[i].payload.assign(static_cast<size_t>(i % 64), static_cast<uint8_t>(i));
+    }
+    return items;
+}
+
+// Runs a query returning a single row and stores its columns as text, NULL becomes "NULL".
+int queryRow(sqlite3* handle, const char* sql, std::vector<std::string>* row)
+{
+    sqlite3_stmt* statement = nullptr;
+    int status = sqlite3_prepare_v2(handle, sql, -1, &statement, nullptr);
+    if (status == SQLITE_OK)
+        status = sqlite3_step(statement);
+    if (status == SQLITE_ROW) {
+        row->clear();
+        for (int i = 0; i < sqlite3_column_count(statement) && status == SQLITE_ROW; ++i) {
+            const bool is_null = sqlite3_column_type(statement, i) == SQLITE_NULL;
+            const char* text = reinterpret_cast<const char*>(sqlite3_column_text(statement, i));
+            if (!text && !is_null) {
+                status = SQLITE_NOMEM;
+            } else {
+                OverthrowerPauser pauser;
+                row->emplace_back(text ? text : "NULL");
+            }
+        }
+        status = status == SQLITE_ROW ? SQLITE_OK : status;
+    }
+    sqlite3_finalize(statement);
+    return status == SQLITE_DONE ? SQLITE_ERROR : status;
+}
+
+} // namespace
+
+TEST(SQLite3, VectorTable)
+{
+    const std::vector<Item> items = makeItems(1000);
+    const VectorTableSource source = vectorTableSource(items, item_columns, 4, 0);
+
+    static const struct {
+        const char* sql;
+        std::vector<std::string> expected;
+    } queries[] = {
+        { "SELECT count(*), min(id), max(id), sum(length(payload)) FROM items", { "1000", "0", "1998", "31020" } },
+        { "SELECT count(*), min(name), max(price) FROM items WHERE rowid BETWEEN 101 AND 200", { "100", "item 100", "99.5" } },
+        { "SELECT count(*) FROM items WHERE rowid > 999.5 OR rowid < 1.5", { "2" } },
+        { "SELECT name, hex(payload) FROM items WHERE rowid = 3", { "item 2", "0202" } },
+        { "SELECT name, price FROM items WHERE id = 500", { "item 250", "125.0" } },
+        { "SELECT count(*) FROM items WHERE id = '500'", { "1" } },
+        { "SELECT count(*) FROM items WHERE id = 501", { "0" } },
+        { "SELECT count(*), sum(items.price) FROM test_table JOIN items ON items.id = test_table.b", { "500", "62625.0" } },
+    };
+
+    sqlite3* handle = nullptr;
+    ASSERT_EQ(sqlite3_open(":memory:", &handle), SQLITE_OK);
+    ASSERT_EQ(registerVectorTable(handle, "items", &source), SQLITE_OK);
+    // Rowid ranges and ids are looked up, not scanned
+    EXPECT_NE(queryPlan(handle, queries[1].sql).find("VIRTUAL TABLE INDEX 10:"), std::string::npos);
+    EXPECT_NE(queryPlan(handle, queries[4].sql).find("VIRTUAL TABLE INDEX 32:"), std::string::npos);
+    ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+
+    int status;
+
+    auto tryQueries = [&](DefaultOverthrower& overthrower) {
+        overthrower.activate();
+        sqlite3* handle = nullptr;
+        removeDbIfExists(overthrower);
+        {
+            OverthrowerPauser pauser;
+            ASSERT_EQ(sqlite3_open(TEST_DB_FILE_NAME, &handle), SQLITE_OK);
+            ASSERT_EQ(sqlite3_exec(handle, "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)", nullptr, nullptr, nullptr), SQLITE_OK);
+            ASSERT_EQ(sqlite3_exec(handle,
+                          "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 1000) INSERT INTO test_table(b, c) SELECT i, "
+                          "'AAAAAAAAAAAAAAAA' FROM n",
+                          nullptr, nullptr, nullptr),
+                SQLITE_OK);
+        }
+
+        status = registerVectorTable(handle, "items", &source);
+        for (const auto& query : queries) {
+            if (status != SQLITE_OK)
+                break;
+            std::vector<std::string> row;
+            status = queryRow(handle, query.sql, &row);
+            if (status == SQLITE_OK) {
+                OverthrowerPauser pauser;
+                ASSERT_EQ(row, query.expected) << query.sql;
+            }
+        }
+        if (status != SQLITE_OK)
+            OOM_SAFE_ASSERT_EQ(status, SQLITE_NOMEM);
+
+        ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    };
+
+    runOomSweeps("SQLite3.VectorTable", status, tryQueries);
+}
+
+// Binary search over a TEXT column: in a UTF-16 database the value of the constraint has to be converted to UTF-8
+// first, which allocates and fails under injection. Lookaside is off, it would serve the conversion without malloc().
+TEST(SQLite3, VectorTableText)
+{
+    std::vector<Item> items = makeItems(1000);
+    std::sort(items.begin(), items.end(), [](const Item& left, const Item& right) { return left.name < right.name; });
+    const VectorTableSource source = vectorTableSource(items, item_columns, 4, 2);
+
+    static const struct {
+        const char* sql;
+        std::vector<std::string> expected;
+    } queries[] = {
+        { "SELECT id, price FROM items WHERE name = 'item 250'", { "500", "125.0" } },
+        { "SELECT count(*) FROM items WHERE name = 'item 2500'", { "0" } },
+        { "SELECT count(*) FROM items WHERE name = ''", { "0" } },
+        { "SELECT count(*), sum(items.id) FROM test_table JOIN items ON items.name = test_table.c", { "19", "19000" } },
+    };
+
+    sqlite3* handle = nullptr;
+    ASSERT_EQ(sqlite3_open(":memory:", &handle), SQLITE_OK);
+    ASSERT_EQ(registerVectorTable(handle, "items", &source), SQLITE_OK);
+    EXPECT_NE(queryPlan(handle, queries[0].sql).find("VIRTUAL TABLE INDEX 32:"), std::string::npos);
+    ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+
+    int status;
+
+    auto tryQueries = [&](DefaultOverthrower& overthrower) {
+        overthrower.activate();
+        sqlite3* handle = nullptr;
+        removeDbIfExists(overthrower);
+        {
+            OverthrowerPauser pauser;
+            ASSERT_EQ(sqlite3_open(TEST_DB_FILE_NAME, &handle), SQLITE_OK);
+            ASSERT_EQ(sqlite3_db_config(handle, SQLITE_DBCONFIG_LOOKASIDE, nullptr, 0, 0), SQLITE_OK);
+            ASSERT_EQ(sqlite3_exec(handle, "PRAGMA encoding = 'UTF-16le'", nullptr, nullptr, nullptr), SQLITE_OK);
+            ASSERT_EQ(sqlite3_exec(handle, "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)", nullptr, nullptr, nullptr), SQLITE_OK);
+            ASSERT_EQ(sqlite3_exec(handle,
+                          "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 20) INSERT INTO test_table(b, c) SELECT i, 'item ' || "
+                          "(i * 50) FROM n",
+                          nullptr, nullptr, nullptr),
+                SQLITE_OK);
+        }
+
+        status = registerVectorTable(handle, "items", &source);
+        for (const auto& query : queries) {
+            if (status != SQLITE_OK)
+                break;
+            std::vector<std::string> row;
+            status = queryRow(handle, query.sql, &row);
+            if (status == SQLITE_OK) {
+                OverthrowerPauser pauser;
+                ASSERT_EQ(row, query.expected) << query.sql;
+            }
+        }
+        if (status != SQLITE_OK)
+            OOM_SAFE_ASSERT_EQ(status, SQLITE_NOMEM);
+
+        ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    };
+
+    runOomSweeps("SQLite3.VectorTableText", status, tryQueries);
+}
+
+TEST(Benchmark, VectorTable)
+{
+    static constexpr int item_count = 1000000;
+    static constexpr int lookups = 100000;
+
+    const std::vector<Item> items = makeItems(item_count);
+    const VectorTableSource source = vectorTableSource(items, item_columns, 4, 0);
+
+    sqlite3* handle = nullptr;
+    ASSERT_EQ(sqlite3_open(":memory:", &handle), SQLITE_OK);
+    ASSERT_EQ(registerVectorTable(handle, "items", &source), SQLITE_OK);
+    ASSERT_EQ(sqlite3_exec(handle, "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)", nullptr, nullptr, nullptr), SQLITE_OK);
+    ASSERT_EQ(sqlite3_exec(handle,
+                  "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 100000) INSERT INTO test_table(b, c) SELECT abs(random()) % "
+                  "2000000, 'AAAAAAAAAAAAAAAA' FROM n",
+                  nullptr, nullptr, nullptr),
+        SQLITE_OK);
+
+    ReportTable report(std::to_string(item_count) + " structs queried in place and after loading into a table",
+        { "table", "load s", "full scan s", "rowid range s", "join " + std::to_string(lookups) + " s" });
+
+    auto runQueries = [&handle, &report](const char* name, const char* table, const std::string& load_elapsed) {
+        const std::string full_scan = std::string("SELECT sum(price), sum(length(name)), sum(length(payload)) FROM ") + table;
+        const std::string rowid_range = std::string("SELECT sum(price) FROM ") + table + " WHERE rowid BETWEEN 250001 AND 750000";
+        const std::string join = std::string("SELECT count(*), sum(price) FROM test_table JOIN ") + table + " ON " + table + ".id = test_table.b";
+        std::vector<std::string> row;
+        std::vector<std::string> cells = { name, load_elapsed };
+        for (const std::string& sql : { full_scan, rowid_range, join }) {
+            const Stopwatch stopwatch;
+            ASSERT_EQ(queryRow(handle, sql.c_str(), &row), SQLITE_OK);
+            cells.push_back(ReportTable::format("%.3f", stopwatch.seconds()));
+        }
+        report.addRow(cells);
+    };
+
+    runQueries("vector_table", "items", "-");
+
+    {
+        const Stopwatch stopwatch;
+        ASSERT_EQ(sqlite3_exec(handle,
+                      "CREATE TABLE real_items(id INTEGER, price REAL, name TEXT, payload BLOB);"
+                      "INSERT INTO real_items(rowid, id, price, name, payload) SELECT rowid, * FROM items;"
+                      "CREATE INDEX real_items_id ON real_items(id)",
+                      nullptr, nullptr, nullptr),
+            SQLITE_OK);
+        const double elapsed = stopwatch.seconds();
+        runQueries("loaded table", "real_items", ReportTable::format("%.3f", elapsed));
+    }
+
+    ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+    report.print();
+}
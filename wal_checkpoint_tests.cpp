@@ -0,0 +1,197 @@
+#include <atomic>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+
+#include "benchmark.h"
+
+#define WAL_DB_FILE_NAME "wal_db"
+
+namespace {
+
+constexpr int CHECKPOINT_AUTO = -1;
+
+struct CheckpointConfig {
+    const char* name;
+    int autocheckpoint; // Value for PRAGMA wal_autocheckpoint, 0 disables automatic checkpoints
+    int mode; // SQLITE_CHECKPOINT_* for the background thread or CHECKPOINT_AUTO if there is no such thread
+};
+
+struct CheckpointStats {
+    unsigned int calls = 0;
+    unsigned int busy = 0; // Checkpoint could not even start
+    unsigned int starved = 0; // Checkpoint left frames behind because of readers
+};
+
+void removeWalDb()
+{
+    for (const char* suffix : { "", "-wal", "-shm" }) {
+        const std::string path = std::string(WAL_DB_FILE_NAME) + suffix;
+        if (!access(path.c_str(), F_OK))
+            ASSERT_EQ(unlink(path.c_str()), 0);
+    }
+}
+
+void openWalDb(sqlite3** handle)
+{
+    ASSERT_EQ(sqlite3_open(WAL_DB_FILE_NAME, handle), SQLITE_OK);
+    ASSERT_EQ(sqlite3_busy_timeout(*handle, 10000), SQLITE_OK);
+    // Also makes the connection read the header, otherwise sqlite3_wal_checkpoint_v2() does not know that it is in WAL mode.
+    ASSERT_EQ(sqlite3_exec(*handle, "PRAGMA journal_mode=WAL", nullptr, nullptr, nullptr), SQLITE_OK);
+}
+
+// Keeps read transactions open for a while to hold back the checkpointer the way long reports do.
+void runReader(const std::atomic<bool>& stop, unsigned int hold_ms, unsigned int idle_ms)
+{
+    sqlite3* handle = nullptr;
+    openWalDb(&handle);
+    while (!stop) {
+        ASSERT_EQ(sqlite3_exec(handle, "BEGIN", nullptr, nullptr, nullptr), SQLITE_OK);
+        ASSERT_EQ(sqlite3_exec(handle, "SELECT count(*) FROM test_table", nullptr, nullptr, nullptr), SQLITE_OK);
+        std::this_thread::sleep_for(std::chrono::milliseconds(hold_ms));
+        ASSERT_EQ(sqlite3_exec(handle, "COMMIT", nullptr, nullptr, nullptr), SQLITE_OK);
+        std::this_thread::sleep_for(std::chrono::milliseconds(idle_ms));
+    }
+    ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+}
+
+void runCheckpointer(const std::atomic<bool>& stop, int mode, unsigned int interval_ms, CheckpointStats& stats)
+{
+    sqlite3* handle = nullptr;
+    openWalDb(&handle);
+    while (!stop) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+        int frames_in_log = 0;
+        int frames_checkpointed = 0;
+        const int status = sqlite3_wal_checkpoint_v2(handle, nullptr, mode, &frames_in_log, &frames_checkpointed);
+        ++stats.calls;
+        if (status == SQLITE_BUSY) {
+            ++stats.busy;
+            continue;
+        }
+        ASSERT_EQ(status, SQLITE_OK);
+        ASSERT_GE(frames_in_log, 0);
+        if (frames_checkpointed < frames_in_log)
+            ++stats.starved;
+    }
+    ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+}
+
+// The readers and the checkpointer of a run. They are stopped and joined on every way out of the run, an ASSERT of the
+// writer included: destroying a joinable std::thread calls std::terminate().
+class BackgroundThreads final {
+public:
+    BackgroundThreads() = default;
+    ~BackgroundThreads() { join(); }
+
+    BackgroundThreads(const BackgroundThreads&) = delete;
+    BackgroundThreads& operator=(const BackgroundThreads&) = delete;
+
+    template <typename Function, typename... Arguments>
+    void start(Function function, Arguments&&... arguments)
+    {
+        threads.emplace_back(function, std::cref(stop), std::forward<Arguments>(arguments)...);
+    }
+
+    void join()
+    {
+        stop = true;
+        for (std::thread& thread : threads) {
+            if (thread.joinable())
+                thread.join();
+        }
+    }
+
+private:
+    std::atomic<bool> stop{ false };
+    std::vector<std::thread> threads;
+};
+
+} // namespace
+
+TEST(Benchmark, WalCheckpoint)
+{
+    static constexpr int rows_to_insert = 50000;
+    static constexpr int reader_count = 2;
+    static constexpr unsigned int reader_hold_ms = 50;
+    static constexpr unsigned int reader_idle_ms = 100;
+    static constexpr unsigned int checkpoint_interval_ms = 20;
+    static constexpr int wal_sample_period = 100;
+
+    static const CheckpointConfig configs[] = {
+        { "auto off", 0, CHECKPOINT_AUTO },
+        { "auto 100", 100, CHECKPOINT_AUTO },
+        { "auto 1000", 1000, CHECKPOINT_AUTO },
+        { "auto 10000", 10000, CHECKPOINT_AUTO },
+        { "PASSIVE", 0, SQLITE_CHECKPOINT_PASSIVE },
+        { "FULL", 0, SQLITE_CHECKPOINT_FULL },
+        { "RESTART", 0, SQLITE_CHECKPOINT_RESTART },
+        { "TRUNCATE", 0, SQLITE_CHECKPOINT_TRUNCATE },
+    };
+
+    ReportTable report("WAL checkpoint strategies (" + std::to_string(rows_to_insert) + " autocommit inserts, " + std::to_string(reader_count) +
+                           " readers holding " + std::to_string(reader_hold_ms) + " ms)",
+        { "strategy", "inserts/s", "p50 us", "p99 us", "p999 us", "max us", "max WAL MB", "final WAL MB", "ckpt calls", "busy", "starved" });
+
+    for (const auto& config : configs) {
+        removeWalDb();
+
+        sqlite3* handle = nullptr;
+        openWalDb(&handle);
+        ASSERT_EQ(sqlite3_exec(handle, "PRAGMA synchronous=NORMAL", nullptr, nullptr, nullptr), SQLITE_OK);
+        ASSERT_EQ(sqlite3_wal_autocheckpoint(handle, config.autocheckpoint), SQLITE_OK);
+        ASSERT_EQ(sqlite3_exec(handle, "CREATE TABLE test_table(a INTEGER PRIMARY KEY AUTOINCREMENT, b, c)", nullptr, nullptr, nullptr), SQLITE_OK);
+        ASSERT_EQ(sqlite3_exec(handle, "CREATE INDEX test_idx ON test_table(a, b, c)", nullptr, nullptr, nullptr), SQLITE_OK);
+
+        CheckpointStats stats;
+        BackgroundThreads background;
+        for (int i = 0; i < reader_count; ++i)
+            background.start(runReader, reader_hold_ms, reader_idle_ms);
+        if (config.mode != CHECKPOINT_AUTO)
+            background.start(runCheckpointer, config.mode, checkpoint_interval_ms, std::ref(stats));
+
+        sqlite3_stmt* prepared_statement = nullptr;
+        ASSERT_EQ(sqlite3_prepare_v2(handle, "INSERT INTO test_table(b, c) VALUES (?, ?)", -1, &prepared_statement, nullptr), SQLITE_OK);
+
+        LatencyRecorder latencies;
+        latencies.reserve(rows_to_insert);
+        long long max_wal_size = 0;
+        const Stopwatch total;
+        for (int i = 0; i < rows_to_insert; ++i) {
+            const Stopwatch insert;
+            ASSERT_EQ(sqlite3_reset(prepared_statement), SQLITE_OK);
+            ASSERT_EQ(sqlite3_bind_int(prepared_statement, 1, i), SQLITE_OK);
+            ASSERT_EQ(sqlite3_bind_text(prepared_statement, 2, "AAAAAAAAAAAAAAAA", -1, SQLITE_STATIC), SQLITE_OK);
+            ASSERT_EQ(sqlite3_step(prepared_statement), SQLITE_DONE);
+            latencies.add(insert.elapsed());
+            if (i % wal_sample_period == 0)
+                max_wal_size = std::max(max_wal_size, fileSize(WAL_DB_FILE_NAME "-wal"));
+        }
+        const double elapsed = total.seconds();
+
+        background.join();
+
+        const long long final_wal_size = fileSize(WAL_DB_FILE_NAME "-wal");
+        max_wal_size = std::max(max_wal_size, final_wal_size);
+
+        ASSERT_EQ(sqlite3_finalize(prepared_statement), SQLITE_OK);
+        ASSERT_EQ(sqlite3_close(handle), SQLITE_OK);
+
+        const bool manual = config.mode != CHECKPOINT_AUTO;
+        report.addRow({ config.name, ReportTable::format("%.0f", rows_to_insert / elapsed), ReportTable::format("%.1f", latencies.percentile(0.5)),
+            ReportTable::format("%.1f", latencies.percentile(0.99)), ReportTable::format("%.1f", latencies.percentile(0.999)),
+            ReportTable::format("%.1f", latencies.max()), ReportTable::format("%.2f", max_wal_size / 1048576.0),
+            ReportTable::format("%.2f", final_wal_size / 1048576.0), manual ? std::to_string(stats.calls) : "-", manual ? std::to_string(stats.busy) : "-",
+            manual ? std::to_string(stats.starved) : "-" });
+    }
+
+    removeWalDb();
+    report.print();
+}
@@ -0,0 +1,406 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "thread_injector.h"
+
+// Hang detection for the OOM suites. A livelock under injected failures would otherwise hang CI silently, so every
+// retry loop of retry.h has a budget of attempts and seconds, and an iteration of a suite has a budget of seconds
+// checked by a monitor thread. Once a budget is spent the process aborts with what the stuck thread was doing: the
+// iteration, the last SQL statement noted by the harness, the allocation index of the thread local injector or the
+// pauses of the LD_PRELOAD overthrower, and the retry loops it is in with their attempts and pauses. The overthrower
+// cannot be asked where it is, overthrower.h records whether the thread has activated it and the pauses it has entered.
+// That state is only ever read by the thread it belongs to: the monitor thread interrupts a late iteration with SIGUSR2
+// and the handler writes the diagnostic, with async-signal-safe code only.
+//
+//   WatchdogIteration iteration("SQLite3.OpenClose", i);   // Outside of fault injection, it registers the thread
+//   ...
+//   watchdogNote(sql);                                     // The SQL statement goes to the diagnostic
+//
+// The budgets come from WATCHDOG_RETRY_ATTEMPTS, WATCHDOG_RETRY_SECONDS and WATCHDOG_ITERATION_SECONDS. Nothing
+// here allocates once the monitor thread runs, so that the watchdog does not shift the allocation sequence under test.
+// Every retry loop also adds its number of attempts to the retry-count distribution of its thread.
+
+// The functions with state have external linkage: every translation unit which includes this header has to share the
+// limits and the context of a thread.
+struct WatchdogLimits {
+    unsigned int retry_attempts;
+    double retry_seconds;
+    double iteration_seconds;
+};
+
+inline WatchdogLimits& watchdogLimits()
+{
+    auto env = [](const char* name, double default_value) {
+        const char* value = getenv(name);
+        return value && atof(value) > 0 ? atof(value) : default_value;
+    };
+    static WatchdogLimits limits = { static_cast<unsigned int>(env("WATCHDOG_RETRY_ATTEMPTS", 100000)), env("WATCHDOG_RETRY_SECONDS", 60),
+        env("WATCHDOG_ITERATION_SECONDS", 600) };
+    return limits;
+}
+
+// Number of attempts per retry loop, exact up to 63
+class RetryHistogram final {
+public:
+    static constexpr unsigned int exact = 64;
+
+    void record(unsigned int attempts)
+    {
+        ++counts[attempts < exact ? attempts : exact];
+        total += attempts;
+        if (attempts > largest)
+            largest = attempts;
+    }
+
+    void clear() { *this = RetryHistogram(); }
+
+    uint64_t calls() const
+    {
+        uint64_t calls = 0;
+        for (uint64_t count : counts)
+            calls += count;
+        return calls;
+    }
+
+    double mean() const { return calls() ? static_cast<double>(total) / calls() : 0.0; }
+
+    // Attempts needed by the given fraction of calls, the largest count seen for the tail above 63
+    unsigned int percentile(double fraction) const
+    {
+        const uint64_t target = static_cast<uint64_t>(fraction * calls());
+        uint64_t seen = 0;
+        for (unsigned int attempts = 0; attempts < exact; ++attempts) {
+            seen += counts[attempts];
+            if (seen > target)
+                return attempts;
+        }
+        return largest;
+    }
+
+    unsigned int max() const { return largest; }
+
+private:
+    uint64_t counts[exact + 1] = {};
+    uint64_t total = 0;
+    unsigned int largest = 0;
+};
+
+// What a thread is doing, written and read by the thread itself only
+struct WatchdogContext {
+    static constexpr unsigned int max_depth = 8;
+
+    struct RetryLoop {
+        unsigned int attempt;
+        unsigned int pause;
+        int status;
+    };
+
+    const char* iteration_name = nullptr;
+    long iteration = -1;
+    char last_sql[256] = {};
+    RetryLoop loops[max_depth] = {};
+    unsigned int depth = 0; // May exceed max_depth, the innermost loops are not shown then
+    const thread_injector::ThreadState* injector = nullptr; // Set by an iteration: a first use of threadState() allocates
+    bool overthrower_active = false;
+    unsigned int overthrower_pauses[max_depth] = {}; // Allocations let through, zero for a pause for forever
+    unsigned int overthrower_depth = 0; // May exceed max_depth like depth
+    RetryHistogram histogram;
+};
+
+inline WatchdogContext& watchdogContext()
+{
+    static thread_local WatchdogContext context;
+    return context;
+}
+
+// A diagnostic put together in a fixed buffer: it may have to be written with every allocation failing, and from a
+// signal handler, so text and numbers are copied by hand instead of going through the printf family
+class WatchdogMessage final {
+public:
+    WatchdogMessage& append(const char* text)
+    {
+        while (*text && length < sizeof(buffer))
+            buffer[length++] = *text++;
+        return *this;
+    }
+
+    WatchdogMessage& appendUnsigned(unsigned long long value)
+    {
+        char digits[20];
+        size_t count = 0;
+        do {
+            digits[count++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value);
+        while (count && length < sizeof(buffer))
+            buffer[length++] = digits[--count];
+        return *this;
+    }
+
+    WatchdogMessage& appendSigned(long long value)
+    {
+        if (value < 0)
+            return append("-").appendUnsigned(0ull - static_cast<unsigned long long>(value));
+        return appendUnsigned(static_cast<unsigned long long>(value));
+    }
+
+    void write() const
+    {
+        if (::write(STDERR_FILENO, buffer, length) < 0)
+            _exit(EXIT_FAILURE);
+    }
+
+private:
+    char buffer[4096];
+    size_t length = 0;
+};
+
+inline void watchdogAbort(const WatchdogContext& context, const char* reason)
+{
+    WatchdogMessage message;
+    message.append("watchdog: ").append(reason).append("\n");
+    message.append("  iteration: ").append(context.iteration_name ? context.iteration_name : "none").append(" #").appendSigned(context.iteration).append("\n");
+    message.append("  last SQL: ").append(context.last_sql[0] ? context.last_sql : "none traced").append("\n");
+    if (context.injector && context.injector->activation)
+        message.append("  allocation index: ").appendUnsigned(context.injector->allocations).append("\n");
+    else
+        message.append("  allocation index: unknown, no thread local injector is active\n");
+    message.append("  retry loops, outermost first:");
+    for (unsigned int i = 0; i < context.depth && i < WatchdogContext::max_depth; ++i) {
+        message.append(" [attempt ").appendUnsigned(context.loops[i].attempt).append(", pause ").appendUnsigned(context.loops[i].pause);
+        message.append(", status ").appendSigned(context.loops[i].status).append("]");
+    }
+    message.append(context.depth ? "\n" : " none\n");
+    if (context.injector && context.injector->activation) {
+        message.append("  injector pauses, outermost first:");
+        for (const thread_injector::Pause& pause : context.injector->pauses) {
+            if (pause.forever)
+                message.append(" [forever]");
+            else
+                message.append(" [").appendUnsigned(pause.left).append(" left]");
+        }
+        message.append(context.injector->pauses.empty() ? " none\n" : "\n");
+    }
+    message.append("  overthrower: ").append(context.overthrower_active ? "activated by this thread" : "not activated by this thread");
+    message.append(", pauses, outermost first:");
+    for (unsigned int i = 0; i < context.overthrower_depth && i < WatchdogContext::max_depth; ++i) {
+        if (context.overthrower_pauses[i])
+            message.append(" [").appendUnsigned(context.overthrower_pauses[i]).append(" allocations]");
+        else
+            message.append(" [forever]");
+    }
+    message.append(context.overthrower_depth ? "\n" : " none\n");
+    message.write();
+    abort();
+}
+
+// Keeps the text of the SQL statement the harness is about to run for the diagnostic. A trace callback would see
+// every statement, but SQLite allocates the text of nested ones for it, which shifts the allocations under test.
+inline void watchdogNote(const char* sql)
+{
+    WatchdogContext& context = watchdogContext();
+    strncpy(context.last_sql, sql, sizeof(context.last_sql) - 1);
+}
+
+// The budget of one retry loop, retry.h creates one per call and tells it about every failed attempt
+class RetryWatch final {
+public:
+    RetryWatch()
+        : context(watchdogContext())
+    {
+    }
+
+    ~RetryWatch()
+    {
+        if (started)
+            --context.depth;
+    }
+
+    RetryWatch(const RetryWatch&) = delete;
+    RetryWatch& operator=(const RetryWatch&) = delete;
+
+    // Attempt number attempt has failed with status, the next one runs with the given pause; aborts once the budget
+    // is spent. The clock is only read from the first failure on, a call which goes through costs nothing.
+    void failed(unsigned int attempt, int status, unsigned int next_pause)
+    {
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (!started) {
+            started = true;
+            first_failure = now;
+            ++context.depth;
+        }
+        if (context.depth <= WatchdogContext::max_depth)
+            context.loops[context.depth - 1] = { attempt + 1, next_pause, status };
+        const WatchdogLimits& limits = watchdogLimits();
+        if (attempt + 1 >= limits.retry_attempts)
+            watchdogAbort(context, "retry loop over its budget of attempts");
+        if (std::chrono::duration<double>(now - first_failure).count() > limits.retry_seconds)
+            watchdogAbort(context, "retry loop over its budget of seconds");
+    }
+
+    void succeeded(unsigned int attempts) { context.histogram.record(attempts); }
+
+private:
+    WatchdogContext& context;
+    bool started = false;
+    std::chrono::steady_clock::time_point first_failure;
+};
+
+// The monitor thread, started by the first iteration and checking the deadlines of all of them ten times a second
+class Watchdog final {
+public:
+    static Watchdog& instance()
+    {
+        static Watchdog watchdog;
+        return watchdog;
+    }
+
+    void add(WatchdogContext* context, const char* name, long index, std::chrono::steady_clock::time_point deadline)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (entries.size() == max_iterations) { // Growing the list would allocate, maybe under fault injection
+            WatchdogMessage message;
+            message.append("watchdog: more than ").appendUnsigned(max_iterations).append(" iterations at once, ").append(name);
+            message.append(" #").appendSigned(index).append(" cannot be watched\n");
+            message.write();
+            abort();
+        }
+        entries.push_back({ context, pthread_self(), name, index, deadline, false, deadline });
+    }
+
+    void remove(WatchdogContext* context)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (Entry& entry : entries) {
+            if (entry.context == context) {
+                entry = entries.back();
+                entries.pop_back();
+                break;
+            }
+        }
+    }
+
+private:
+    static constexpr unsigned int max_iterations = 256; // Running at once, one per thread
+
+    struct Entry {
+        WatchdogContext* context; // Only compared, never read: it belongs to the watched thread
+        pthread_t thread;
+        const char* name;
+        long index;
+        std::chrono::steady_clock::time_point deadline;
+        bool interrupted;
+        std::chrono::steady_clock::time_point interrupted_at;
+    };
+
+    // Runs on the late thread, which may read its own context
+    static void interrupted(int)
+    {
+        watchdogAbort(watchdogContext(), "iteration over its budget of seconds");
+    }
+
+    // Without an answer to the signal, e.g. with the signal blocked, only what the entry knows is reported
+    static void abortUnanswered(const Entry& entry)
+    {
+        WatchdogMessage message;
+        message.append("watchdog: iteration over its budget of seconds, the thread does not answer SIGUSR2\n");
+        message.append("  iteration: ").append(entry.name ? entry.name : "none").append(" #").appendSigned(entry.index).append("\n");
+        message.write();
+        abort();
+    }
+
+    // Waits for the monitor thread to run: whatever it allocates on start must not happen under fault injection
+    Watchdog()
+    {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = interrupted;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGUSR2, &action, nullptr);
+        entries.reserve(max_iterations);
+        std::unique_lock<std::mutex> lock(mutex);
+        monitor = std::thread([this]() { run(); });
+        wakeup.wait(lock, [this]() { return running; });
+    }
+
+    ~Watchdog()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+        }
+        wakeup.notify_one();
+        monitor.join();
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        running = true;
+        wakeup.notify_one();
+        while (!stopped) {
+            wakeup.wait_for(lock, std::chrono::milliseconds(100));
+            const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            for (Entry& entry : entries) {
+                if (now <= entry.deadline)
+                    continue;
+                if (!entry.interrupted) {
+                    entry.interrupted = true;
+                    entry.interrupted_at = now;
+                    pthread_kill(entry.thread, SIGUSR2);
+                } else if (now - entry.interrupted_at > std::chrono::seconds(1)) {
+                    abortUnanswered(entry);
+                }
+            }
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::vector<Entry> entries;
+    bool running = false;
+    bool stopped = false;
+    std::thread monitor;
+};
+
+// One iteration of a suite on the calling thread, watched for the lifetime of the object
+class WatchdogIteration final {
+public:
+    WatchdogIteration(const char* name, long index)
+        : context(watchdogContext())
+    {
+        context.iteration_name = name;
+        context.iteration = index;
+        context.last_sql[0] = '\0';
+        context.injector = &thread_injector::threadState();
+        const std::chrono::duration<double> budget(watchdogLimits().iteration_seconds);
+        Watchdog::instance().add(
+            &context, name, index, std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(budget));
+    }
+
+    ~WatchdogIteration()
+    {
+        Watchdog::instance().remove(&context);
+        context.iteration_name = nullptr;
+        context.iteration = -1;
+    }
+
+    WatchdogIteration(const WatchdogIteration&) = delete;
+    WatchdogIteration& operator=(const WatchdogIteration&) = delete;
+
+private:
+    WatchdogContext& context;
+};